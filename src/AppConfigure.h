@@ -15,7 +15,16 @@ public:
     bool showRawFrameType = false; // show raw frame type in frame table
     int  playFrameRate    = 20;
     int  playIFrameRate   = 5;
+    int  playAheadFrames  = 8; // most frames decoded ahead of playing, fewer if decoding keeps up, 0 - off
     bool showFrameInfo    = true;
+    int  frameTypeWorkers = 0; // threads of frame type extracting, <= 0 - auto
+    bool useIndexCache    = true; // reuse frame types of a file parsed before
+    int  indexCacheSizeMB = 256;
+    int  maxWorkerThreads = 0;    // threads of all open files together, <= 0 - cpu cores
+    int  sessionCacheMB   = 2048; // frame caches of all open files together
+    int  frameCacheMB     = 1024; // frame cache of one file, GOPs used least recently go first
+    int  frameCacheCodec  = 1;    // FRAME_CACHE_CODEC_E, LZ4
+    int  lz4Acceleration  = 1;    // frame cache in LZ4, higher is faster and bigger
     enum PlayStrategy : int
     {
         RestartOnEnd,
@@ -23,7 +32,8 @@ public:
     };
     PlayStrategy playStrategy = RestartOnEnd;
 
-    std::string saveFramePath = "";
+    std::string saveFramePath  = "";
+    std::string indexCachePath = ""; // empty - system temp dir
 
     ImGui::ImGuiImageSampleType imageSampleType = ImGui::ImGuiImageSampleType_Linear;
 
@@ -0,0 +1,86 @@
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include "logger.h"
+
+#include "BoxScanner.h"
+
+#define MAX_SCAN_DEPTH (16)
+
+using std::string;
+
+static bool isContainerBox(const string &type)
+{
+    static const std::set<string> containers = {"moov", "trak", "mdia", "minf", "stbl", "edts", "dinf", "mvex",
+                                                "moof", "traf", "udta", "mfra", "tref", "sinf", "schi"};
+    return containers.count(type) > 0;
+}
+
+static uint64_t readBigEndian(const uint8_t *data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+static void scanLevel(std::ifstream &file, ScannedBox &parent, uint64_t start, uint64_t end, int depth,
+                      const volatile bool *isContinue)
+{
+    uint64_t offset = start;
+    while (offset + 8 <= end && (nullptr == isContinue || *isContinue))
+    {
+        uint8_t header[16];
+        file.seekg((std::streamoff)offset);
+        if (!file.read((char *)header, 8))
+            break;
+
+        uint64_t boxSize    = readBigEndian(header, 4);
+        uint32_t headerSize = 8;
+        if (1 == boxSize)
+        {
+            if (offset + 16 > end || !file.read((char *)header + 8, 8))
+                break;
+            boxSize    = readBigEndian(header + 8, 8);
+            headerSize = 16;
+        }
+        else if (0 == boxSize)
+        {
+            boxSize = end - offset; // to the end of parent
+        }
+        if (boxSize < headerSize || boxSize > end - offset)
+        {
+            Z_INFO("stop scanning at {}, bad box size {}\n", offset, boxSize);
+            break;
+        }
+
+        ScannedBox box;
+        box.type.assign((char *)header + 4, 4);
+        box.position = offset;
+        box.size     = boxSize;
+        if (depth < MAX_SCAN_DEPTH && isContainerBox(box.type))
+            scanLevel(file, box, offset + headerSize, offset + boxSize, depth + 1, isContinue);
+
+        parent.subBoxes.push_back(std::move(box));
+        offset += boxSize;
+    }
+}
+
+int scanBoxes(const string &filePath, ScannedBox &root, const volatile bool *isContinue)
+{
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        Z_ERR("open {} fail\n", filePath);
+        return -1;
+    }
+
+    root.type     = "file";
+    root.position = 0;
+    root.size     = (uint64_t)file.tellg();
+    root.subBoxes.clear();
+
+    scanLevel(file, root, 0, root.size, 0, isContinue);
+    return root.subBoxes.empty() ? -1 : 0;
+}
@@ -0,0 +1,21 @@
+#ifndef _BOX_SCANNER_H_
+#define _BOX_SCANNER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ScannedBox
+{
+    std::string             type;
+    uint64_t                position = 0;
+    uint64_t                size     = 0;
+    std::vector<ScannedBox> subBoxes;
+};
+
+// read box headers only, from the top level down through the container boxes(moov/trak/moof...),
+// payload like mdat is skipped, so a multi-GB file costs a few thousands of small reads.
+// root gets type "file", position 0 and the file size
+int scanBoxes(const std::string &filePath, ScannedBox &root, const volatile bool *isContinue = nullptr);
+
+#endif
@@ -0,0 +1,76 @@
+#include "BoxTable.h"
+
+using std::string;
+
+void BoxTable::clear()
+{
+    mRows.clear();
+    mTypes.clear();
+    mData.clear();
+}
+
+uint32_t BoxTable::addRow(uint32_t parent, uint32_t layer, const string &type, int64_t position, int64_t size)
+{
+    BoxRow row;
+    row.parent     = parent;
+    row.layer      = layer;
+    row.typeOffset = (uint32_t)mTypes.size();
+    row.position   = position;
+    row.size       = size;
+    mTypes.append(type.c_str(), type.size() + 1);
+
+    if (BOX_TABLE_NONE != parent)
+        mRows[parent].childCount++;
+    mRows.push_back(row);
+    return (uint32_t)mRows.size() - 1;
+}
+
+void BoxTable::addBoxes(const ScannedBox &box, uint32_t parent, uint32_t layer)
+{
+    uint32_t idx = addRow(parent, layer, box.type, (int64_t)box.position, (int64_t)box.size);
+    for (auto &subBox : box.subBoxes)
+        addBoxes(subBox, idx, layer + 1);
+    mRows[idx].subtreeEnd = size();
+}
+
+void BoxTable::addBoxes(const Mp4Box &box, uint32_t parent, uint32_t layer)
+{
+    uint32_t idx = addRow(parent, layer, box.getBoxTypeStr(), (int64_t)box.getBoxPos(), (int64_t)box.getBoxSize());
+    mData.push_back(box.getData());
+
+    auto boxes = box.getSubBoxes();
+    for (auto &subBox : boxes)
+        addBoxes(*subBox, idx, layer + 1);
+    mRows[idx].subtreeEnd = size();
+}
+
+void BoxTable::build(const ScannedBox &root, const string &rootName)
+{
+    clear();
+    uint32_t rootIdx = addRow(BOX_TABLE_NONE, 0, rootName, (int64_t)root.position, (int64_t)root.size);
+    for (auto &subBox : root.subBoxes)
+        addBoxes(subBox, rootIdx, 1);
+    mRows[rootIdx].subtreeEnd = size();
+}
+
+void BoxTable::build(const Mp4Box &root, const string &rootName)
+{
+    clear();
+    uint32_t rootIdx = addRow(BOX_TABLE_NONE, 0, rootName, (int64_t)root.getBoxPos(), (int64_t)root.getBoxSize());
+    mData.push_back(root.getData());
+
+    auto boxes = root.getSubBoxes();
+    for (auto &subBox : boxes)
+        addBoxes(*subBox, rootIdx, 1);
+    mRows[rootIdx].subtreeEnd = size();
+}
+
+uint32_t BoxTable::find(int64_t position, const string &type) const
+{
+    for (uint32_t i = 0; i < size(); i++)
+    {
+        if (mRows[i].position == position && type == getType(i))
+            return i;
+    }
+    return BOX_TABLE_NONE;
+}
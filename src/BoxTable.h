@@ -0,0 +1,61 @@
+#ifndef _BOX_TABLE_H_
+#define _BOX_TABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mp4Parse.h"
+#include "BoxScanner.h"
+
+#define BOX_TABLE_NONE (0xFFFFFFFFu)
+
+// one box of a BoxTable. subtree of box i is [i + 1, subtreeEnd),
+// its first child is i + 1 and the next sibling of a child is the child's subtreeEnd
+struct BoxRow
+{
+    uint32_t parent     = BOX_TABLE_NONE;
+    uint32_t subtreeEnd = 0;
+    uint32_t childCount = 0;
+    uint32_t layer      = 0;
+    uint32_t typeOffset = 0; // in the type arena
+    int64_t  position   = 0;
+    int64_t  size       = 0;
+};
+
+// every box of a file in one flat array, in the order the tree view shows them(preorder).
+// box types share one string arena, so 100k+ moof/traf/trun boxes cost a few allocations instead of several each.
+// built in the parse thread and never changed after, the UI only reads it
+class BoxTable
+{
+public:
+    // headers from the box scanner, there's no box data
+    void build(const ScannedBox &root, const std::string &rootName);
+    // every box the parser found, with its fields
+    void build(const Mp4Box &root, const std::string &rootName);
+
+    uint32_t      size() const { return (uint32_t)mRows.size(); }
+    bool          empty() const { return mRows.empty(); }
+    bool          hasData() const { return !mData.empty(); }
+    const BoxRow &row(uint32_t idx) const { return mRows[idx]; }
+    const char   *getType(uint32_t idx) const { return mTypes.c_str() + mRows[idx].typeOffset; }
+    // null for the scanned boxes
+    std::shared_ptr<Mp4BoxData> getData(uint32_t idx) const { return idx < mData.size() ? mData[idx] : nullptr; }
+
+    // first box at position with this type, BOX_TABLE_NONE if there's none
+    uint32_t find(int64_t position, const std::string &type) const;
+
+private:
+    void     clear();
+    uint32_t addRow(uint32_t parent, uint32_t layer, const std::string &type, int64_t position, int64_t size);
+    void     addBoxes(const ScannedBox &box, uint32_t parent, uint32_t layer);
+    void     addBoxes(const Mp4Box &box, uint32_t parent, uint32_t layer);
+
+private:
+    std::vector<BoxRow>                      mRows;
+    std::string                              mTypes; // '\0' terminated types, one after another
+    std::vector<std::shared_ptr<Mp4BoxData>> mData;  // same index as mRows, empty for scanned boxes
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "CellCache.h"
+
+void CellCache::sync(uint64_t state, int frame)
+{
+    if (state != mState)
+    {
+        mRows.clear();
+        mState = state;
+    }
+    if (frame == mFrame)
+        return;
+
+    // scrolled away, keep the rows drawn in the frame before
+    if (mRows.size() > CELL_CACHE_MAX_ROWS)
+    {
+        for (auto row = mRows.begin(); row != mRows.end();)
+        {
+            if (row->second.lastFrame != mFrame)
+                row = mRows.erase(row);
+            else
+                ++row;
+        }
+    }
+    mFrame = frame;
+}
+
+const std::string &CellCache::get(size_t rowIdx, size_t colIdx, const FormatRow &format)
+{
+    auto &row = mRows[rowIdx];
+    if (row.cells.empty())
+        format(rowIdx, row.cells);
+    row.lastFrame = mFrame;
+    return colIdx < row.cells.size() ? row.cells[colIdx] : mEmpty;
+}
+
+void CellCache::clear()
+{
+    mRows.clear();
+    mState = 0;
+}
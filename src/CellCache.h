@@ -0,0 +1,38 @@
+#ifndef _CELL_CACHE_H_
+#define _CELL_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define CELL_CACHE_MAX_ROWS (512)
+
+// formatted cells of the rows a table drew lately, a row is formatted once and then only copied out each frame.
+// rows not drawn in the last frame go when there are too many, everything goes when the state changes
+class CellCache
+{
+public:
+    using FormatRow = std::function<void(size_t rowIdx, std::vector<std::string> &cells)>;
+
+    // state: what the cells are formatted with(hex setting, frame types...), frame: ImGui frame count
+    void sync(uint64_t state, int frame);
+    // rowIdx is the key, a row is formatted as a whole the first time one of its cells is asked for
+    const std::string &get(size_t rowIdx, size_t colIdx, const FormatRow &format);
+    void               clear();
+
+private:
+    struct Row
+    {
+        std::vector<std::string> cells;
+        int                      lastFrame = 0;
+    };
+
+    std::unordered_map<size_t, Row> mRows;
+    uint64_t                        mState = 0;
+    int                             mFrame = 0;
+    std::string                     mEmpty;
+};
+
+#endif
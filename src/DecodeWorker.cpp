@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+
+#include "logger.h"
+
+#include "DecodeWorker.h"
+#include "Trace.h"
+
+static std::atomic<uint64_t> sRequestId{0};
+
+uint64_t DecodeWorker::getLastRequestId()
+{
+    return sRequestId;
+}
+
+uint64_t DecodeWorker::request(uint32_t trackIdx, uint32_t frameIdx, const std::vector<AVPixelFormat> &acceptFormats)
+{
+    uint64_t id = ++sRequestId;
+    {
+        std::lock_guard<std::mutex> locker(mLock);
+        // the frame is being read ahead, the request takes that decode over instead of stopping it.
+        // not if an earlier request already told it to stop, it would only give a cancelled frame
+        if (mIsAheadRunning && mLatestId == mAheadLatestId && trackIdx == mAheadRunning.trackIdx
+            && frameIdx == mAheadRunning.frameIdx && acceptFormats == mAheadRunning.acceptFormats)
+        {
+            mAdoptId    = id;
+            mHasPending = false;
+            return id;
+        }
+        mAdoptId    = 0;
+        mPending.id            = id;
+        mPending.trackIdx      = trackIdx;
+        mPending.frameIdx      = frameIdx;
+        mPending.acceptFormats = acceptFormats;
+        mHasPending            = true;
+        // the decode running sees it and stops
+        mLatestId = id;
+    }
+    mCondition.notify_one();
+    return id;
+}
+
+void DecodeWorker::setPlayAhead(uint32_t trackIdx, std::vector<uint32_t> &&frameIdxs,
+                                const std::vector<AVPixelFormat> &acceptFormats)
+{
+    {
+        std::lock_guard<std::mutex> locker(mLock);
+        if (trackIdx != mAhead.trackIdx || acceptFormats != mAhead.acceptFormats)
+            mAhead.sent.clear();
+        // the window slides along, frames sent before and still in it are not decoded again
+        std::set<uint32_t> sent;
+        for (auto frameIdx : frameIdxs)
+        {
+            if (mAhead.sent.count(frameIdx))
+                sent.insert(frameIdx);
+        }
+        mAhead.id            = ++sRequestId;
+        mAhead.trackIdx      = trackIdx;
+        mAhead.frameIdxs     = std::move(frameIdxs);
+        mAhead.acceptFormats = acceptFormats;
+        mAhead.sent          = std::move(sent);
+    }
+    mCondition.notify_one();
+}
+
+bool DecodeWorker::nextAheadFrame(DecodeRequest *request)
+{
+    for (auto frameIdx : mAhead.frameIdxs)
+    {
+        if (mAhead.sent.count(frameIdx))
+            continue;
+        if (request)
+        {
+            request->id            = mAhead.id;
+            request->trackIdx      = mAhead.trackIdx;
+            request->frameIdx      = frameIdx;
+            request->acceptFormats = mAhead.acceptFormats;
+            mAhead.sent.insert(frameIdx);
+        }
+        return true;
+    }
+    return false;
+}
+
+void DecodeWorker::updateCost(uint32_t costUs)
+{
+    uint32_t average = mAverageCostUs;
+    mAverageCostUs   = average ? (average * 7 + costUs) / 8 : costUs;
+    // follows a slow frame at once, forgets it over some dozens of frames
+    uint32_t peak = mPeakCostUs;
+    mPeakCostUs   = std::max(costUs, peak - peak / 16);
+}
+
+bool DecodeWorker::takeFrame(DecodedFrame &frame)
+{
+    return mReadyFrames.pop(frame);
+}
+
+void DecodeWorker::starting()
+{
+    mIsContinue = true;
+}
+
+void DecodeWorker::stopping()
+{
+    {
+        std::lock_guard<std::mutex> locker(mLock);
+        mIsContinue = false;
+        mHasPending = false;
+        mAhead      = PlayAhead();
+    }
+    mCondition.notify_all();
+}
+
+void DecodeWorker::run()
+{
+    while (mIsContinue)
+    {
+        DecodeRequest request;
+        bool          isAhead  = false;
+        uint64_t      latestId = 0;
+        {
+            std::unique_lock<std::mutex> locker(mLock);
+            mCondition.wait_for(locker, std::chrono::milliseconds(100),
+                                [this]() { return mHasPending || nextAheadFrame(nullptr) || !mIsContinue; });
+            if (!mIsContinue)
+                continue;
+            if (mHasPending)
+            {
+                request     = std::move(mPending);
+                mHasPending = false;
+                // playing caught up with the window, it's not read ahead again
+                if (request.trackIdx == mAhead.trackIdx)
+                    mAhead.sent.insert(request.frameIdx);
+            }
+            else if (nextAheadFrame(&request))
+            {
+                isAhead         = true;
+                mIsAheadRunning = true;
+                mAheadRunning   = request;
+                mAheadLatestId  = mLatestId;
+            }
+            else
+            {
+                continue;
+            }
+            latestId = mLatestId;
+        }
+
+        DecodedFrame decoded;
+        decoded.requestId = request.id;
+        decoded.trackIdx  = request.trackIdx;
+        decoded.frameIdx  = request.frameIdx;
+        decoded.isAhead   = isAhead;
+        decoded.frame     = std::make_shared<MyAVFrame>();
+
+        // reading ahead gives way to any request, a request to a newer one
+        auto isCancelled = [this, latestId]() { return !mIsContinue || mLatestId != latestId; };
+        auto startTime   = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE(isAhead ? "decode_ahead" : "decode_request");
+            decoded.result = mDecode ? mDecode(request, *decoded.frame, isCancelled) : -1;
+        }
+        if (isAhead)
+        {
+            {
+                std::lock_guard<std::mutex> locker(mLock);
+                mIsAheadRunning = false;
+                if (0 != mAdoptId)
+                {
+                    decoded.requestId = mAdoptId;
+                    decoded.isAhead   = false;
+                    mAdoptId          = 0;
+                }
+                // tried again once the request is done, unless it failed by itself
+                if (decoded.result < 0 && decoded.isAhead && isCancelled() && request.trackIdx == mAhead.trackIdx)
+                    mAhead.sent.erase(request.frameIdx);
+            }
+            if (decoded.result < 0 && decoded.isAhead)
+                continue;
+            auto costUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+            updateCost((uint32_t)costUs.count());
+        }
+        // stopped half way, the newer request is waiting
+        else if (decoded.result < 0 && isCancelled())
+        {
+            continue;
+        }
+
+        if (!mReadyFrames.push(std::move(decoded)))
+            Z_ERR("decoded frame queue full, drop frame {} of track {}\n", request.frameIdx, request.trackIdx);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef _DECODE_WORKER_H_
+#define _DECODE_WORKER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "Myffmpeg.h"
+#include "SpscQueue.h"
+#include "myThread.h"
+
+#define DECODED_QUEUE_SIZE    (32)
+#define PLAY_AHEAD_MAX_FRAMES (24) // converted frames in memory, a 4K one is 12MB
+
+struct DecodeRequest
+{
+    uint64_t                   id       = 0;
+    uint32_t                   trackIdx = 0;
+    uint32_t                   frameIdx = 0; // sample index
+    std::vector<AVPixelFormat> acceptFormats;
+};
+
+struct DecodedFrame
+{
+    uint64_t                   requestId = 0;
+    uint32_t                   trackIdx  = 0;
+    uint32_t                   frameIdx  = 0;
+    int                        result    = 0; // < 0: decode failed
+    bool                       isAhead   = false; // decoded ahead of playing, nobody asked for it yet
+    std::shared_ptr<MyAVFrame> frame;
+};
+
+// decodes frames away from the render loop. only the newest request counts: a request waiting is replaced by a
+// newer one, and the decode running stops between two frames when a newer one comes. frames decoded on the way
+// stay in the decoder and its cache, so the next request goes on from there. while playing, the frames coming next
+// are decoded ahead when no request waits.
+// ready frames go back through a lock-free queue the UI thread polls every frame
+class DecodeWorker : public MyThread
+{
+public:
+    using DecodeFunc =
+        std::function<int(const DecodeRequest &request, MyAVFrame &frame, const std::function<bool()> &isCancelled)>;
+
+    void setDecodeFunc(const DecodeFunc &decode) { mDecode = decode; } // before start()
+
+    // ids grow across all workers, a frame of a closed file is never taken for a newer request
+    uint64_t        request(uint32_t trackIdx, uint32_t frameIdx, const std::vector<AVPixelFormat> &acceptFormats);
+    bool            takeFrame(DecodedFrame &frame); // in UI thread
+    static uint64_t getLastRequestId();
+
+    // frames playing reaches next, in presentation order. decoded one by one while no request waits and sent once
+    // each as ahead frames, a request stops the one running. empty frameIdxs stops reading ahead
+    void setPlayAhead(uint32_t trackIdx, std::vector<uint32_t> &&frameIdxs, const std::vector<AVPixelFormat> &acceptFormats);
+    // decode time of one frame read ahead, running average and the slowest lately
+    uint32_t getAverageCostUs() const { return mAverageCostUs; }
+    uint32_t getPeakCostUs() const { return mPeakCostUs; }
+
+private:
+    virtual void run() override;
+    virtual void starting() override;
+    virtual void stopping() override;
+
+    bool nextAheadFrame(DecodeRequest *request); // under mLock, null only checks if any is left
+    void updateCost(uint32_t costUs);
+
+private:
+    struct PlayAhead
+    {
+        uint64_t                   id       = 0;
+        uint32_t                   trackIdx = 0;
+        std::vector<uint32_t>      frameIdxs;
+        std::vector<AVPixelFormat> acceptFormats;
+        std::set<uint32_t>         sent; // or being decoded
+    };
+
+    DecodeFunc mDecode;
+
+    std::mutex              mLock;
+    std::condition_variable mCondition;
+    DecodeRequest           mPending;
+    bool                    mHasPending = false;
+    std::atomic<uint64_t>   mLatestId{0};
+    volatile bool           mIsContinue = false;
+    PlayAhead               mAhead;
+    DecodeRequest           mAheadRunning;
+    bool                    mIsAheadRunning = false;
+    uint64_t                mAheadLatestId  = 0; // mLatestId when the running read ahead started
+    uint64_t                mAdoptId        = 0; // a request for the frame being read ahead
+    std::atomic<uint32_t>   mAverageCostUs{0};
+    std::atomic<uint32_t>   mPeakCostUs{0};
+
+    SpscQueue<DecodedFrame, DECODED_QUEUE_SIZE> mReadyFrames;
+};
+
+#endif
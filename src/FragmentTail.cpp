@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "logger.h"
+
+#include "FragmentTail.h"
+#include "BoxScanner.h"
+
+#define TAIL_POLL_INTERVAL_MS (500)
+#define MAX_MOOF_SIZE         (64 * 1024 * 1024)
+
+#define TFHD_BASE_DATA_OFFSET   (0x000001)
+#define TFHD_SAMPLE_DESC_INDEX  (0x000002)
+#define TFHD_DEFAULT_DURATION   (0x000008)
+#define TFHD_DEFAULT_SIZE       (0x000010)
+#define TFHD_DEFAULT_FLAGS      (0x000020)
+#define TFHD_DEFAULT_BASE_MOOF  (0x020000)
+#define TRUN_DATA_OFFSET        (0x000001)
+#define TRUN_FIRST_SAMPLE_FLAGS (0x000004)
+#define TRUN_SAMPLE_DURATION    (0x000100)
+#define TRUN_SAMPLE_SIZE        (0x000200)
+#define TRUN_SAMPLE_FLAGS       (0x000400)
+#define TRUN_SAMPLE_CTS_OFFSET  (0x000800)
+#define SAMPLE_IS_NON_SYNC      (0x010000)
+
+using std::string;
+using std::vector;
+namespace fs = std::filesystem;
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t readU64(const uint8_t *p)
+{
+    return ((uint64_t)readU32(p) << 32) | readU32(p + 4);
+}
+
+static uint64_t toMs(uint64_t value, uint32_t timescale)
+{
+    return value * 1000 / timescale;
+}
+
+// walk the boxes in [data, data + size), stop at the first broken one
+template <typename Func>
+static int forEachBox(const uint8_t *data, uint64_t size, Func &&func)
+{
+    uint64_t offset = 0;
+    while (offset + 8 <= size)
+    {
+        uint64_t boxSize    = readU32(data + offset);
+        uint32_t headerSize = 8;
+        if (1 == boxSize && offset + 16 <= size)
+        {
+            boxSize    = readU64(data + offset + 8);
+            headerSize = 16;
+        }
+        else if (0 == boxSize)
+        {
+            boxSize = size - offset;
+        }
+        if (boxSize < headerSize || boxSize > size - offset)
+            return -1;
+
+        string type((const char *)data + offset + 4, 4);
+        if (func(type, data + offset + headerSize, boxSize - headerSize, offset) < 0)
+            return -1;
+        offset += boxSize;
+    }
+    return 0;
+}
+
+static int readPayload(std::ifstream &file, const ScannedBox &box, vector<uint8_t> &payload, uint64_t maxSize)
+{
+    if (box.size < 8 || box.size > maxSize)
+        return -1;
+    payload.resize(box.size - 8);
+    file.seekg((std::streamoff)box.position + 8);
+    return file.read((char *)payload.data(), payload.size()) ? 0 : -1;
+}
+
+static const ScannedBox *findSubBox(const ScannedBox &box, const char *type)
+{
+    for (auto &subBox : box.subBoxes)
+    {
+        if (subBox.type == type)
+            return &subBox;
+    }
+    return nullptr;
+}
+
+int FragmentTail::init(const string &filePath, const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &tables)
+{
+    if (tables.size() != tracks.size())
+        return -1;
+
+    mFilePath = filePath;
+    mTracks.clear();
+    mIndexedEnd = 0;
+    {
+        std::lock_guard<std::mutex> locker(mAppendLock);
+        mAppends.clear();
+    }
+
+    ScannedBox root;
+    if (scanBoxes(filePath, root) < 0)
+        return -1;
+
+    std::ifstream file(filePath, std::ios::binary);
+    auto          moov = findSubBox(root, "moov");
+    if (!file || !moov || !findSubBox(*moov, "mvex"))
+    {
+        Z_INFO("{} is not a fragmented file\n", filePath);
+        return -1;
+    }
+
+    vector<uint8_t> payload;
+    uint32_t        trakIndex = 0;
+    for (auto &trak : moov->subBoxes)
+    {
+        if (trak.type != "trak")
+            continue;
+
+        auto trackInfo =
+            std::find_if(tracks.begin(), tracks.end(), [trakIndex](const Mp4TrackInfo &t) { return t.trakIndex == trakIndex; });
+        trakIndex++;
+        auto tkhd = findSubBox(trak, "tkhd");
+        auto mdia = findSubBox(trak, "mdia");
+        auto mdhd = mdia ? findSubBox(*mdia, "mdhd") : nullptr;
+        if (trackInfo == tracks.end() || !tkhd || !mdhd)
+            continue;
+
+        TrackState state;
+        state.trackIdx = (uint32_t)(trackInfo - tracks.begin());
+        state.isVideo  = TRACK_TYPE_VIDEO == trackInfo->trackType;
+
+        // version 1 has 64 bits creation/modification time
+        if (readPayload(file, *tkhd, payload, 1024) < 0 || payload.size() < 32)
+            continue;
+        uint32_t trackId = 0 == payload[0] ? readU32(payload.data() + 12) : readU32(payload.data() + 20);
+
+        if (readPayload(file, *mdhd, payload, 1024) < 0 || payload.size() < 32)
+            continue;
+        state.timescale = 0 == payload[0] ? readU32(payload.data() + 12) : readU32(payload.data() + 20);
+        if (0 == state.timescale)
+            continue;
+
+        // what was appended before counts too, following may be restarted
+        auto &samples     = tables[state.trackIdx];
+        state.sampleCount = samples.size();
+        state.chunkCount  = samples.getChunks().size();
+        if (!samples.empty())
+        {
+            uint32_t last = samples.size() - 1;
+            state.nextDts = (samples.dtsMs(last) + samples.dtsDeltaMs(last)) * state.timescale / 1000;
+        }
+
+        mTracks[trackId] = state;
+    }
+
+    for (auto &trex : findSubBox(*moov, "mvex")->subBoxes)
+    {
+        if (trex.type != "trex" || readPayload(file, trex, payload, 1024) < 0 || payload.size() < 24)
+            continue;
+        auto track = mTracks.find(readU32(payload.data() + 4));
+        if (track == mTracks.end())
+            continue;
+        track->second.defaultDescIdx  = readU32(payload.data() + 8);
+        track->second.defaultDuration = readU32(payload.data() + 12);
+        track->second.defaultSize     = readU32(payload.data() + 16);
+        track->second.defaultFlags    = readU32(payload.data() + 20);
+    }
+
+    if (mTracks.empty())
+        return -1;
+
+    // the parser indexed every sample up to the top level box holding the last sample data
+    uint64_t dataEnd = moov->position + moov->size;
+    for (auto &samples : tables)
+    {
+        for (auto &chunk : samples.getChunks())
+            dataEnd = std::max<uint64_t>(dataEnd, chunk.chunkOffset + chunk.chunkSize);
+    }
+    for (auto &box : root.subBoxes)
+    {
+        if (box.position < dataEnd)
+            mIndexedEnd = box.position + box.size;
+    }
+
+    Z_INFO("follow {} from {}, {} tracks\n", filePath, mIndexedEnd.load(), mTracks.size());
+    return 0;
+}
+
+void FragmentTail::takeAppends(vector<TrackAppend> &appends)
+{
+    std::lock_guard<std::mutex> locker(mAppendLock);
+    appends = std::move(mAppends);
+    mAppends.clear();
+}
+
+void FragmentTail::starting()
+{
+    mIsContinue = true;
+}
+
+void FragmentTail::stopping()
+{
+    mIsContinue = false;
+}
+
+void FragmentTail::run()
+{
+    while (mIsContinue)
+    {
+        poll();
+        for (int i = 0; i < TAIL_POLL_INTERVAL_MS / 10 && mIsContinue; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+int FragmentTail::poll()
+{
+    std::error_code ec;
+    uint64_t        fileSize = fs::file_size(mFilePath, ec);
+    if (ec || fileSize <= mIndexedEnd)
+        return 0;
+
+    std::ifstream file(mFilePath, std::ios::binary);
+    if (!file)
+        return -1;
+
+    vector<TrackAppend> appends;
+    vector<uint8_t>     moof;
+    uint64_t            offset      = mIndexedEnd;
+    uint32_t            sampleCount = 0;
+    while (offset + 8 <= fileSize && mIsContinue)
+    {
+        uint8_t header[16];
+        file.seekg((std::streamoff)offset);
+        if (!file.read((char *)header, 8))
+            break;
+
+        uint64_t boxSize    = readU32(header);
+        uint32_t headerSize = 8;
+        if (1 == boxSize)
+        {
+            if (offset + 16 > fileSize || !file.read((char *)header + 8, 8))
+                break;
+            boxSize    = readU64(header + 8);
+            headerSize = 16;
+        }
+        // size 0 runs to the end of a file which is still growing
+        if (boxSize < headerSize || offset + boxSize > fileSize)
+            break;
+
+        if (0 == memcmp(header + 4, "moof", 4))
+        {
+            if (boxSize > MAX_MOOF_SIZE)
+            {
+                Z_ERR("moof at {} too large: {}\n", offset, boxSize);
+                break;
+            }
+            moof.resize(boxSize - headerSize);
+            if (!file.read((char *)moof.data(), moof.size()))
+                break;
+
+            // keep the state if the moof can't be taken yet
+            auto     tracksBackup = mTracks;
+            size_t   appendCount  = appends.size();
+            uint64_t dataEnd      = 0;
+            if (parseMoof(moof.data(), moof.size(), offset, appends, dataEnd) < 0 || dataEnd > fileSize)
+            {
+                mTracks = std::move(tracksBackup);
+                appends.resize(appendCount);
+                break;
+            }
+            for (size_t i = appendCount; i < appends.size(); i++)
+                sampleCount += (uint32_t)appends[i].samples.size();
+        }
+
+        offset += boxSize;
+        mIndexedEnd = offset;
+    }
+
+    if (!appends.empty())
+    {
+        Z_INFO("tail {} samples, indexed to {}\n", sampleCount, mIndexedEnd.load());
+        std::lock_guard<std::mutex> locker(mAppendLock);
+        std::move(appends.begin(), appends.end(), std::back_inserter(mAppends));
+    }
+    return (int)sampleCount;
+}
+
+int FragmentTail::parseMoof(const uint8_t *data, uint64_t size, uint64_t moofPos, vector<TrackAppend> &appends, uint64_t &dataEnd)
+{
+    bool     isFirstTraf = true;
+    uint64_t prevDataEnd = moofPos;
+    int      ret         = forEachBox(data, size,
+                                      [&](const string &type, const uint8_t *payload, uint64_t payloadSize, uint64_t)
+                                      {
+                                          if (type != "traf")
+                                              return 0;
+                                          int trafRet = parseTraf(payload, payloadSize, moofPos, isFirstTraf, prevDataEnd,
+                                                                  appends);
+                                          isFirstTraf = false;
+                                          return trafRet;
+                                      });
+    dataEnd = prevDataEnd;
+    return ret;
+}
+
+int FragmentTail::parseTraf(const uint8_t *data, uint64_t size, uint64_t moofPos, bool isFirstTraf, uint64_t &prevDataEnd,
+                            vector<TrackAppend> &appends)
+{
+    TrackState *track          = nullptr;
+    uint64_t    baseOffset     = 0;
+    uint64_t    nextDataOffset = 0;
+    uint32_t    descIdx = 0, defaultDuration = 0, defaultSize = 0, defaultFlags = 0;
+
+    return forEachBox(
+        data, size,
+        [&](const string &type, const uint8_t *payload, uint64_t payloadSize, uint64_t) -> int
+        {
+            if ("tfhd" == type)
+            {
+                if (payloadSize < 8)
+                    return -1;
+                uint32_t flags   = readU32(payload) & 0xFFFFFF;
+                auto     trackIt = mTracks.find(readU32(payload + 4));
+                if (trackIt == mTracks.end())
+                    return 0; // not a track we show
+                track = &trackIt->second;
+
+                const uint8_t *p   = payload + 8;
+                const uint8_t *end = payload + payloadSize;
+                baseOffset         = (flags & TFHD_DEFAULT_BASE_MOOF) || isFirstTraf ? moofPos : prevDataEnd;
+                if ((flags & TFHD_BASE_DATA_OFFSET) && p + 8 <= end)
+                    baseOffset = readU64(p), p += 8;
+                descIdx = track->defaultDescIdx, defaultDuration = track->defaultDuration;
+                defaultSize = track->defaultSize, defaultFlags = track->defaultFlags;
+                if ((flags & TFHD_SAMPLE_DESC_INDEX) && p + 4 <= end)
+                    descIdx = readU32(p), p += 4;
+                if ((flags & TFHD_DEFAULT_DURATION) && p + 4 <= end)
+                    defaultDuration = readU32(p), p += 4;
+                if ((flags & TFHD_DEFAULT_SIZE) && p + 4 <= end)
+                    defaultSize = readU32(p), p += 4;
+                if ((flags & TFHD_DEFAULT_FLAGS) && p + 4 <= end)
+                    defaultFlags = readU32(p), p += 4;
+                nextDataOffset = baseOffset;
+            }
+            else if ("tfdt" == type && track)
+            {
+                if (payloadSize < 8)
+                    return -1;
+                track->nextDts = 1 == payload[0] && payloadSize >= 12 ? readU64(payload + 4) : readU32(payload + 4);
+            }
+            else if ("trun" == type && track)
+            {
+                if (payloadSize < 8)
+                    return -1;
+                uint8_t        version = payload[0];
+                uint32_t       flags   = readU32(payload) & 0xFFFFFF;
+                uint32_t       count   = readU32(payload + 4);
+                const uint8_t *p       = payload + 8;
+                const uint8_t *end     = payload + payloadSize;
+
+                uint64_t dataOffset = nextDataOffset;
+                if (flags & TRUN_DATA_OFFSET)
+                {
+                    if (p + 4 > end)
+                        return -1;
+                    dataOffset = baseOffset + (int32_t)readU32(p), p += 4;
+                }
+                uint32_t firstFlags = defaultFlags;
+                bool     hasFirst   = false;
+                if (flags & TRUN_FIRST_SAMPLE_FLAGS)
+                {
+                    if (p + 4 > end)
+                        return -1;
+                    firstFlags = readU32(p), p += 4, hasFirst = true;
+                }
+
+                uint32_t recordSize = 0;
+                for (uint32_t bit : {TRUN_SAMPLE_DURATION, TRUN_SAMPLE_SIZE, TRUN_SAMPLE_FLAGS, TRUN_SAMPLE_CTS_OFFSET})
+                    recordSize += (flags & bit) ? 4 : 0;
+                if ((uint64_t)count * recordSize > (uint64_t)(end - p))
+                    return -1;
+
+                TrackAppend append;
+                append.trackIdx = track->trackIdx;
+                append.samples.reserve(count);
+
+                uint64_t chunkOffset = dataOffset;
+                uint64_t startDts    = track->nextDts;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    uint32_t duration    = defaultDuration;
+                    uint32_t sampleSize  = defaultSize;
+                    uint32_t sampleFlags = 0 == i && hasFirst ? firstFlags : defaultFlags;
+                    int64_t  ctsOffset   = 0;
+                    if (flags & TRUN_SAMPLE_DURATION)
+                        duration = readU32(p), p += 4;
+                    if (flags & TRUN_SAMPLE_SIZE)
+                        sampleSize = readU32(p), p += 4;
+                    if (flags & TRUN_SAMPLE_FLAGS)
+                        sampleFlags = 0 == i && hasFirst ? firstFlags : readU32(p), p += 4;
+                    if (flags & TRUN_SAMPLE_CTS_OFFSET)
+                        ctsOffset = version ? (int64_t)(int32_t)readU32(p) : (int64_t)readU32(p), p += 4;
+
+                    Mp4SampleItem sample{};
+                    sample.sampleIdx              = track->sampleCount++;
+                    sample.sampleOffset           = dataOffset;
+                    sample.sampleSize             = sampleSize;
+                    sample.dtsMs                  = toMs(track->nextDts, track->timescale);
+                    sample.ptsMs = toMs((uint64_t)std::max<int64_t>((int64_t)track->nextDts + ctsOffset, 0), track->timescale);
+                    sample.dtsDeltaMs             = toMs(duration, track->timescale);
+                    sample.sampleDescriptionIndex = descIdx;
+                    sample.isKeyFrame             = !(sampleFlags & SAMPLE_IS_NON_SYNC);
+                    if (track->isVideo && sample.isKeyFrame)
+                        sample.frameType = H26X_FRAME_I; // others stay unknown, no slice is read here
+                    append.samples.push_back(std::move(sample));
+
+                    dataOffset += sampleSize;
+                    track->nextDts += duration;
+                }
+                nextDataOffset = dataOffset;
+                prevDataEnd    = std::max(prevDataEnd, dataOffset);
+                if (0 == count)
+                    return 0;
+
+                Mp4ChunkItem chunk{};
+                chunk.chunkIdx               = track->chunkCount++;
+                chunk.chunkOffset            = chunkOffset;
+                chunk.chunkSize              = dataOffset - chunkOffset;
+                chunk.sampleStartIdx         = append.samples.front().sampleIdx;
+                chunk.sampleCount            = count;
+                chunk.sampleDescriptionIndex = descIdx;
+                chunk.startPtsMs             = append.samples.front().ptsMs;
+                chunk.durationMs             = toMs(track->nextDts - startDts, track->timescale);
+                chunk.avgBitrateBps          = chunk.durationMs ? (double)chunk.chunkSize * 8 * 1000 / chunk.durationMs : 0;
+                append.chunks.push_back(chunk);
+
+                appends.push_back(std::move(append));
+            }
+            return 0;
+        });
+}
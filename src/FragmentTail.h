@@ -0,0 +1,70 @@
+#ifndef _FRAGMENT_TAIL_H_
+#define _FRAGMENT_TAIL_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Mp4Parse.h"
+#include "SampleTable.h"
+#include "myThread.h"
+
+// follow a fragmented mp4 while the recorder is still writing it.
+// moof boxes appended after what the parser indexed are read in this thread, and their samples are queued
+// for the owner to append to the tracks. only complete boxes are taken, a moof waits for the next round
+// until all of its sample data is in the file, so every round reads just the new bytes
+class FragmentTail : public MyThread
+{
+public:
+    struct TrackAppend
+    {
+        uint32_t                   trackIdx = 0;
+        std::vector<Mp4SampleItem> samples;
+        std::vector<Mp4ChunkItem>  chunks;
+    };
+
+    FragmentTail() {}
+
+    // learn track ids, timescales and defaults from moov, call in caller thread before start()
+    int      init(const std::string &filePath, const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &tables);
+    void     takeAppends(std::vector<TrackAppend> &appends);
+    uint64_t getIndexedSize() const { return mIndexedEnd; }
+
+private:
+    struct TrackState
+    {
+        uint32_t trackIdx        = 0; // index in tracks
+        bool     isVideo         = false;
+        uint32_t timescale       = 1000;
+        uint32_t defaultDescIdx  = 1;
+        uint32_t defaultDuration = 0;
+        uint32_t defaultSize     = 0;
+        uint32_t defaultFlags    = 0;
+        uint64_t sampleCount     = 0;
+        uint64_t chunkCount      = 0;
+        uint64_t nextDts         = 0; // in timescale
+    };
+
+    virtual void run() override;
+    virtual void starting() override;
+    virtual void stopping() override;
+
+    int poll();
+    int parseMoof(const uint8_t *data, uint64_t size, uint64_t moofPos, std::vector<TrackAppend> &appends, uint64_t &dataEnd);
+    int parseTraf(const uint8_t *data, uint64_t size, uint64_t moofPos, bool isFirstTraf, uint64_t &prevDataEnd,
+                  std::vector<TrackAppend> &appends);
+
+private:
+    std::string                                   mFilePath;
+    std::map<uint32_t /* track_ID */, TrackState> mTracks;
+    std::atomic<uint64_t>                         mIndexedEnd{0}; // top level boxes before it are indexed
+
+    volatile bool mIsContinue = false;
+
+    std::mutex               mAppendLock;
+    std::vector<TrackAppend> mAppends;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "FrameCache.h"
+
+static inline uint64_t makeKey(uint32_t trackIdx, uint32_t sampleIdx)
+{
+    return ((uint64_t)trackIdx << 32) | sampleIdx;
+}
+
+FrameCacheData::FrameCacheData() {}
+
+FrameCacheData::~FrameCacheData() {}
+
+void FrameCache::setMaxBytes(uint64_t maxBytes)
+{
+    mMaxBytes = maxBytes;
+    evict();
+}
+
+void FrameCache::add(uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, FrameCacheData &&data)
+{
+    uint64_t frameKey = makeKey(trackIdx, sampleIdx);
+    uint64_t gopKey   = makeKey(trackIdx, keyFrameIdx);
+
+    GopIter gop;
+    auto    gopIt = mGopByKey.find(gopKey);
+    if (gopIt == mGopByKey.end())
+    {
+        mGops.emplace_front();
+        gop               = mGops.begin();
+        gop->key          = gopKey;
+        mGopByKey[gopKey] = gop;
+    }
+    else
+    {
+        gop = gopIt->second;
+        mGops.splice(mGops.begin(), mGops, gop);
+    }
+
+    uint32_t bytes = data.compressedDataSize;
+    auto     frame = mFrames.find(frameKey);
+    if (frame != mFrames.end())
+    {
+        // decoded again, same GOP
+        frame->second.gop->bytes -= frame->second.data.compressedDataSize;
+        mBytes -= frame->second.data.compressedDataSize;
+        frame->second.data = std::move(data);
+    }
+    else
+    {
+        mFrames.emplace(frameKey, Frame{std::move(data), gop});
+        gop->frames.push_back(frameKey);
+    }
+    gop->bytes += bytes;
+    mBytes += bytes;
+
+    evict();
+}
+
+FrameCacheData *FrameCache::find(uint32_t trackIdx, uint32_t sampleIdx)
+{
+    auto frame = mFrames.find(makeKey(trackIdx, sampleIdx));
+    if (frame == mFrames.end())
+        return nullptr;
+    mGops.splice(mGops.begin(), mGops, frame->second.gop);
+    return &frame->second.data;
+}
+
+bool FrameCache::contains(uint32_t trackIdx, uint32_t sampleIdx) const
+{
+    return mFrames.count(makeKey(trackIdx, sampleIdx)) > 0;
+}
+
+void FrameCache::clear()
+{
+    mFrames.clear();
+    mGopByKey.clear();
+    mGops.clear();
+    mBytes = 0;
+}
+
+void FrameCache::evict()
+{
+    while (mMaxBytes > 0 && mBytes > mMaxBytes && mGops.size() > 1)
+    {
+        auto &gop = mGops.back();
+        for (auto frameKey : gop.frames)
+            mFrames.erase(frameKey);
+        mBytes -= gop.bytes;
+        mGopByKey.erase(gop.key);
+        mGops.pop_back();
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef _FRAME_CACHE_H_
+#define _FRAME_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Myffmpeg.h"
+
+// how a frame is kept in the cache, the setting picks it for the frames cached from then on
+enum FRAME_CACHE_CODEC_E : int
+{
+    FRAME_CACHE_CODEC_RAW,
+    FRAME_CACHE_CODEC_LZ4,   // fast, with an acceleration level
+    FRAME_CACHE_CODEC_LZ4HC, // smaller and slower to compress, as fast to decompress
+    FRAME_CACHE_CODEC_DELTA, // XOR with the frame cached before it in the GOP, then LZ4
+    FRAME_CACHE_CODEC_COUNT,
+};
+
+struct FrameCacheData
+{
+    FrameCacheData();
+    virtual ~FrameCacheData();
+    FrameCacheData(FrameCacheData &&)            = default;
+    FrameCacheData &operator=(FrameCacheData &&) = default;
+
+    int width  = 0;
+    int height = 0;
+
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+
+    uint32_t originalDataSize   = 0;
+    uint32_t compressedDataSize = 0;
+    uint32_t ptsMs              = 0;
+
+    FRAME_CACHE_CODEC_E        codec        = FRAME_CACHE_CODEC_LZ4;
+    int64_t                    refSampleIdx = -1; // delta: the frame of the GOP it's XORed with, -1: not XORed
+    std::unique_ptr<uint8_t[]> compressedData;    // block of every plane, one after another
+
+    int      lineSize[AV_NUM_DATA_POINTERS]            = {0};
+    uint32_t planeCompressedSize[AV_NUM_DATA_POINTERS] = {0};
+};
+
+// decoded frames by track and sample index. a frame is kept with the others of its GOP: seeking into a GOP decodes it
+// from the key frame, so a GOP is used and dropped as a whole, the least recently used first when over the byte budget.
+// a delta frame only refers to frames of its own GOP, they are always dropped together
+// not thread safe, Mp4ParseData locks it
+class FrameCache
+{
+public:
+    void setMaxBytes(uint64_t maxBytes); // 0: no limit
+
+    // keyFrameIdx: sample index of the key frame starting the GOP
+    void            add(uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, FrameCacheData &&data);
+    FrameCacheData *find(uint32_t trackIdx, uint32_t sampleIdx); // its GOP becomes the most recently used
+    bool            contains(uint32_t trackIdx, uint32_t sampleIdx) const;
+    void            clear();
+
+    uint64_t getBytes() const { return mBytes; }
+    size_t   getFrameCount() const { return mFrames.size(); }
+    size_t   getGopCount() const { return mGops.size(); }
+
+private:
+    struct Gop
+    {
+        uint64_t              key   = 0;
+        uint64_t              bytes = 0;
+        std::vector<uint64_t> frames;
+    };
+    using GopIter = std::list<Gop>::iterator;
+    struct Frame
+    {
+        FrameCacheData data;
+        GopIter        gop;
+    };
+
+    void evict(); // the most recently used GOP always stays
+
+    uint64_t                              mMaxBytes = 0;
+    uint64_t                              mBytes    = 0;
+    std::list<Gop>                        mGops; // most recently used first
+    std::unordered_map<uint64_t, GopIter> mGopByKey;
+    std::unordered_map<uint64_t, Frame>   mFrames;
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "lz4.h"
+#include "lz4hc.h"
+
+#include "logger.h"
+
+#include "FrameCompressor.h"
+#include "Trace.h"
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
+
+static FrameCodecStats sStats[FRAME_CACHE_CODEC_COUNT];
+
+static inline uint64_t makeKey(uint32_t trackIdx, uint32_t sampleIdx)
+{
+    return ((uint64_t)trackIdx << 32) | sampleIdx;
+}
+
+static inline uint64_t elapsedUs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// dst = a ^ b, 8 bytes a time, dst may be a
+static void xorBytes(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t wordA, wordB;
+        memcpy(&wordA, a + i, 8);
+        memcpy(&wordB, b + i, 8);
+        wordA ^= wordB;
+        memcpy(dst + i, &wordA, 8);
+    }
+    for (; i < size; i++)
+        dst[i] = a[i] ^ b[i];
+}
+
+static bool isSameLayout(const AVFrame *a, const AVFrame *b)
+{
+    if (a->width != b->width || a->height != b->height || a->format != b->format)
+        return false;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+    {
+        if (a->linesize[i] != b->linesize[i])
+            return false;
+    }
+    return true;
+}
+
+FrameCodecStats &FrameCompressor::getStats(FRAME_CACHE_CODEC_E codec)
+{
+    return sStats[codec < FRAME_CACHE_CODEC_COUNT ? codec : FRAME_CACHE_CODEC_LZ4];
+}
+
+const char *FrameCompressor::getCodecName(FRAME_CACHE_CODEC_E codec)
+{
+    switch (codec)
+    {
+        case FRAME_CACHE_CODEC_RAW:
+            return "Raw";
+        case FRAME_CACHE_CODEC_LZ4:
+            return "LZ4";
+        case FRAME_CACHE_CODEC_LZ4HC:
+            return "LZ4 HC";
+        case FRAME_CACHE_CODEC_DELTA:
+            return "LZ4 Delta";
+        default:
+            return "Unknown";
+    }
+}
+
+void FrameCompressor::setCodec(FRAME_CACHE_CODEC_E codec, int acceleration)
+{
+    mCodec        = codec < FRAME_CACHE_CODEC_COUNT ? codec : FRAME_CACHE_CODEC_LZ4;
+    mAcceleration = std::max(acceleration, 1);
+}
+
+void FrameCompressor::push(uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, MyAVFrame &frame)
+{
+    {
+        std::lock_guard<std::mutex> locker(mLock);
+        uint64_t                    key = makeKey(trackIdx, sampleIdx);
+        if (mPending.count(key))
+            return;
+        if (mIsContinue && mPending.size() < FRAME_COMPRESS_MAX_PENDING)
+        {
+            auto &job = mPending[key];
+            if (av_frame_ref(job.frame.get(), frame.get()) < 0)
+            {
+                mPending.erase(key);
+                return;
+            }
+            job.trackIdx     = trackIdx;
+            job.sampleIdx    = sampleIdx;
+            job.keyFrameIdx  = keyFrameIdx;
+            job.codec        = mCodec;
+            job.acceleration = mAcceleration;
+            mOrder.push_back(key);
+            mCondition.notify_one();
+            return;
+        }
+    }
+
+    // the worker is behind, holding more frames would only grow memory. kept whole, the worker's reference is its own
+    FrameCacheData data;
+    if (compress(frame.get(), nullptr, mCodec, mAcceleration, mCallerScratch, data) == 0 && mSink)
+        mSink(trackIdx, sampleIdx, keyFrameIdx, std::move(data));
+}
+
+bool FrameCompressor::isPending(uint32_t trackIdx, uint32_t sampleIdx)
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    return mPending.count(makeKey(trackIdx, sampleIdx)) > 0;
+}
+
+bool FrameCompressor::getPending(uint32_t trackIdx, uint32_t sampleIdx, MyAVFrame &frame)
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    auto                        job = mPending.find(makeKey(trackIdx, sampleIdx));
+    if (job == mPending.end())
+        return false;
+    frame.clear();
+    return av_frame_ref(frame.get(), job->second.frame.get()) >= 0;
+}
+
+void FrameCompressor::clear()
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    mPending.clear();
+    mOrder.clear();
+    mGeneration++;
+}
+
+int FrameCompressor::compress(const AVFrame *frame, const AVFrame *ref, FRAME_CACHE_CODEC_E codec, int acceleration,
+                              Scratch &scratch, FrameCacheData &data)
+{
+    auto                      format     = (AVPixelFormat)frame->format;
+    int                       planeCount = av_pix_fmt_count_planes(format);
+    const AVPixFmtDescriptor *desc       = av_pix_fmt_desc_get(format);
+    if (planeCount <= 0 || !desc || 0 == (desc->flags & AV_PIX_FMT_FLAG_PLANAR))
+        return -1;
+    if (FRAME_CACHE_CODEC_DELTA != codec || (ref && !isSameLayout(frame, ref)))
+        ref = nullptr;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    uint32_t planeDataSize[AV_NUM_DATA_POINTERS] = {0};
+    uint32_t frameDataSize                       = 0;
+    size_t   boundSize                           = 0;
+    for (int i = 0; i < planeCount; i++)
+    {
+        if (frame->linesize[i] <= 0)
+            return -1;
+        uint32_t planeHeight = i > 0 ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        planeDataSize[i]     = frame->linesize[i] * planeHeight;
+        frameDataSize += planeDataSize[i];
+        boundSize += FRAME_CACHE_CODEC_RAW == codec ? planeDataSize[i] : LZ4_compressBound((int)planeDataSize[i]);
+    }
+    if (scratch.out.size() < boundSize)
+        scratch.out.resize(boundSize);
+    if (FRAME_CACHE_CODEC_LZ4HC == codec && scratch.hcState.size() < (size_t)LZ4_sizeofStateHC())
+        scratch.hcState.resize(LZ4_sizeofStateHC());
+
+    TRACE_SCOPE("frame_cache_compress");
+    uint32_t offset = 0;
+    for (int i = 0; i < planeCount; i++)
+    {
+        const char *src            = (const char *)frame->data[i];
+        char       *dst            = (char *)scratch.out.data() + offset;
+        int         dstSize        = (int)(scratch.out.size() - offset);
+        int         compressedSize = 0;
+        if (ref)
+        {
+            // unchanged areas turn to zeros, LZ4 takes long runs of them almost for free
+            if (scratch.delta.size() < planeDataSize[i])
+                scratch.delta.resize(planeDataSize[i]);
+            xorBytes(scratch.delta.data(), frame->data[i], ref->data[i], planeDataSize[i]);
+            src = (const char *)scratch.delta.data();
+        }
+        switch (codec)
+        {
+            case FRAME_CACHE_CODEC_RAW:
+                memcpy(dst, src, planeDataSize[i]);
+                compressedSize = (int)planeDataSize[i];
+                break;
+            case FRAME_CACHE_CODEC_LZ4HC:
+                compressedSize = LZ4_compress_HC_extStateHC(scratch.hcState.data(), src, dst, (int)planeDataSize[i], dstSize,
+                                                            FRAME_CACHE_HC_LEVEL);
+                break;
+            default:
+                compressedSize = LZ4_compress_fast(src, dst, (int)planeDataSize[i], dstSize, acceleration);
+                break;
+        }
+        if (compressedSize <= 0)
+        {
+            Z_ERR("{} compress failed:{}\n", getCodecName(codec), compressedSize);
+            return -1;
+        }
+        data.lineSize[i]            = frame->linesize[i];
+        data.planeCompressedSize[i] = compressedSize;
+        offset += compressedSize;
+    }
+
+    // only what the planes took, the bound of the whole frame stays in scratch
+    data.compressedData.reset(new uint8_t[offset]);
+    memcpy(data.compressedData.get(), scratch.out.data(), offset);
+
+    data.width              = frame->width;
+    data.height             = frame->height;
+    data.format             = format;
+    data.ptsMs              = (uint32_t)frame->pts;
+    data.codec              = codec;
+    data.refSampleIdx       = -1; // the caller knows which sample ref is
+    data.originalDataSize   = frameDataSize;
+    data.compressedDataSize = offset;
+
+    auto &stats = getStats(codec);
+    stats.encodedFrames++;
+    stats.rawBytes += frameDataSize;
+    stats.storedBytes += offset;
+    stats.encodeUs += elapsedUs(startTime);
+    return 0;
+}
+
+int FrameCompressor::decompress(const FrameCacheData &data, MyAVFrame &frame, Scratch &scratch)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(data.format);
+    if (!desc)
+        return -1;
+    bool isXored = FRAME_CACHE_CODEC_DELTA == data.codec && data.refSampleIdx >= 0;
+    if (isXored)
+    {
+        if (frame->width != data.width || frame->height != data.height || frame->format != data.format)
+            return -1;
+    }
+    else if (frame.getBuffer(data.width, data.height, data.format, data.lineSize) < 0)
+    {
+        return -1;
+    }
+
+    TRACE_SCOPE("frame_cache_decompress");
+    const uint8_t *src        = data.compressedData.get();
+    int            planeCount = av_pix_fmt_count_planes(data.format);
+    for (int i = 0; i < planeCount; i++)
+    {
+        if (frame->linesize[i] != data.lineSize[i])
+        {
+            Z_ERR("line size {} of plane {} is not the cached {}\n", frame->linesize[i], i, data.lineSize[i]);
+            return -1;
+        }
+        uint32_t planeHeight   = i > 0 ? AV_CEIL_RSHIFT(data.height, desc->log2_chroma_h) : data.height;
+        int      planeDataSize = (int)(data.lineSize[i] * planeHeight);
+        int      blockSize     = (int)data.planeCompressedSize[i];
+        if (FRAME_CACHE_CODEC_RAW == data.codec)
+        {
+            if (blockSize != planeDataSize)
+                return -1;
+            memcpy(frame->data[i], src, planeDataSize);
+        }
+        else
+        {
+            uint8_t *dst = frame->data[i];
+            if (isXored)
+            {
+                if (scratch.delta.size() < (size_t)planeDataSize)
+                    scratch.delta.resize(planeDataSize);
+                dst = scratch.delta.data();
+            }
+            int ret = LZ4_decompress_safe((const char *)src, (char *)dst, blockSize, planeDataSize);
+            if (ret != planeDataSize)
+            {
+                Z_ERR("LZ4 decompression failed with error code {}\n", ret);
+                return -1;
+            }
+            if (isXored)
+                xorBytes(frame->data[i], frame->data[i], dst, planeDataSize);
+        }
+        src += blockSize;
+    }
+    return 0;
+}
+
+void FrameCompressor::starting()
+{
+    mIsContinue = true;
+}
+
+void FrameCompressor::stopping()
+{
+    {
+        std::lock_guard<std::mutex> locker(mLock);
+        mIsContinue = false;
+    }
+    mCondition.notify_all();
+}
+
+void FrameCompressor::run()
+{
+    while (mIsContinue)
+    {
+        Job      job;
+        uint32_t generation = 0;
+        {
+            std::unique_lock<std::mutex> locker(mLock);
+            mCondition.wait_for(locker, std::chrono::milliseconds(100), [this]() { return !mOrder.empty() || !mIsContinue; });
+            if (!mIsContinue || mOrder.empty())
+                continue;
+            // stays queued till it's in the cache, getPending finds it meanwhile
+            auto &pending    = mPending[mOrder.front()];
+            job.trackIdx     = pending.trackIdx;
+            job.sampleIdx    = pending.sampleIdx;
+            job.keyFrameIdx  = pending.keyFrameIdx;
+            job.codec        = pending.codec;
+            job.acceleration = pending.acceleration;
+            if (av_frame_ref(job.frame.get(), pending.frame.get()) < 0)
+            {
+                mPending.erase(mOrder.front());
+                mOrder.pop_front();
+                continue;
+            }
+            generation = mGeneration;
+        }
+
+        // the frame before it in the same GOP, still in the cache as the GOP goes as a whole
+        const AVFrame *ref = nullptr;
+        if (FRAME_CACHE_CODEC_DELTA == job.codec && mReference.valid && mReference.generation == generation
+            && mReference.trackIdx == job.trackIdx && mReference.keyFrameIdx == job.keyFrameIdx
+            && mReference.chain < FRAME_CACHE_DELTA_MAX_CHAIN && isSameLayout(job.frame.get(), mReference.frame.get()))
+            ref = mReference.frame.get();
+
+        FrameCacheData data;
+        int            ret = compress(job.frame.get(), ref, job.codec, job.acceleration, mScratch, data);
+        if (ref && 0 == ret)
+            data.refSampleIdx = mReference.sampleIdx;
+
+        std::lock_guard<std::mutex> locker(mLock);
+        if (generation != mGeneration)
+        {
+            mReference.valid = false;
+            continue;
+        }
+        if (0 == ret && mSink)
+            mSink(job.trackIdx, job.sampleIdx, job.keyFrameIdx, std::move(data));
+        mPending.erase(mOrder.front());
+        mOrder.pop_front();
+
+        mReference.valid = 0 == ret;
+        if (0 == ret)
+        {
+            mReference.chain = ref ? mReference.chain + 1 : 0;
+            mReference.frame.clear();
+            av_frame_ref(mReference.frame.get(), job.frame.get());
+            mReference.generation  = generation;
+            mReference.trackIdx    = job.trackIdx;
+            mReference.sampleIdx   = job.sampleIdx;
+            mReference.keyFrameIdx = job.keyFrameIdx;
+        }
+    }
+
+    std::lock_guard<std::mutex> locker(mLock);
+    mPending.clear();
+    mOrder.clear();
+    mReference.valid = false;
+    mReference.frame.clear();
+}
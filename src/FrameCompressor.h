@@ -0,0 +1,111 @@
+#ifndef _FRAME_COMPRESSOR_H_
+#define _FRAME_COMPRESSOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "FrameCache.h"
+#include "Myffmpeg.h"
+#include "myThread.h"
+
+#define FRAME_COMPRESS_MAX_PENDING  (8) // frames held by reference, past it the caller compresses itself
+#define FRAME_CACHE_DELTA_MAX_CHAIN (4) // delta frames in a row, reading one back decompresses at most this many more
+#define FRAME_CACHE_HC_LEVEL        (4) // higher levels take too long for 4K frames to keep up with decoding
+
+// what the cache codecs did in this process, each one counted apart
+struct FrameCodecStats
+{
+    std::atomic<uint64_t> encodedFrames{0};
+    std::atomic<uint64_t> rawBytes{0};
+    std::atomic<uint64_t> storedBytes{0};
+    std::atomic<uint64_t> encodeUs{0};
+    std::atomic<uint64_t> decodedFrames{0};
+    std::atomic<uint64_t> decodedBytes{0};
+    std::atomic<uint64_t> decodeUs{0}; // a delta frame counts the frames it's XORed with too
+};
+
+// compression of decoded frames off the decode path. a frame is queued by reference, no copy, and compressed
+// plane by plane straight from it into a reused buffer, the cache gets it through the sink. a frame queued and not
+// compressed yet can still be taken back, so it never has to be decoded again meanwhile
+class FrameCompressor : public MyThread
+{
+public:
+    using Sink = std::function<void(uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, FrameCacheData &&data)>;
+
+    // buffers reused by one thread
+    struct Scratch
+    {
+        std::vector<uint8_t> out;
+        std::vector<uint8_t> delta;
+        std::vector<uint8_t> hcState;
+    };
+
+    void setSink(const Sink &sink) { mSink = sink; } // called in the worker thread, before start()
+    void setCodec(FRAME_CACHE_CODEC_E codec, int acceleration); // for frames pushed from now on
+
+    // from one thread only, the decode path. software frames, planar
+    void push(uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, MyAVFrame &frame);
+    bool isPending(uint32_t trackIdx, uint32_t sampleIdx);
+    bool getPending(uint32_t trackIdx, uint32_t sampleIdx, MyAVFrame &frame); // a new reference to it
+    void clear(); // frames queued or being compressed never reach the sink
+
+    // every plane its own block, one after another in data.compressedData. ref: delta only, the frame before it in
+    // the GOP with the same size and format, null to keep it whole
+    static int compress(const AVFrame *frame, const AVFrame *ref, FRAME_CACHE_CODEC_E codec, int acceleration,
+                        Scratch &scratch, FrameCacheData &data);
+    // straight into the planes of frame, allocated here with the line sizes cached. a delta frame with a reference
+    // is XORed into frame in place, which has to hold that reference already
+    static int decompress(const FrameCacheData &data, MyAVFrame &frame, Scratch &scratch);
+
+    static FrameCodecStats &getStats(FRAME_CACHE_CODEC_E codec);
+    static const char      *getCodecName(FRAME_CACHE_CODEC_E codec);
+
+private:
+    virtual void run() override;
+    virtual void starting() override;
+    virtual void stopping() override;
+
+private:
+    struct Job
+    {
+        uint32_t            trackIdx     = 0;
+        uint32_t            sampleIdx    = 0;
+        uint32_t            keyFrameIdx  = 0;
+        FRAME_CACHE_CODEC_E codec        = FRAME_CACHE_CODEC_LZ4;
+        int                 acceleration = 1;
+        MyAVFrame           frame;
+    };
+    // the frame the worker compressed last, a delta frame after it in the GOP refers to it
+    struct Reference
+    {
+        bool      valid       = false;
+        uint32_t  generation  = 0;
+        uint32_t  trackIdx    = 0;
+        uint32_t  sampleIdx   = 0;
+        uint32_t  keyFrameIdx = 0;
+        int       chain       = 0; // delta frames before it down to one kept whole
+        MyAVFrame frame;
+    };
+
+    Sink                             mSink;
+    std::atomic<FRAME_CACHE_CODEC_E> mCodec{FRAME_CACHE_CODEC_LZ4};
+    std::atomic<int>                 mAcceleration{1};
+
+    std::mutex                        mLock;
+    std::condition_variable           mCondition;
+    std::unordered_map<uint64_t, Job> mPending;
+    std::deque<uint64_t>              mOrder;          // keys of mPending, oldest first
+    uint32_t                          mGeneration = 0; // changes on clear()
+    volatile bool                     mIsContinue = false;
+    Scratch                           mScratch;       // worker thread
+    Scratch                           mCallerScratch; // caller thread, when too many are queued
+    Reference                         mReference;     // worker thread
+};
+
+#endif
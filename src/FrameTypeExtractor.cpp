@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "logger.h"
+
+#include "FrameTypeExtractor.h"
+#include "NaluScanner.h"
+#include "SampleReader.h"
+#include "Trace.h"
+
+#define MAX_EXTRACT_WORKERS (8)
+#define MIN_TASK_SAMPLES    (64) // small enough that the visible samples spread over several workers
+#define SCAN_VERIFY_SAMPLES (16) // per worker and track, compared with the parser before the scanner is trusted
+
+using std::string;
+using std::vector;
+
+bool FrameTypeExtractor::isTrackSupported(const Mp4TrackInfo &track)
+{
+    if (TRACK_TYPE_VIDEO != track.trackType || !track.mediaInfo)
+        return false;
+
+    auto codecType = mp4GetCodecType(track.mediaInfo->codecCode);
+    return MP4_CODEC_H264 == codecType || MP4_CODEC_HEVC == codecType;
+}
+
+void FrameTypeExtractor::clear()
+{
+    mTasks.clear();
+    mTaskStates.reset();
+    mTrackTasks.clear();
+    mResults.clear();
+    mTrackScans.reset();
+    mPoolBlocks.clear();
+    mPoolBlockUsed = NALU_POOL_BLOCK;
+    mNextTask      = 0;
+    mTotalCount    = 0;
+    mParsedCount   = 0;
+
+    std::lock_guard<std::mutex> locker(mPriorityLock);
+    mPriorityRanges.clear();
+}
+
+void FrameTypeExtractor::prepare(const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &samples)
+{
+    clear();
+    mIsContinue = true;
+
+    mTrackTasks.resize(tracks.size(), {0, 0});
+    mResults.resize(tracks.size());
+    mTrackScans = std::make_unique<TrackScan[]>(tracks.size());
+
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); trackIdx++)
+    {
+        auto &track = tracks[trackIdx];
+        if (!isTrackSupported(track) || trackIdx >= samples.size())
+            continue;
+
+        uint32_t sampleCount = samples[trackIdx].size();
+        uint32_t taskStart   = 0;
+
+        mTrackTasks[trackIdx].first = mTasks.size();
+
+        // cut at chunk boundaries, samples of one chunk are continuous in file
+        for (auto &chunk : samples[trackIdx].getChunks())
+        {
+            uint32_t chunkEnd = (uint32_t)std::min<uint64_t>(chunk.sampleStartIdx + chunk.sampleCount, sampleCount);
+            if (chunkEnd > taskStart && chunkEnd - taskStart >= MIN_TASK_SAMPLES)
+            {
+                mTasks.push_back({trackIdx, taskStart, chunkEnd});
+                taskStart = chunkEnd;
+            }
+        }
+        // no chunk info or remaining samples
+        while (taskStart < sampleCount)
+        {
+            uint32_t taskEnd = std::min<uint32_t>(taskStart + MIN_TASK_SAMPLES, sampleCount);
+            if (sampleCount - taskEnd < MIN_TASK_SAMPLES / 2)
+                taskEnd = sampleCount;
+            mTasks.push_back({trackIdx, taskStart, taskEnd});
+            taskStart = taskEnd;
+        }
+
+        mTrackTasks[trackIdx].second = mTasks.size();
+
+        auto &result      = mResults[trackIdx];
+        result.frameTypes = std::make_unique<std::atomic<uint8_t>[]>(sampleCount);
+        for (uint32_t i = 0; i < sampleCount; i++)
+            result.frameTypes[i] = FRAME_TYPE_UNPARSED;
+        result.naluSlots   = std::make_unique<NaluSlot[]>(sampleCount);
+        result.sampleCount = sampleCount;
+
+        mTotalCount += sampleCount;
+    }
+
+    mTaskStates = std::make_unique<std::atomic<uint8_t>[]>(mTasks.size());
+    for (size_t i = 0; i < mTasks.size(); i++)
+        mTaskStates[i] = TASK_PENDING;
+}
+
+void FrameTypeExtractor::setPriorityRanges(uint32_t trackIdx, const SampleRanges &ranges)
+{
+    std::lock_guard<std::mutex> locker(mPriorityLock);
+    mPriorityTrack  = trackIdx;
+    mPriorityRanges = ranges;
+}
+
+bool FrameTypeExtractor::isFrameParsed(uint32_t trackIdx, uint32_t sampleIdx) const
+{
+    // tracks not handled here keep what the parser gives
+    if (trackIdx >= mResults.size() || !mResults[trackIdx].frameTypes)
+        return true;
+    // appended after the pass started(file tail), this pass never reads it
+    if (sampleIdx >= mResults[trackIdx].sampleCount)
+        return false;
+    return FRAME_TYPE_UNPARSED != mResults[trackIdx].frameTypes[sampleIdx];
+}
+
+H26X_FRAME_TYPE_E FrameTypeExtractor::getFrameType(uint32_t trackIdx, uint32_t sampleIdx, H26X_FRAME_TYPE_E fallback) const
+{
+    if (trackIdx >= mResults.size() || sampleIdx >= mResults[trackIdx].sampleCount)
+        return fallback;
+    uint8_t frameType = mResults[trackIdx].frameTypes[sampleIdx];
+    return FRAME_TYPE_UNPARSED == frameType ? fallback : (H26X_FRAME_TYPE_E)frameType;
+}
+
+FrameTypeExtractor::NaluTypes FrameTypeExtractor::getNaluTypes(uint32_t trackIdx, uint32_t sampleIdx) const
+{
+    if (!isFrameParsed(trackIdx, sampleIdx) || sampleIdx >= mResults[trackIdx].sampleCount)
+        return NaluTypes();
+
+    auto &slot = mResults[trackIdx].naluSlots[sampleIdx];
+    return NaluTypes{slot.count > NALU_INLINE_COUNT ? slot.overflow : slot.types, slot.count};
+}
+
+const uint8_t *FrameTypeExtractor::allocNaluTypes(const uint8_t *naluTypes, uint32_t naluCount)
+{
+    std::lock_guard<std::mutex> locker(mPoolLock);
+    if (mPoolBlockUsed + naluCount > NALU_POOL_BLOCK)
+    {
+        mPoolBlocks.push_back(std::make_unique<uint8_t[]>(NALU_POOL_BLOCK));
+        mPoolBlockUsed = 0;
+    }
+    uint8_t *types = mPoolBlocks.back().get() + mPoolBlockUsed;
+    memcpy(types, naluTypes, naluCount);
+    mPoolBlockUsed += naluCount;
+    return types;
+}
+
+void FrameTypeExtractor::setFrameType(uint32_t trackIdx, uint32_t sampleIdx, H26X_FRAME_TYPE_E frameType,
+                                      const uint8_t *naluTypes, uint32_t naluCount)
+{
+    if (trackIdx >= mResults.size() || sampleIdx >= mResults[trackIdx].sampleCount)
+        return;
+
+    // every sample has only one writer, publish the slot before the type
+    auto &result = mResults[trackIdx];
+    auto &slot   = result.naluSlots[sampleIdx];
+    slot.count   = (uint8_t)std::min<uint32_t>(naluCount, UINT8_MAX);
+    if (slot.count > NALU_INLINE_COUNT)
+        slot.overflow = allocNaluTypes(naluTypes, slot.count);
+    else
+        memcpy(slot.types, naluTypes, slot.count);
+    if (FRAME_TYPE_UNPARSED == result.frameTypes[sampleIdx].exchange((uint8_t)frameType))
+        mParsedCount++;
+}
+
+bool FrameTypeExtractor::tryClaimTask(size_t taskIdx)
+{
+    uint8_t expected = TASK_PENDING;
+    return mTaskStates[taskIdx].compare_exchange_strong(expected, TASK_CLAIMED);
+}
+
+int FrameTypeExtractor::claimTask()
+{
+    {
+        std::lock_guard<std::mutex> locker(mPriorityLock);
+        if (mPriorityTrack < mTrackTasks.size())
+        {
+            auto taskBegin = mTasks.begin() + mTrackTasks[mPriorityTrack].first;
+            auto taskEnd   = mTasks.begin() + mTrackTasks[mPriorityTrack].second;
+            for (auto &range : mPriorityRanges)
+            {
+                // first task which ends after range.first
+                auto task = std::upper_bound(taskBegin, taskEnd, range.first,
+                                             [](uint32_t sampleIdx, const ParseTask &t) { return sampleIdx < t.endIdx; });
+                for (; task != taskEnd && task->startIdx <= range.second; task++)
+                {
+                    size_t taskIdx = task - mTasks.begin();
+                    if (tryClaimTask(taskIdx))
+                        return (int)taskIdx;
+                }
+            }
+        }
+    }
+
+    // background fill, mNextTask is only a hint of where the unclaimed tasks start
+    for (size_t taskIdx = mNextTask; taskIdx < mTasks.size(); taskIdx++)
+    {
+        if (tryClaimTask(taskIdx))
+        {
+            size_t nextTask = mNextTask;
+            while (nextTask < taskIdx + 1 && !mNextTask.compare_exchange_weak(nextTask, taskIdx + 1))
+            {
+            }
+            return (int)taskIdx;
+        }
+    }
+    return -1;
+}
+
+// a parser of the worker's own, made on first use since it parses the whole file again
+struct WorkerParser
+{
+    std::shared_ptr<Mp4Parser>                 parser;
+    std::vector<std::shared_ptr<Mp4TrackInfo>> tracks;
+    bool                                       failed = false;
+};
+
+static Mp4Parser *getWorkerParser(const string &filePath, WorkerParser &worker)
+{
+    if (worker.parser || worker.failed)
+        return worker.parser.get();
+
+    auto parser = createMp4Parser();
+    {
+        TRACE_SCOPE("worker_parse_file");
+        parser->parse(filePath);
+    }
+    if (!parser->isParseSuccess())
+    {
+        Z_ERR("worker parse {} fail: {}\n", filePath, parser->getErrorMessage());
+        worker.failed = true;
+        return nullptr;
+    }
+    worker.tracks = parser->getTracksInfo();
+    worker.parser = parser;
+    return worker.parser.get();
+}
+
+// what one worker keeps of a track while scanning its samples
+struct WorkerTrackScan
+{
+    bool                             ready = false;
+    std::unique_ptr<SliceTypeParser> sliceParser;
+    vector<NaluSpan>                 nalus;
+    vector<uint8_t>                  buffer;
+};
+
+static void initWorkerScan(bool isHevc, const vector<uint8_t> &parameterSets, WorkerTrackScan &scan)
+{
+    scan.ready       = true;
+    scan.sliceParser = std::make_unique<SliceTypeParser>(isHevc);
+    if (parameterSets.empty())
+        return;
+    // the wrapped key frame carries the parameter sets of the sample description
+    scanAnnexBNalus(parameterSets.data(), parameterSets.size(), isHevc, scan.nalus);
+    scan.sliceParser->addParameterSets(parameterSets.data(), scan.nalus);
+}
+
+// H26X_FRAME_Unknown: leave the sample to the parser
+static H26X_FRAME_TYPE_E scanSample(const string &filePath, WorkerParser &worker, SampleReader &reader, uint32_t trakIndex,
+                                    const SampleTable &samples, uint32_t sampleIdx, bool directRead, bool isHevc,
+                                    int lengthSize, WorkerTrackScan &scan, uint8_t *naluTypes, uint32_t &naluCount)
+{
+    TRACE_SCOPE("scan_nalus");
+    Mp4RawSample   raw;
+    const uint8_t *data     = nullptr;
+    size_t         dataSize = 0;
+    if (directRead)
+    {
+        // samples of a task are in file order, the reader reads the next chunks ahead
+        uint32_t size = samples.sampleSize(sampleIdx);
+        scan.buffer.resize(size);
+        if (reader.read(trakIndex, sampleIdx, samples.sampleOffset(sampleIdx), size, scan.buffer.data()) < 0)
+            return H26X_FRAME_Unknown;
+        data     = scan.buffer.data();
+        dataSize = scan.buffer.size();
+    }
+    else
+    {
+        auto parser = getWorkerParser(filePath, worker);
+        if (!parser || parser->getSample(trakIndex, sampleIdx, raw) < 0 || !raw.sampleData)
+            return H26X_FRAME_Unknown;
+        data     = raw.sampleData.get();
+        dataSize = raw.dataSize;
+    }
+
+    int ret = lengthSize > 0 ? scanLengthPrefixedNalus(data, dataSize, lengthSize, isHevc, scan.nalus)
+                             : scanAnnexBNalus(data, dataSize, isHevc, scan.nalus);
+    if (ret < 0)
+        return H26X_FRAME_Unknown;
+
+    naluCount = (uint32_t)std::min<size_t>(scan.nalus.size(), UINT8_MAX);
+    for (uint32_t i = 0; i < naluCount; i++)
+        naluTypes[i] = scan.nalus[i].type;
+    return scan.sliceParser->getFrameType(data, scan.nalus);
+}
+
+// frame type and nalu types from the parser, its nalu list is dropped once copied
+static H26X_FRAME_TYPE_E parseSample(Mp4Parser &parser, const WorkerParser &worker, uint32_t trakIndex, uint32_t sampleIdx,
+                                     uint8_t *naluTypes, uint32_t &naluCount)
+{
+    H26X_FRAME_TYPE_E frameType;
+    {
+        TRACE_SCOPE("parse_nalu_type");
+        frameType = parser.parseVideoNaluType(trakIndex, sampleIdx);
+    }
+
+    // nalu types are 5(h264) or 6(h265) bits
+    naluCount = 0;
+    if (trakIndex >= worker.tracks.size() || sampleIdx >= worker.tracks[trakIndex]->mediaInfo->samplesInfo.size())
+        return frameType;
+    auto &parserNaluTypes = worker.tracks[trakIndex]->mediaInfo->samplesInfo[sampleIdx].naluTypes;
+    naluCount             = (uint32_t)std::min<size_t>(parserNaluTypes.size(), UINT8_MAX);
+    for (uint32_t i = 0; i < naluCount; i++)
+        naluTypes[i] = (uint8_t)parserNaluTypes[i];
+    parserNaluTypes.clear();
+    parserNaluTypes.shrink_to_fit();
+    return frameType;
+}
+
+// the scanner of a track is turned on only if it gives what the parser gives for the first samples of the task
+static void probeTrackScan(const string &filePath, WorkerParser &worker, SampleReader &reader, uint32_t trakIndex,
+                           const Mp4TrackInfo &track, const SampleTable &samples, uint32_t startIdx,
+                           FrameTypeExtractor::TrackScan &scan)
+{
+    scan.probed = true;
+    scan.isHevc = MP4_CODEC_HEVC == mp4GetCodecType(track.mediaInfo->codecCode);
+
+    auto probeSamples = pickWrapProbeSamples(
+        samples.size(), [&samples](uint32_t idx) { return samples.isKeyFrame(idx); },
+        [&samples](uint32_t idx) { return samples.descriptionIndex(idx); }, scan.descriptionIndex);
+    auto parser = getWorkerParser(filePath, worker);
+    if (probeSamples.empty() || !parser)
+        return;
+
+    SampleWrapLayout layout;
+    Mp4RawSample     raw;
+    if (probeSampleWrapLayout(*parser, trakIndex, scan.isHevc, probeSamples, layout) >= 0)
+    {
+        scan.lengthSize    = layout.lengthSize;
+        scan.parameterSets = layout.keyFramePrefix;
+    }
+    else if (parser->getSample(trakIndex, probeSamples[0].sampleIdx, raw) >= 0 && raw.sampleData
+             && findStartCode(raw.sampleData.get(), std::min<size_t>(raw.dataSize, 4)) < 2)
+    {
+        // some muxers leave the start codes(and in band parameter sets) in the samples
+        scan.lengthSize = 0;
+    }
+    else
+    {
+        Z_INFO("track {} samples are left to the parser\n", trakIndex);
+        return;
+    }
+
+    uint32_t probeIdx = probeSamples[0].sampleIdx;
+    reader.setTrackChunks(trakIndex, &samples.getChunks());
+    scan.directRead = reader.isOpen()
+                      && reader.isSameAsParser(*parser, trakIndex, probeIdx, samples.sampleOffset(probeIdx),
+                                               samples.sampleSize(probeIdx));
+
+    WorkerTrackScan verifyScan;
+    initWorkerScan(scan.isHevc, scan.parameterSets, verifyScan);
+    uint8_t  scannedNaluTypes[UINT8_MAX];
+    uint8_t  naluTypes[UINT8_MAX];
+    uint32_t verified = 0;
+    for (uint32_t sampleIdx = startIdx; sampleIdx < samples.size() && verified < SCAN_VERIFY_SAMPLES; sampleIdx++)
+    {
+        if (samples.descriptionIndex(sampleIdx) != scan.descriptionIndex)
+            continue;
+        uint32_t scannedCount = 0;
+        auto     scannedType  = scanSample(filePath, worker, reader, trakIndex, samples, sampleIdx, scan.directRead, scan.isHevc,
+                                           scan.lengthSize, verifyScan, scannedNaluTypes, scannedCount);
+        if (H26X_FRAME_Unknown == scannedType)
+            continue;
+        uint32_t naluCount = 0;
+        auto     frameType = parseSample(*parser, worker, trakIndex, sampleIdx, naluTypes, naluCount);
+        if (scannedType != frameType || scannedCount != naluCount || 0 != memcmp(scannedNaluTypes, naluTypes, naluCount))
+        {
+            Z_INFO("track {} sample {} scanned as {} but parsed as {}, scanner off\n", trakIndex, sampleIdx, (int)scannedType,
+                   (int)frameType);
+            return;
+        }
+        verified++;
+    }
+    scan.enabled = true;
+}
+
+void FrameTypeExtractor::workerRun(const string &filePath, const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &samples,
+                                   const FrameParsedCallback &onFrameParsed)
+{
+    WorkerParser worker;
+
+    // every worker reads ahead in its own task ranges
+    SampleReader reader;
+    reader.open(filePath);
+
+    vector<WorkerTrackScan> trackScans(tracks.size());
+    while (mIsContinue)
+    {
+        int taskIdx = claimTask();
+        if (taskIdx < 0)
+            break;
+
+        auto    &task         = mTasks[taskIdx];
+        uint32_t trakIndex    = tracks[task.trackIdx].trakIndex;
+        auto    &trackSamples = samples[task.trackIdx];
+        auto    &setup        = mTrackScans[task.trackIdx];
+        auto    &scan         = trackScans[task.trackIdx];
+        if (!scan.ready)
+        {
+            // the other workers wait for the first one probing the track
+            std::lock_guard<std::mutex> locker(setup.probeLock);
+            if (!setup.probed)
+                probeTrackScan(filePath, worker, reader, trakIndex, tracks[task.trackIdx], trackSamples, task.startIdx, setup);
+            initWorkerScan(setup.isHevc, setup.parameterSets, scan);
+            if (setup.directRead)
+                reader.setTrackChunks(trakIndex, &trackSamples.getChunks());
+        }
+
+        uint8_t naluTypes[UINT8_MAX];
+        for (uint32_t sampleIdx = task.startIdx; sampleIdx < task.endIdx; sampleIdx++)
+        {
+            if (!mIsContinue)
+                return;
+
+            // the scanner reads the slice header itself, the parser covers what it can't tell
+            H26X_FRAME_TYPE_E frameType = H26X_FRAME_Unknown;
+            uint32_t          naluCount = 0;
+            if (setup.enabled && trackSamples.descriptionIndex(sampleIdx) == setup.descriptionIndex)
+                frameType = scanSample(filePath, worker, reader, trakIndex, trackSamples, sampleIdx, setup.directRead,
+                                       setup.isHevc, setup.lengthSize, scan, naluTypes, naluCount);
+            if (H26X_FRAME_Unknown == frameType)
+            {
+                auto parser = getWorkerParser(filePath, worker);
+                if (!parser)
+                    return;
+                // every worker writes its own sample range, no lock needed for the result
+                frameType = parseSample(*parser, worker, trakIndex, sampleIdx, naluTypes, naluCount);
+            }
+
+            setFrameType(task.trackIdx, sampleIdx, frameType, naluTypes, naluCount);
+            if (nullptr != onFrameParsed)
+            {
+                std::lock_guard<std::mutex> locker(mCallbackLock);
+                onFrameParsed(trakIndex, sampleIdx, frameType);
+            }
+            Z_DBG("get frame {} type {}\n", sampleIdx, frameType);
+        }
+    }
+}
+
+int FrameTypeExtractor::getAutoWorkerCount()
+{
+    return std::min(std::max((int)std::thread::hardware_concurrency(), 1), MAX_EXTRACT_WORKERS);
+}
+
+int FrameTypeExtractor::extract(const string &filePath, const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &samples,
+                                const FrameParsedCallback &onFrameParsed)
+{
+    if (mTasks.empty())
+        return 0;
+
+    int workerCount = mWorkerCount;
+    if (workerCount <= 0)
+        workerCount = getAutoWorkerCount();
+    workerCount = std::min(workerCount, (int)mTasks.size());
+
+    Z_INFO("extract frame type of {} samples in {} tasks with {} workers\n", mTotalCount.load(), mTasks.size(), workerCount);
+
+    vector<std::thread> workers;
+    for (int i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(&FrameTypeExtractor::workerRun, this, std::cref(filePath), std::cref(tracks), std::cref(samples),
+                             std::cref(onFrameParsed));
+    }
+    for (auto &worker : workers)
+        worker.join();
+
+    if (mParsedCount < mTotalCount)
+    {
+        Z_INFO("frame type extracting stopped at {}/{}\n", mParsedCount.load(), mTotalCount.load());
+        return -1;
+    }
+    return 0;
+}
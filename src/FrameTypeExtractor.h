@@ -0,0 +1,143 @@
+#ifndef _FRAME_TYPE_EXTRACTOR_H_
+#define _FRAME_TYPE_EXTRACTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Mp4Parse.h"
+#include "SampleTable.h"
+
+// split the frame type pass of H264/H265 tracks into chunk aligned sample ranges,
+// workers read samples at the offsets of the sample tables with a reader of their own, so they never share a file handle.
+// a worker parses the file again only when it needs a parser: probing a track, or samples the scanner can't tell.
+// ranges covering the priority samples(what the user is looking at) are taken first, then the rest in file order.
+// results are kept here instead of in the samples, so the sample tables can stay shared with the parser.
+// nalu types of a sample are stored inline in a fixed slot, only samples with many nalus take bytes from a pool
+class FrameTypeExtractor
+{
+public:
+    typedef std::function<void(unsigned int trackIdx, int frameIdx, H26X_FRAME_TYPE_E frameType)> FrameParsedCallback;
+    typedef std::vector<std::pair<uint32_t, uint32_t>>                                             SampleRanges; // [first, last]
+
+    // points into the slot or the pool, valid until clear()
+    struct NaluTypes
+    {
+        const uint8_t *types = nullptr;
+        uint32_t       count = 0;
+
+        uint32_t       size() const { return count; }
+        bool           empty() const { return 0 == count; }
+        uint8_t        operator[](uint32_t idx) const { return types[idx]; }
+        const uint8_t *begin() const { return types; }
+        const uint8_t *end() const { return types + count; }
+    };
+
+    // how the samples of a track are scanned, probed once against a parser by the first worker reaching the track
+    struct TrackScan
+    {
+        std::mutex           probeLock;
+        bool                 probed           = false;
+        bool                 enabled          = false;
+        bool                 isHevc           = false;
+        int                  lengthSize       = 0; // 0: start codes in the samples
+        uint32_t             descriptionIndex = 0;
+        bool                 directRead       = false; // from the sample reader instead of the parser
+        std::vector<uint8_t> parameterSets;            // prefix of the wrapped key frames
+    };
+
+    FrameTypeExtractor() {}
+
+    void       setWorkerCount(int count) { mWorkerCount = count; } // <= 0: auto
+    static int getAutoWorkerCount(); // cpu cores, capped since a worker may keep sample tables of its own parser
+    // build tasks in caller thread, so the parsed state is ready before extract() starts.
+    // samples: tables of the tracks, same index, not changed until extract() returns
+    void prepare(const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &samples);
+    int  extract(const std::string &filePath, const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &samples,
+                 const FrameParsedCallback &onFrameParsed);
+    void stop() { mIsContinue = false; }
+    void clear();
+
+    void setPriorityRanges(uint32_t trackIdx, const SampleRanges &ranges);
+    bool isFrameParsed(uint32_t trackIdx, uint32_t sampleIdx) const;
+    // fallback for tracks and samples this pass doesn't cover
+    H26X_FRAME_TYPE_E getFrameType(uint32_t trackIdx, uint32_t sampleIdx, H26X_FRAME_TYPE_E fallback) const;
+    NaluTypes         getNaluTypes(uint32_t trackIdx, uint32_t sampleIdx) const; // empty if not parsed
+    // from a worker, or from somewhere else(index cache)
+    void setFrameType(uint32_t trackIdx, uint32_t sampleIdx, H26X_FRAME_TYPE_E frameType, const uint8_t *naluTypes,
+                      uint32_t naluCount);
+
+    uint64_t getTotalCount() const { return mTotalCount; }
+    uint64_t getParsedCount() const { return mParsedCount; }
+
+    static bool isTrackSupported(const Mp4TrackInfo &track);
+
+private:
+    struct ParseTask
+    {
+        uint32_t trackIdx = 0;
+        uint32_t startIdx = 0;
+        uint32_t endIdx   = 0; // exclusive
+    };
+    enum
+    {
+        TASK_PENDING = 0,
+        TASK_CLAIMED,
+    };
+    enum
+    {
+        FRAME_TYPE_UNPARSED = 0xFF,
+        NALU_INLINE_COUNT   = 7,
+        NALU_POOL_BLOCK     = 64 * 1024,
+    };
+    struct NaluSlot
+    {
+        uint8_t        count = 0;
+        uint8_t        types[NALU_INLINE_COUNT];
+        const uint8_t *overflow = nullptr; // count > NALU_INLINE_COUNT
+    };
+    struct TrackResult
+    {
+        std::unique_ptr<std::atomic<uint8_t>[]> frameTypes; // FRAME_TYPE_UNPARSED until set, naluSlots are ready after
+        std::unique_ptr<NaluSlot[]>             naluSlots;
+        uint32_t                                sampleCount = 0;
+    };
+
+    const uint8_t *allocNaluTypes(const uint8_t *naluTypes, uint32_t naluCount);
+
+    bool tryClaimTask(size_t taskIdx);
+    int  claimTask();
+    void workerRun(const std::string &filePath, const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &samples,
+                   const FrameParsedCallback &onFrameParsed);
+
+private:
+    int mWorkerCount = 0;
+
+    std::vector<ParseTask>                            mTasks;
+    std::unique_ptr<std::atomic<uint8_t>[]>           mTaskStates;
+    std::vector<std::pair<size_t, size_t>>            mTrackTasks; // [begin, end) in mTasks of every track
+    std::atomic<size_t>                               mNextTask{0};
+    std::vector<TrackResult>                          mResults;
+    std::unique_ptr<TrackScan[]>                      mTrackScans; // same index as mResults
+
+    std::mutex   mPriorityLock;
+    uint32_t     mPriorityTrack = 0;
+    SampleRanges mPriorityRanges;
+
+    std::atomic<uint64_t> mTotalCount{0};
+    std::atomic<uint64_t> mParsedCount{0};
+    std::atomic<bool>     mIsContinue{false};
+
+    std::mutex mCallbackLock;
+
+    // blocks never move, slots keep pointers into them
+    std::mutex                              mPoolLock;
+    std::vector<std::unique_ptr<uint8_t[]>> mPoolBlocks;
+    size_t                                  mPoolBlockUsed = NALU_POOL_BLOCK;
+};
+
+#endif
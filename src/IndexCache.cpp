@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "logger.h"
+
+#include "IndexCache.h"
+#include "FrameTypeExtractor.h"
+
+#define INDEX_CACHE_MAGIC      "MP4IDX\0\0"
+#define INDEX_CACHE_VERSION    (1)
+#define INDEX_CACHE_EXT        ".idx"
+#define FINGERPRINT_BLOCK_SIZE (64 * 1024)
+
+using std::string;
+using std::vector;
+namespace fs = std::filesystem;
+
+struct IndexCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t trackCount;
+    uint64_t fileSize;
+    int64_t  modifyTime;
+    uint64_t fingerprint;
+    uint32_t pathLength; // followed by the path
+    uint32_t reserved;
+};
+
+struct IndexCacheTrackHeader
+{
+    uint32_t trackIdx;
+    uint32_t sampleCount;
+    uint64_t tableDigest;
+    uint64_t dataSize; // followed by [frameType, naluCount, naluTypes...] of every sample
+};
+
+static uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    auto bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// any change of the sample layout makes the cached types useless
+static uint64_t sampleTableDigest(const SampleTable &samples)
+{
+    uint64_t hash = fnv1a(nullptr, 0);
+    for (uint32_t i = 0; i < samples.parsedSize(); i++)
+    {
+        uint64_t values[2] = {samples.sampleOffset(i), (uint64_t)samples.sampleSize(i)};
+        hash               = fnv1a(values, sizeof(values), hash);
+    }
+    return hash;
+}
+
+int IndexCache::getFileKey(const string &filePath, FileKey &key)
+{
+    std::error_code ec;
+    fs::path        path(filePath);
+
+    key.fileSize = fs::file_size(path, ec);
+    if (ec)
+        return -1;
+    key.modifyTime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+    if (ec)
+        return -1;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return -1;
+
+    // head, middle and tail of the file, catches files rewritten with the same size and mtime
+    vector<char> block(FINGERPRINT_BLOCK_SIZE);
+    uint64_t     tailOffset = key.fileSize > FINGERPRINT_BLOCK_SIZE ? key.fileSize - FINGERPRINT_BLOCK_SIZE : 0;
+    uint64_t     offsets[3] = {0, key.fileSize / 2, tailOffset};
+
+    key.fingerprint = fnv1a(&key.fileSize, sizeof(key.fileSize));
+    for (auto offset : offsets)
+    {
+        file.seekg((std::streamoff)offset);
+        file.read(block.data(), block.size());
+        key.fingerprint = fnv1a(block.data(), (size_t)file.gcount(), key.fingerprint);
+        file.clear();
+    }
+    return 0;
+}
+
+fs::path IndexCache::getCacheDir()
+{
+    if (!mCacheDir.empty())
+        return fs::path(mCacheDir);
+
+    std::error_code ec;
+    fs::path        tempDir = fs::temp_directory_path(ec);
+    if (ec)
+        return fs::path();
+    return tempDir / "Mp4Parser" / "IndexCache";
+}
+
+fs::path IndexCache::getCachePath(const string &filePath)
+{
+    fs::path cacheDir = getCacheDir();
+    if (cacheDir.empty())
+        return fs::path();
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(filePath.data(), filePath.size()));
+    return cacheDir / (string(name) + INDEX_CACHE_EXT);
+}
+
+bool IndexCache::load(const string &filePath, const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &samples,
+                      FrameTypeExtractor &extractor)
+{
+    fs::path cachePath = getCachePath(filePath);
+    if (cachePath.empty())
+        return false;
+
+    std::error_code ec;
+    uint64_t        cacheSize = fs::file_size(cachePath, ec);
+    if (ec || cacheSize < sizeof(IndexCacheHeader))
+        return false;
+
+    FileKey key;
+    if (getFileKey(filePath, key) < 0)
+        return false;
+
+    vector<uint8_t> content(cacheSize);
+    {
+        std::ifstream cacheFile(cachePath, std::ios::binary);
+        if (!cacheFile.read((char *)content.data(), cacheSize))
+            return false;
+    }
+
+    auto invalidate = [&cachePath](const char *reason)
+    {
+        Z_INFO("index cache {} invalid: {}\n", cachePath.string(), reason);
+        std::error_code removeEc;
+        fs::remove(cachePath, removeEc);
+        return false;
+    };
+
+    IndexCacheHeader header;
+    memcpy(&header, content.data(), sizeof(header));
+    if (0 != memcmp(header.magic, INDEX_CACHE_MAGIC, sizeof(header.magic)) || INDEX_CACHE_VERSION != header.version)
+        return invalidate("version");
+    if (header.fileSize != key.fileSize || header.modifyTime != key.modifyTime || header.fingerprint != key.fingerprint)
+        return invalidate("file changed");
+
+    size_t offset = sizeof(header);
+    if (offset + header.pathLength > content.size() || string((char *)content.data() + offset, header.pathLength) != filePath)
+        return invalidate("path");
+    offset += header.pathLength;
+
+    uint32_t supportedTracks = 0;
+    for (auto &track : tracks)
+    {
+        if (FrameTypeExtractor::isTrackSupported(track))
+            supportedTracks++;
+    }
+    if (header.trackCount != supportedTracks)
+        return invalidate("track count");
+
+    // check everything before touching the tracks
+    vector<std::pair<IndexCacheTrackHeader, size_t>> trackData;
+    for (uint32_t i = 0; i < header.trackCount; i++)
+    {
+        IndexCacheTrackHeader trackHeader;
+        if (offset + sizeof(trackHeader) > content.size())
+            return invalidate("truncated");
+        memcpy(&trackHeader, content.data() + offset, sizeof(trackHeader));
+        offset += sizeof(trackHeader);
+
+        if (trackHeader.trackIdx >= tracks.size() || trackHeader.trackIdx >= samples.size()
+            || !FrameTypeExtractor::isTrackSupported(tracks[trackHeader.trackIdx]))
+            return invalidate("track");
+        auto &trackSamples = samples[trackHeader.trackIdx];
+        if (trackHeader.sampleCount != trackSamples.parsedSize() || trackHeader.tableDigest != sampleTableDigest(trackSamples))
+            return invalidate("sample table");
+        if (offset + trackHeader.dataSize > content.size())
+            return invalidate("truncated");
+
+        trackData.push_back({trackHeader, offset});
+        offset += trackHeader.dataSize;
+    }
+
+    for (auto &[trackHeader, dataOffset] : trackData)
+    {
+        const uint8_t *data    = content.data() + dataOffset;
+        const uint8_t *dataEnd = data + trackHeader.dataSize;
+        for (uint32_t sampleIdx = 0; sampleIdx < trackHeader.sampleCount; sampleIdx++)
+        {
+            if (data + 2 > dataEnd || data + 2 + data[1] > dataEnd)
+                return invalidate("truncated");
+
+            extractor.setFrameType(trackHeader.trackIdx, sampleIdx, (H26X_FRAME_TYPE_E)data[0], data + 2, data[1]);
+            data += 2 + data[1];
+        }
+    }
+
+    // used recently, keep it when trimming
+    fs::last_write_time(cachePath, fs::file_time_type::clock::now(), ec);
+
+    Z_INFO("load frame types from index cache {}\n", cachePath.string());
+    return true;
+}
+
+int IndexCache::save(const string &filePath, const vector<Mp4TrackInfo> &tracks, const vector<SampleTable> &samples,
+                     const FrameTypeExtractor &extractor)
+{
+    fs::path cachePath = getCachePath(filePath);
+    if (cachePath.empty())
+        return -1;
+
+    FileKey key;
+    if (getFileKey(filePath, key) < 0)
+        return -1;
+
+    IndexCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_CACHE_MAGIC, sizeof(header.magic));
+    header.version     = INDEX_CACHE_VERSION;
+    header.fileSize    = key.fileSize;
+    header.modifyTime  = key.modifyTime;
+    header.fingerprint = key.fingerprint;
+    header.pathLength  = (uint32_t)filePath.size();
+
+    vector<uint8_t> content;
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); trackIdx++)
+    {
+        if (!FrameTypeExtractor::isTrackSupported(tracks[trackIdx]) || trackIdx >= samples.size())
+            continue;
+
+        auto &trackSamples = samples[trackIdx];
+
+        IndexCacheTrackHeader trackHeader;
+        trackHeader.trackIdx    = trackIdx;
+        trackHeader.sampleCount = trackSamples.parsedSize();
+        trackHeader.tableDigest = sampleTableDigest(trackSamples);
+
+        size_t headerOffset = content.size();
+        content.resize(content.size() + sizeof(trackHeader));
+        for (uint32_t sampleIdx = 0; sampleIdx < trackHeader.sampleCount; sampleIdx++)
+        {
+            auto naluTypes = extractor.getNaluTypes(trackIdx, sampleIdx);
+            content.push_back((uint8_t)extractor.getFrameType(trackIdx, sampleIdx, trackSamples.frameType(sampleIdx)));
+            content.push_back((uint8_t)naluTypes.size());
+            content.insert(content.end(), naluTypes.begin(), naluTypes.end());
+        }
+        trackHeader.dataSize = content.size() - headerOffset - sizeof(trackHeader);
+        memcpy(content.data() + headerOffset, &trackHeader, sizeof(trackHeader));
+
+        header.trackCount++;
+    }
+
+    std::error_code ec;
+    fs::create_directories(cachePath.parent_path(), ec);
+
+    // write aside and rename, a killed app never leaves a half written entry
+    fs::path tmpPath = cachePath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream cacheFile(tmpPath, std::ios::binary | std::ios::trunc);
+        cacheFile.write((const char *)&header, sizeof(header));
+        cacheFile.write(filePath.data(), filePath.size());
+        cacheFile.write((const char *)content.data(), content.size());
+        if (!cacheFile)
+        {
+            Z_ERR("write index cache {} fail\n", tmpPath.string());
+            cacheFile.close();
+            fs::remove(tmpPath, ec);
+            return -1;
+        }
+    }
+    fs::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        Z_ERR("rename index cache {} fail: {}\n", cachePath.string(), ec.message());
+        fs::remove(tmpPath, ec);
+        return -1;
+    }
+
+    trimCacheDir();
+    return 0;
+}
+
+void IndexCache::trimCacheDir()
+{
+    struct CacheEntry
+    {
+        fs::path           path;
+        uint64_t           size;
+        fs::file_time_type lastUsed;
+    };
+
+    std::error_code    ec;
+    vector<CacheEntry> entries;
+    uint64_t           totalSize = 0;
+
+    for (auto &entry : fs::directory_iterator(getCacheDir(), ec))
+    {
+        if (!entry.is_regular_file(ec) || entry.path().extension() != INDEX_CACHE_EXT)
+            continue;
+        CacheEntry cacheEntry = {entry.path(), entry.file_size(ec), entry.last_write_time(ec)};
+        totalSize += cacheEntry.size;
+        entries.push_back(cacheEntry);
+    }
+    if (totalSize <= mMaxCacheSize)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry &a, const CacheEntry &b) { return a.lastUsed < b.lastUsed; });
+    for (auto &entry : entries)
+    {
+        if (totalSize <= mMaxCacheSize)
+            break;
+        if (fs::remove(entry.path, ec))
+            totalSize -= entry.size;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _INDEX_CACHE_H_
+#define _INDEX_CACHE_H_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Mp4Parse.h"
+#include "SampleTable.h"
+
+class FrameTypeExtractor;
+
+// on disk cache of the frame type pass, one file per media file under the cache directory.
+// an entry is used only when path, size, mtime, content fingerprint and sample table digest all match,
+// the least recently used entries are removed when the directory grows over the size limit
+class IndexCache
+{
+public:
+    IndexCache() {}
+
+    void setCacheDir(const std::string &dir) { mCacheDir = dir; } // local encode, empty: system temp dir
+    void setMaxCacheSize(uint64_t bytes) { mMaxCacheSize = bytes; }
+
+    // set frame/nalu types of every H264/H265 sample to the extractor, return false if nothing usable is cached.
+    // samples: tables of the tracks, same index, the samples the parser gave are cached
+    bool load(const std::string &filePath, const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &samples,
+              FrameTypeExtractor &extractor);
+    int  save(const std::string &filePath, const std::vector<Mp4TrackInfo> &tracks, const std::vector<SampleTable> &samples,
+              const FrameTypeExtractor &extractor);
+
+private:
+    struct FileKey
+    {
+        uint64_t fileSize    = 0;
+        int64_t  modifyTime  = 0;
+        uint64_t fingerprint = 0;
+    };
+
+    int                   getFileKey(const std::string &filePath, FileKey &key);
+    std::filesystem::path getCacheDir();
+    std::filesystem::path getCachePath(const std::string &filePath);
+    void                  trimCacheDir();
+
+private:
+    std::string mCacheDir;
+    uint64_t    mMaxCacheSize = 256 * 1024 * 1024;
+};
+
+#endif
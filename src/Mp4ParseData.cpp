@@ -1,6 +1,8 @@
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <iterator>
 
 #include "lz4.h"
 
@@ -8,9 +10,10 @@
 #include "ImGuiBaseTypes.h"
 #include "logger.h"
 
-#include "Mp4Parser.h"
 #include "Mp4ParseData.h"
 #include "AppConfigure.h"
+#include "Trace.h"
+#include "SessionManager.h"
 
 extern "C"
 {
@@ -24,9 +27,6 @@ namespace fs = std::filesystem;
 
 using namespace ImGui;
 
-StdMutex                 gDatalock;
-shared_ptr<Mp4ParseData> gDataShare = nullptr;
-
 AppConfigures gAppConfig;
 
 AppConfigures &getAppConfigure()
@@ -36,54 +36,67 @@ AppConfigures &getAppConfigure()
 
 Mp4ParseData &getMp4DataShare()
 {
-    if (nullptr == gDataShare)
-    {
-        StdMutexGuard locker(gDatalock);
-        if (!gDataShare)
-            gDataShare = std::make_shared<Mp4ParseData>();
-    }
-    return *gDataShare;
+    return getSessionManager().getActive();
 }
 
-int getCachedFrame(FrameCacheData &cacheData, MyAVFrame &frame)
+int Mp4ParseData::startParse(PARSE_OPERATION_E op)
 {
-    frame.getBuffer(cacheData.width, cacheData.height, cacheData.format, cacheData.lineSize);
-
-    auto decompressBuffer = std::make_unique<uint8_t[]>(cacheData.originalDataSize);
+    mOperation = op;
+    if (OPERATION_PARSE_FILE == op)
+    {
+        mLocalFilePath = utf8ToLocal(toParseFilePath);
+        mOpenTime      = std::chrono::steady_clock::now();
 
-    uint8_t *compressedDataPtr   = cacheData.compressedData.get();
-    uint8_t *decompressedDataPtr = decompressBuffer.get();
-    int      ret = LZ4_decompress_safe((char *)compressedDataPtr, (char *)decompressedDataPtr, cacheData.compressedDataSize,
-                                       cacheData.originalDataSize);
-    if (ret < 0)
+        StdMutexGuard locker(mBoxTableLock);
+        mBoxTable.reset();
+    }
+    else if (OPERATION_PARSE_FRAME_TYPE == op)
     {
-        Z_ERR("LZ4 decompression failed with error code {}\n", ret);
-        return -1;
+        mFrameTypeExtractor.prepare(tracksInfo, tracksSamples);
     }
+    return start();
+}
 
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(cacheData.format);
+shared_ptr<const BoxTable> Mp4ParseData::getBoxTable()
+{
+    StdMutexGuard locker(mBoxTableLock);
+    return mBoxTable;
+}
 
-    uint32_t offset     = 0;
-    int      planeCount = av_pix_fmt_count_planes(cacheData.format);
-    for (int i = 0; i < planeCount; i++)
-    {
-        uint32_t planeHeight   = i > 0 ? AV_CEIL_RSHIFT(cacheData.height, desc->log2_chroma_h) : cacheData.height;
-        uint32_t planeDataSize = cacheData.lineSize[i] * planeHeight;
-        memcpy(frame->data[i], decompressedDataPtr + offset, planeDataSize);
-        offset += planeDataSize;
-    }
+int64_t Mp4ParseData::getElapsedMs() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mOpenTime).count();
+}
 
-    return 0;
+void Mp4ParseData::setFrameTypePriority(uint32_t trackIdx, const FrameTypeExtractor::SampleRanges &ranges)
+{
+    mFrameTypeExtractor.setPriorityRanges(trackIdx, ranges);
 }
 
-int Mp4ParseData::startParse(PARSE_OPERATION_E op)
+bool Mp4ParseData::isFrameTypeParsed(uint32_t trackIdx, uint32_t sampleIdx) const
 {
-    mOperation = op;
-    return start();
+    // samples appended from the tail only know their key frames, no slice of them is read
+    if (trackIdx < tracksSamples.size() && sampleIdx >= tracksSamples[trackIdx].parsedSize()
+        && sampleIdx < tracksSamples[trackIdx].size())
+        return H26X_FRAME_Unknown != tracksSamples[trackIdx].frameType(sampleIdx);
+    return mFrameTypeExtractor.isFrameParsed(trackIdx, sampleIdx);
+}
+
+H26X_FRAME_TYPE_E Mp4ParseData::getFrameType(uint32_t trackIdx, uint32_t sampleIdx) const
+{
+    return mFrameTypeExtractor.getFrameType(trackIdx, sampleIdx, tracksSamples[trackIdx].frameType(sampleIdx));
+}
+
+FrameTypeExtractor::NaluTypes Mp4ParseData::getNaluTypes(uint32_t trackIdx, uint32_t sampleIdx) const
+{
+    return mFrameTypeExtractor.getNaluTypes(trackIdx, sampleIdx);
 }
 
 Mp4ParseData::SeekResult Mp4ParseData::seekToFrame(uint32_t trackIdx, uint32_t frameIdx, uint32_t &keyFrameIdx)
 {
+    StdMutexGuard locker(mDecodeLock);
+    StdMutexGuard tableLocker(mTableLock);
+
     auto trackDecoder = mVideoDecoders.find(trackIdx);
     if (trackDecoder == mVideoDecoders.end())
         return SeekFail;
@@ -92,29 +105,21 @@ Mp4ParseData::SeekResult Mp4ParseData::seekToFrame(uint32_t trackIdx, uint32_t f
 
     MyAVPacket packet;
 
-    auto &samples = tracksInfo[trackIdx].mediaInfo->samplesInfo;
+    auto &samples = tracksSamples[trackIdx];
     if (frameIdx >= samples.size())
         return SeekFail;
 
-    for (auto &cache : mDecodeFrameCache)
+    if (isFrameCached(trackIdx, frameIdx))
     {
-        if (cache.ptsMs == samples[frameIdx].ptsMs)
-        {
-            Z_INFO("Got Cache With Pts {}\n", cache.ptsMs);
-            return FrameInCache;
-        }
+        Z_INFO("Got Cache Of Frame {}\n", frameIdx);
+        return FrameInCache;
     }
 
-    uint32_t seekFrameIdx = 0;
-    for (seekFrameIdx = frameIdx; seekFrameIdx > 0; seekFrameIdx--)
-    {
-        if (samples[seekFrameIdx].isKeyFrame)
-            break;
-    }
-    bool needSeek = false;
+    uint32_t seekFrameIdx = samples.findKeyFrame(frameIdx);
+    bool     needSeek     = false;
 
     if (mTracksDecodeStat[trackIdx].lastDecodedFrameIdx < 0
-        || samples[mTracksDecodeStat[trackIdx].lastDecodedFrameIdx].ptsMs >= samples[frameIdx].ptsMs)
+        || samples.ptsMs((uint32_t)mTracksDecodeStat[trackIdx].lastDecodedFrameIdx) >= samples.ptsMs(frameIdx))
     {
         needSeek = true;
     }
@@ -122,7 +127,7 @@ Mp4ParseData::SeekResult Mp4ParseData::seekToFrame(uint32_t trackIdx, uint32_t f
     {
         for (int64_t i = mTracksDecodeStat[trackIdx].lastDecodedFrameIdx + 1; i <= frameIdx; i++)
         {
-            if (samples[i].isKeyFrame)
+            if (samples.isKeyFrame((uint32_t)i))
             {
                 needSeek = true;
                 break;
@@ -133,8 +138,8 @@ Mp4ParseData::SeekResult Mp4ParseData::seekToFrame(uint32_t trackIdx, uint32_t f
     keyFrameIdx = seekFrameIdx;
     if (needSeek)
     {
+        // cached frames of other GOPs stay, going back to them costs nothing
         avcodec_flush_buffers(decoder.get());
-        mDecodeFrameCache.clear();
         mTracksDecodeStat[trackIdx].lastExtractFrameIdx = seekFrameIdx - 1;
         return SeekToKeyFrame;
     }
@@ -142,8 +147,9 @@ Mp4ParseData::SeekResult Mp4ParseData::seekToFrame(uint32_t trackIdx, uint32_t f
 }
 
 int Mp4ParseData::decodeFrameAt(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame &frame,
-                                const std::vector<AVPixelFormat> &acceptFormats)
+                                const std::vector<AVPixelFormat> &acceptFormats, const std::function<bool()> &isCancelled)
 {
+    StdMutexGuard locker(mDecodeLock);
 
     auto trackDecoder = mVideoDecoders.find(trackIdx);
     if (trackDecoder == mVideoDecoders.end())
@@ -153,54 +159,48 @@ int Mp4ParseData::decodeFrameAt(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame
 
     MyAVPacket packet;
 
-    auto &samples = tracksInfo[trackIdx].mediaInfo->samplesInfo;
-    if (frameIdx >= samples.size())
-        return -1;
-
-    for (auto &cache : mDecodeFrameCache)
-    {
-        if (cache.ptsMs == samples[frameIdx].ptsMs)
-        {
-            auto start = std::chrono::high_resolution_clock::now();
-            getCachedFrame(cache, frame);
-            auto end = std::chrono::high_resolution_clock::now();
-            Z_INFO("Got Cache With Pts {}, Time Taken: {} ms\n", cache.ptsMs,
-                   std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
-            frame->pts = samples[frameIdx].ptsMs;
-            transformFrameFormat(frame, acceptFormats);
-            return 0;
-        }
-    }
-
+    uint64_t framePtsMs   = 0;
     uint32_t seekFrameIdx = 0;
-    for (seekFrameIdx = frameIdx; seekFrameIdx > 0; seekFrameIdx--)
+    bool     needSeek     = false;
     {
-        if (samples[seekFrameIdx].isKeyFrame)
-            break;
-    }
-    bool needSeek = false;
+        // tail appends only wait for this, not for the decode
+        StdMutexGuard tableLocker(mTableLock);
 
-    if (mTracksDecodeStat[trackIdx].lastDecodedFrameIdx < 0
-        || samples[mTracksDecodeStat[trackIdx].lastDecodedFrameIdx].ptsMs >= samples[frameIdx].ptsMs)
-    {
-        needSeek = true;
-    }
-    else
-    {
-        for (int64_t i = mTracksDecodeStat[trackIdx].lastDecodedFrameIdx + 1; i <= frameIdx; i++)
+        auto &samples = tracksSamples[trackIdx];
+        if (frameIdx >= samples.size())
+            return -1;
+
+        framePtsMs   = samples.ptsMs(frameIdx);
+        seekFrameIdx = samples.findKeyFrame(frameIdx);
+        if (mTracksDecodeStat[trackIdx].lastDecodedFrameIdx < 0
+            || samples.ptsMs((uint32_t)mTracksDecodeStat[trackIdx].lastDecodedFrameIdx) >= framePtsMs)
         {
-            if (samples[i].isKeyFrame)
+            needSeek = true;
+        }
+        else
+        {
+            for (int64_t i = mTracksDecodeStat[trackIdx].lastDecodedFrameIdx + 1; i <= frameIdx; i++)
             {
-                needSeek = true;
-                break;
+                if (samples.isKeyFrame((uint32_t)i))
+                {
+                    needSeek = true;
+                    break;
+                }
             }
         }
     }
 
+    if (getCachedFrame(trackIdx, frameIdx, frame) >= 0)
+    {
+        Z_INFO("Got Cache Of Frame {}\n", frameIdx);
+        frame->pts = framePtsMs;
+        transformFrameFormat(frame, acceptFormats, mFmtTransition);
+        return 0;
+    }
+
     if (needSeek)
     {
         avcodec_flush_buffers(decoder.get());
-        mDecodeFrameCache.clear();
         mTracksDecodeStat[trackIdx].lastExtractFrameIdx = seekFrameIdx - 1;
     }
     while (1)
@@ -210,15 +210,18 @@ int Mp4ParseData::decodeFrameAt(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame
             return -1;
         }
 
-        addFrameToCache(frame);
+        addFrameToCache(trackIdx, frame);
 
         if (mTracksDecodeStat[trackIdx].lastDecodedFrameIdx >= frameIdx)
         {
             break;
         }
+        // a newer request is waiting, frames decoded so far stay in the cache
+        if (isCancelled && isCancelled())
+            return -1;
     }
 
-    transformFrameFormat(frame, acceptFormats);
+    transformFrameFormat(frame, acceptFormats, mFmtTransition);
 
     return 0;
 }
@@ -230,19 +233,24 @@ int Mp4ParseData::sendPacketToDecoder(uint32_t trackIdx, uint32_t frameIdx)
         return -1;
 
     auto &decoder = trackDecoder->second;
-    auto &samples = tracksInfo[trackIdx].mediaInfo->samplesInfo;
-
-    if (frameIdx >= samples.size())
-    {
-        Z_ERR("no more frames {} >= {}\n", frameIdx, samples.size());
-        return -1;
-    }
+    auto &samples = tracksSamples[trackIdx];
 
+    TRACE_SCOPE("send_packet");
     MyAVPacket packet;
 
     Mp4VideoFrame videoSample;
 
-    int ret = mParser->getVideoSample(trackIdx, frameIdx, videoSample);
+    int ret = 0;
+    {
+        // the sample is read under the table lock, the decoder gets it after
+        StdMutexGuard tableLocker(mTableLock);
+        if (frameIdx >= samples.size())
+        {
+            Z_ERR("no more frames {} >= {}\n", frameIdx, samples.size());
+            return -1;
+        }
+        ret = getVideoSample(trackIdx, frameIdx, videoSample);
+    }
     if (ret < 0)
     {
         Z_ERR("err {}\n", ret);
@@ -264,6 +272,137 @@ int Mp4ParseData::sendPacketToDecoder(uint32_t trackIdx, uint32_t frameIdx)
     return 0;
 }
 
+const SampleWrapLayout *Mp4ParseData::getWrapLayout(uint32_t trackIdx, bool &directRead)
+{
+    StdMutexGuard locker(mWrapLock);
+
+    auto found = mWrapStates.find(trackIdx);
+    if (found != mWrapStates.end())
+    {
+        directRead = found->second.directRead;
+        return found->second.layout.valid ? &found->second.layout : nullptr;
+    }
+
+    auto &state  = mWrapStates[trackIdx];
+    auto &layout = state.layout;
+    if (trackIdx >= tracksInfo.size() || !FrameTypeExtractor::isTrackSupported(tracksInfo[trackIdx]))
+        return nullptr;
+
+    auto &samples      = tracksSamples[trackIdx];
+    auto  probeSamples = pickWrapProbeSamples(
+        samples.size(), [&samples](uint32_t idx) { return samples.isKeyFrame(idx); },
+        [&samples](uint32_t idx) { return samples.descriptionIndex(idx); }, layout.descriptionIndex);
+    bool isHevc = MP4_CODEC_HEVC == mp4GetCodecType(tracksInfo[trackIdx].mediaInfo->codecCode);
+    if (probeSampleWrapLayout(*mParser, trackIdx, isHevc, probeSamples, layout) < 0)
+    {
+        Z_INFO("track {} samples are wrapped by the parser\n", trackIdx);
+        return nullptr;
+    }
+
+    // playback reads in file order, from here the reader can read ahead
+    if (!mSampleReader.isOpen())
+        mSampleReader.open(mLocalFilePath);
+    uint32_t probeIdx = probeSamples[0].sampleIdx;
+    mSampleReader.setTrackChunks(trackIdx, &samples.getChunks());
+    state.directRead = mSampleReader.isOpen()
+                       && mSampleReader.isSameAsParser(*mParser, trackIdx, probeIdx, samples.sampleOffset(probeIdx),
+                                                        samples.sampleSize(probeIdx));
+    directRead = state.directRead;
+    return &layout;
+}
+
+int Mp4ParseData::getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frame)
+{
+    if (trackIdx >= tracksSamples.size())
+        return mParser->getVideoSample(trackIdx, sampleIdx, frame);
+
+    // a raw read and a wrap here, instead of the parser walking the sample again
+    bool  directRead = false;
+    auto  layout     = getWrapLayout(trackIdx, directRead);
+    auto &samples    = tracksSamples[trackIdx];
+    // no falling back to the parser for samples it doesn't know
+    bool inParser = isParserSample(trackIdx, sampleIdx);
+    if (!layout || sampleIdx >= samples.size() || samples.descriptionIndex(sampleIdx) != layout->descriptionIndex)
+        return inParser ? mParser->getVideoSample(trackIdx, sampleIdx, frame) : -1;
+
+    Mp4RawSample raw;
+    int          ret = 0;
+    if (directRead || !inParser)
+        ret = readSample(trackIdx, sampleIdx, raw);
+    else
+        ret = mParser->getSample(trackIdx, sampleIdx, raw);
+    if (ret < 0 || wrapSample(*layout, raw, samples.isKeyFrame(sampleIdx), frame) < 0)
+        return inParser ? mParser->getVideoSample(trackIdx, sampleIdx, frame) : -1;
+    return 0;
+}
+
+int Mp4ParseData::getRawSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &sample)
+{
+    if (!isParserSample(trackIdx, sampleIdx))
+        return readSample(trackIdx, sampleIdx, sample);
+    return mParser->getSample(trackIdx, sampleIdx, sample);
+}
+
+bool Mp4ParseData::isParserSample(uint32_t trackIdx, uint32_t sampleIdx)
+{
+    if (trackIdx >= tracksSamples.size())
+        return true;
+    // appended from the tail
+    if (sampleIdx >= tracksSamples[trackIdx].parsedSize())
+        return false;
+
+    StdMutexGuard locker(mWrapLock);
+    auto          found = mWrapStates.find(trackIdx);
+    return found == mWrapStates.end() || !found->second.rowsReleased;
+}
+
+void Mp4ParseData::releaseParserSamples(uint32_t trackIdx)
+{
+    // the table has everything of the rows but the nalu types, which the frame type pass keeps itself
+    auto &rows = tracksInfo[trackIdx].mediaInfo->samplesInfo;
+    for (auto &row : rows)
+    {
+        row.naluTypes.clear();
+        row.naluTypes.shrink_to_fit();
+    }
+
+    // the rows go if every sample of the track can be read and wrapped here, without the parser
+    bool  directRead = false;
+    auto  layout     = TRACK_TYPE_VIDEO == tracksInfo[trackIdx].trackType ? getWrapLayout(trackIdx, directRead) : nullptr;
+    auto &samples    = tracksSamples[trackIdx];
+    if (!layout || !directRead)
+        return;
+    for (uint32_t i = 0; i < samples.size(); i++)
+    {
+        if (samples.descriptionIndex(i) != layout->descriptionIndex)
+            return;
+    }
+
+    StdMutexGuard locker(mWrapLock);
+    std::vector<Mp4SampleItem>().swap(rows);
+    mWrapStates[trackIdx].rowsReleased = true;
+    Z_INFO("track {} sample rows of the parser released, {} samples\n", trackIdx, samples.size());
+}
+
+int Mp4ParseData::readSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &sample)
+{
+    auto &samples = tracksSamples[trackIdx];
+    if (sampleIdx >= samples.size())
+        return -1;
+    {
+        StdMutexGuard locker(mWrapLock);
+        if (!mSampleReader.isOpen() && mSampleReader.open(mLocalFilePath) < 0)
+            return -1;
+    }
+
+    sample.dataSize   = samples.sampleSize(sampleIdx);
+    sample.ptsMs      = samples.ptsMs(sampleIdx);
+    sample.dtsMs      = samples.dtsMs(sampleIdx);
+    sample.sampleData = std::make_unique<uint8_t[]>(sample.dataSize);
+    return mSampleReader.read(trackIdx, sampleIdx, samples.sampleOffset(sampleIdx), samples.sampleSize(sampleIdx),
+                              sample.sampleData.get());
+}
+
 int Mp4ParseData::decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame)
 {
     auto trackDecoder = mVideoDecoders.find(trackIdx);
@@ -271,7 +410,7 @@ int Mp4ParseData::decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame)
         return -1;
 
     auto &decoder = trackDecoder->second;
-    auto &samples = tracksInfo[trackIdx].mediaInfo->samplesInfo;
+    auto &samples = tracksSamples[trackIdx];
 
     auto &trackDecodeInfo = mTracksDecodeStat[trackIdx];
 
@@ -282,7 +421,10 @@ int Mp4ParseData::decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame)
     while (1)
     {
         frame.clear();
-        ret = decoder.receiveFrame(frame);
+        {
+            TRACE_SCOPE("receive_frame");
+            ret = decoder.receiveFrame(frame);
+        }
         if (ret == 0)
         {
             Z_INFO("get frame pts {}\n", frame->pts);
@@ -303,20 +445,28 @@ int Mp4ParseData::decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame)
         }
 
         extractFrameIdx++;
-        if (extractFrameIdx == samples.size())
+        bool isLast = false;
+        {
+            StdMutexGuard tableLocker(mTableLock);
+            isLast = extractFrameIdx == samples.size();
+        }
+        if (isLast)
         {
             ret = decoder.sendPacket(nullptr);
         }
     }
 
-    auto frm = std::find_if(samples.begin(), samples.end(),
-                            [&frame](const Mp4SampleItem &sample) { return (int64_t)sample.ptsMs == frame->pts; });
-    if (frm == samples.end())
+    StdMutexGuard tableLocker(mTableLock);
+    // pts sorted list is only kept for video tracks, which are the only ones decoded
+    auto &ptsList = tracksFramePtsList[(int)trackIdx];
+    auto  frm     = std::lower_bound(ptsList.begin(), ptsList.end(), frame->pts,
+                                     [&samples](uint32_t idx, int64_t pts) { return (int64_t)samples.ptsMs(idx) < pts; });
+    if (frm == ptsList.end() || (int64_t)samples.ptsMs(*frm) != frame->pts)
     {
         return -1;
     }
 
-    trackDecodeInfo.lastDecodedFrameIdx = frm->sampleIdx;
+    trackDecodeInfo.lastDecodedFrameIdx = *frm;
     Z_INFO("frame sampleIdx {}\n", trackDecodeInfo.lastDecodedFrameIdx);
 
     return 0;
@@ -329,7 +479,8 @@ bool exists(const std::vector<AVPixelFormat> &acceptFormats, AVPixelFormat forma
     return std::find(acceptFormats.begin(), acceptFormats.end(), format) != acceptFormats.end();
 }
 
-int Mp4ParseData::transformFrameFormat(MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats)
+int Mp4ParseData::transformFrameFormat(MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats,
+                                       MySwsContext &fmtTransition)
 {
     Z_INFO("frame format {}\n", frame->format);
     Z_INFO("frame pict_type {}\n", frame->pict_type);
@@ -361,6 +512,7 @@ int Mp4ParseData::transformFrameFormat(MyAVFrame &frame, const std::vector<AVPix
         return 0;
     }
 
+    TRACE_SCOPE("transform_frame_format");
     MyAVFrame transFrame;
 
     ret = transFrame.getBuffer(frame->width, frame->height, acceptFormats[0]);
@@ -369,15 +521,15 @@ int Mp4ParseData::transformFrameFormat(MyAVFrame &frame, const std::vector<AVPix
         Z_ERR("get buffer for {}x{} fail: {}\n", frame->width, frame->height, ffmpeg_make_err_string(ret));
         return -1;
     }
-    ret = mFmtTransition.init(frame->width, frame->height, (AVPixelFormat)frame->format, transFrame->width, transFrame->height,
-                              (AVPixelFormat)transFrame->format, SWS_FAST_BILINEAR);
+    ret = fmtTransition.init(frame->width, frame->height, (AVPixelFormat)frame->format, transFrame->width, transFrame->height,
+                             (AVPixelFormat)transFrame->format, SWS_FAST_BILINEAR);
     if (ret < 0)
     {
         Z_ERR("sws_getContext fail\n");
         return -1;
     }
 
-    ret = mFmtTransition.scaleFrame(transFrame, frame);
+    ret = fmtTransition.scaleFrame(transFrame, frame);
     if (ret < 0)
     {
         Z_ERR("sws_scale err {}\n", ffmpeg_make_err_string(ret));
@@ -393,22 +545,29 @@ int Mp4ParseData::transformFrameFormat(MyAVFrame &frame, const std::vector<AVPix
 
 void Mp4ParseData::clearData()
 {
+    {
+        StdMutexGuard locker(mDecodeLock);
+        mVideoDecoders.clear();
+        mFmtTransition.clear();
+        clearFrameCache();
+    }
     tracksInfo.clear();
-    mVideoDecoders.clear();
-    mFmtTransition.clear();
+    tracksSamples.clear();
+    tracksSampleIndex.clear();
     tracksMaxSampleSize.clear();
     videoTracksIdx.clear();
-    mDecodeFrameCache.clear();
     tracksFramePtsList.clear();
     tracksIFrameList.clear();
+    mFrameTypeExtractor.clear();
 
-    mTotalVideoFrameCount = 0;
-    mParsingFrameCount    = 0;
+    StdMutexGuard locker(mWrapLock);
+    mWrapStates.clear();
+    mSampleReader.close();
 }
 
 void Mp4ParseData::updateData()
 {
-    if (!dataAvailable)
+    if (!mParser->isParseSuccess())
         return;
 
     clearData();
@@ -418,50 +577,33 @@ void Mp4ParseData::updateData()
     auto tracks = mParser->getTracksInfo();
     for (auto &track : tracks)
     {
-        Mp4TrackInfo copyTrackInfo;
-        copyTrackInfo           = *track;
-        copyTrackInfo.mediaInfo = nullptr;
-        switch (copyTrackInfo.trackType)
-        {
-            default:
-                copyTrackInfo.mediaInfo  = std::make_shared<Mp4MediaInfo>();
-                *copyTrackInfo.mediaInfo = *track->mediaInfo;
-                break;
-            case TRACK_TYPE_VIDEO:
-                copyTrackInfo.mediaInfo = std::make_shared<Mp4VideoInfo>();
-                *std::dynamic_pointer_cast<Mp4VideoInfo>(copyTrackInfo.mediaInfo) =
-                    *std::dynamic_pointer_cast<Mp4VideoInfo>(track->mediaInfo);
-                break;
-            case TRACK_TYPE_AUDIO:
-                copyTrackInfo.mediaInfo = std::make_shared<Mp4AudioInfo>();
-                *std::dynamic_pointer_cast<Mp4AudioInfo>(copyTrackInfo.mediaInfo) =
-                    *std::dynamic_pointer_cast<Mp4AudioInfo>(track->mediaInfo);
-                break;
-        }
-        if (copyTrackInfo.trackType == TRACK_TYPE_VIDEO)
-        {
-            auto &ptsList    = tracksFramePtsList[(int)tracksInfo.size()];
-            auto &iframeList = tracksIFrameList[(int)tracksInfo.size()];
-            auto &samples    = copyTrackInfo.mediaInfo->samplesInfo;
+        // media info stays shared with the parser, the samples are read from tracksSamples
+        tracksInfo.push_back(*track);
+        tracksSamples.emplace_back();
+
+        auto &samples = tracksSamples.back();
+        samples.build(*track->mediaInfo);
+        tracksMaxSampleSize.push_back(samples.getMaxSampleSize());
+        tracksSampleIndex.emplace_back();
+        tracksSampleIndex.back().build(samples);
 
-            ptsList.reserve(copyTrackInfo.mediaInfo->samplesInfo.size());
-            iframeList.reserve(copyTrackInfo.mediaInfo->samplesInfo.size());
+        if (track->trackType == TRACK_TYPE_VIDEO)
+        {
+            auto &ptsList    = tracksFramePtsList[(int)tracksInfo.size() - 1];
+            auto &iframeList = tracksIFrameList[(int)tracksInfo.size() - 1];
 
-            for (auto &sample : samples)
+            ptsList.resize(samples.size());
+            for (uint32_t i = 0; i < samples.size(); i++)
             {
-                ptsList.push_back((uint32_t)sample.sampleIdx);
-                if (sample.isKeyFrame)
-                    iframeList.push_back((uint32_t)sample.sampleIdx);
+                ptsList[i] = i;
+                if (samples.isKeyFrame(i))
+                    iframeList.push_back(i);
             }
             std::sort(ptsList.begin(), ptsList.end(),
-                      [&samples](uint32_t a, uint32_t b) { return samples[a].ptsMs < samples[b].ptsMs; });
+                      [&samples](uint32_t a, uint32_t b) { return samples.ptsMs(a) < samples.ptsMs(b); });
         }
-
-        tracksInfo.push_back(copyTrackInfo);
     }
 
-    auto virtual_top_box = mParser->getBoxes();
-
     for (uint32_t i = 0; i < tracksInfo.size(); i++)
     {
         if (TRACK_TYPE_VIDEO == tracksInfo[i].trackType)
@@ -470,19 +612,9 @@ void Mp4ParseData::updateData()
         }
     }
 
-    for (auto &track : tracksInfo)
-    {
-        auto    &samples       = track.mediaInfo->samplesInfo;
-        uint64_t maxSampleSize = 0;
-        for (auto &sample : samples)
-        {
-            if (sample.sampleSize > maxSampleSize)
-            {
-                maxSampleSize = sample.sampleSize;
-            }
-        }
-        tracksMaxSampleSize.push_back(maxSampleSize);
-    }
+    // the columns replace the parser's rows wherever the parser isn't needed to read the samples
+    for (uint32_t i = 0; i < tracksInfo.size(); i++)
+        releaseParserSamples(i);
 
     if (videoTracksIdx.empty())
         return;
@@ -492,7 +624,9 @@ void Mp4ParseData::updateData()
 
 void Mp4ParseData::recreateDecoder()
 {
+    StdMutexGuard locker(mDecodeLock);
     mVideoDecoders.clear();
+    clearFrameCache();
     for (auto &trackIdx : videoTracksIdx)
     {
         AVCodecID codecID;
@@ -565,14 +699,36 @@ void Mp4ParseData::run()
 {
     if (OPERATION_PARSE_FILE == mOperation)
     {
-        string filePath = utf8ToLocal(toParseFilePath);
-        mParser->parse(filePath);
+        // headers only, the box tree can be browsed while the full parse is running
+        ScannedBox previewBoxes;
+        if (scanBoxes(mLocalFilePath, previewBoxes, &mIsContinue) >= 0)
+        {
+            auto previewTable = std::make_shared<BoxTable>();
+            previewTable->build(previewBoxes, localToUtf8(fs::path(mLocalFilePath).filename().string()));
+            {
+                StdMutexGuard locker(mBoxTableLock);
+                mBoxTable = previewTable;
+            }
+            ADD_APPLICATION_LOG("box preview ready in %lld ms\n", (long long)getElapsedMs());
+        }
+
+        // other open files may be parsing too, wait for a thread of the shared budget
+        auto &scheduler = getSessionManager().getScheduler();
+        scheduler.setMaxThreads(getAppConfigure().maxWorkerThreads);
+        if (scheduler.acquireThreads(1, &mIsContinue) <= 0)
+            return;
+        {
+            TRACE_SCOPE("parse_file");
+            mParser->parse(mLocalFilePath);
+        }
+        scheduler.releaseThreads(1);
 
         if (!mParser->isParseSuccess())
         {
             Z_ERR("parse fail\n");
             string err = mParser->getErrorMessage();
-            gUserApp->setStatus(err);
+            if (onStatus)
+                onStatus(err);
             while (!err.empty())
             {
                 ADD_APPLICATION_LOG("%s\n", err.c_str());
@@ -580,50 +736,61 @@ void Mp4ParseData::run()
             }
             return;
         }
-        auto tracks = mParser->getTracksInfo();
-        for (auto &track : tracks)
-        {
-            if (TRACK_TYPE_VIDEO != track->trackType)
-                continue;
-
-            if (mp4GetCodecType(track->mediaInfo->codecCode) != MP4_CODEC_H264
-                && mp4GetCodecType(track->mediaInfo->codecCode) != MP4_CODEC_HEVC)
-                continue;
+        // sort the sample tables here, not in UI thread
+        int64_t parsedMs = getElapsedMs();
+        updateData();
 
-            mTotalVideoFrameCount += track->mediaInfo->samplesInfo.size();
+        // the box tree is flattened here too, a file with 100k+ fragments would freeze the UI thread
+        auto top      = mParser->asBox();
+        auto boxTable = std::make_shared<BoxTable>();
+        boxTable->build(*top, localToUtf8(top->getBoxTypeStr()));
+        {
+            StdMutexGuard locker(mBoxTableLock);
+            mBoxTable = boxTable;
         }
-
         dataAvailable = true;
-        updateData();
+        ADD_APPLICATION_LOG("parse done in %lld ms, tracks ready %lld ms later\n", (long long)parsedMs,
+                            (long long)(getElapsedMs() - parsedMs));
     }
     else if (OPERATION_PARSE_FRAME_TYPE == mOperation)
     {
-        mParsingFrameCount = 0;
-        for (auto &track : tracksInfo)
-        {
-            if (track.trackType != TRACK_TYPE_VIDEO)
-                continue;
+        auto &configure = getAppConfigure();
+        mIndexCache.setCacheDir(utf8ToLocal(configure.indexCachePath));
+        mIndexCache.setMaxCacheSize((uint64_t)std::max(configure.indexCacheSizeMB, 1) * 1024 * 1024);
 
-            if (mp4GetCodecType(track.mediaInfo->codecCode) != MP4_CODEC_H264
-                && mp4GetCodecType(track.mediaInfo->codecCode) != MP4_CODEC_HEVC)
-                continue;
-
-            for (uint32_t parsingFrameIdx = 0; parsingFrameIdx < track.mediaInfo->samplesInfo.size(); parsingFrameIdx++)
+        string filePath = mParser->getFilePath();
+        if (configure.useIndexCache && mIndexCache.load(filePath, tracksInfo, tracksSamples, mFrameTypeExtractor))
+        {
+            for (uint32_t trackIdx = 0; trackIdx < tracksInfo.size(); trackIdx++)
             {
-                if (!mIsContinue)
-                    return;
-
-                track.mediaInfo->samplesInfo[parsingFrameIdx].frameType =
-                    mParser->parseVideoNaluType(track.trakIndex, parsingFrameIdx);
-                track.mediaInfo->samplesInfo[parsingFrameIdx].naluTypes =
-                    mParser->getTracksInfo()[track.trakIndex]->mediaInfo->samplesInfo[parsingFrameIdx].naluTypes;
-                if (nullptr != onFrameParsed)
-                {
-                    onFrameParsed(track.trakIndex, parsingFrameIdx, track.mediaInfo->samplesInfo[parsingFrameIdx].frameType);
-                }
-                Z_DBG("get frame {} type {}\n", parsingFrameIdx, track.mediaInfo->samplesInfo[parsingFrameIdx].frameType);
-                mParsingFrameCount++;
+                auto &track = tracksInfo[trackIdx];
+                if (!FrameTypeExtractor::isTrackSupported(track) || nullptr == onFrameParsed)
+                    continue;
+                for (uint32_t i = 0; i < tracksSamples[trackIdx].parsedSize(); i++)
+                    onFrameParsed(track.trakIndex, i, getFrameType(trackIdx, i));
             }
+            ADD_APPLICATION_LOG("frame types loaded from cache in %lld ms\n", (long long)getElapsedMs());
+            return;
+        }
+
+        auto &scheduler = getSessionManager().getScheduler();
+        scheduler.setMaxThreads(configure.maxWorkerThreads);
+        // one thread is kept free, a file opened meanwhile is parsed without waiting for this whole pass
+        int wantedWorkers = configure.frameTypeWorkers;
+        if (wantedWorkers <= 0)
+            wantedWorkers = FrameTypeExtractor::getAutoWorkerCount();
+        int workerCount = scheduler.acquireThreads(wantedWorkers, &mIsContinue, 1);
+        if (workerCount <= 0)
+            return;
+
+        mFrameTypeExtractor.setWorkerCount(workerCount);
+        int ret = mFrameTypeExtractor.extract(filePath, tracksInfo, tracksSamples, onFrameParsed);
+        scheduler.releaseThreads(workerCount);
+        if (ret >= 0)
+        {
+            ADD_APPLICATION_LOG("frame types ready in %lld ms\n", (long long)getElapsedMs());
+            if (configure.useIndexCache)
+                mIndexCache.save(filePath, tracksInfo, tracksSamples, mFrameTypeExtractor);
         }
     }
 }
@@ -647,21 +814,254 @@ float Mp4ParseData::getParseFileProgress()
 
 float Mp4ParseData::getParseFrameTypeProgress()
 {
-    return (float)mParsingFrameCount / (float)mTotalVideoFrameCount;
+    uint64_t totalCount = mFrameTypeExtractor.getTotalCount();
+    if (0 == totalCount)
+        return 0;
+    return (float)mFrameTypeExtractor.getParsedCount() / (float)totalCount;
 }
 void Mp4ParseData::stopping()
 {
     mIsContinue = false;
+    mFrameTypeExtractor.stop();
+}
+
+int Mp4ParseData::startFollowTail()
+{
+    if (!dataAvailable || isFollowingTail())
+        return -1;
+    if (mFragmentTail.init(mLocalFilePath, tracksInfo, tracksSamples) < 0)
+        return -1;
+    return mFragmentTail.start();
+}
+
+void Mp4ParseData::stopFollowTail()
+{
+    if (isFollowingTail())
+        mFragmentTail.stop();
+}
+
+uint32_t Mp4ParseData::applyTailAppends()
+{
+    // the parse thread reads the sample tables
+    if (!dataAvailable || isRunning())
+        return 0;
+
+    vector<FragmentTail::TrackAppend> appends;
+    mFragmentTail.takeAppends(appends);
+    if (appends.empty())
+        return 0;
+
+    // the decode worker reads the tables, pts lists and chunks(through the sample reader) while playing,
+    // they may move when they grow. it holds the table lock per packet, a decode running doesn't block the UI
+    StdMutexGuard tableLocker(mTableLock);
+    StdMutexGuard wrapLocker(mWrapLock);
+
+    uint32_t appendCount = 0;
+    for (auto &append : appends)
+    {
+        if (append.trackIdx >= tracksSamples.size())
+            continue;
+
+        auto &samples       = tracksSamples[append.trackIdx];
+        auto &maxSampleSize = tracksMaxSampleSize[append.trackIdx];
+        auto  oldSize       = samples.size();
+        samples.append(append.samples, std::move(append.chunks));
+        for (auto i = oldSize; i < samples.size(); i++)
+            maxSampleSize = std::max<uint64_t>(maxSampleSize, samples.sampleSize(i));
+        appendCount += samples.size() - oldSize;
+
+        if (TRACK_TYPE_VIDEO != tracksInfo[append.trackIdx].trackType)
+            continue;
+
+        auto &ptsList    = tracksFramePtsList[(int)append.trackIdx];
+        auto &iframeList = tracksIFrameList[(int)append.trackIdx];
+        auto  ptsOldSize = ptsList.size();
+        for (auto i = oldSize; i < samples.size(); i++)
+        {
+            ptsList.push_back(i);
+            if (samples.isKeyFrame(i))
+                iframeList.push_back(i);
+        }
+
+        // new samples only reorder with the last few old ones, merge from there
+        auto ptsLess  = [&samples](uint32_t a, uint32_t b) { return samples.ptsMs(a) < samples.ptsMs(b); };
+        auto newBegin = ptsList.begin() + ptsOldSize;
+        std::sort(newBegin, ptsList.end(), ptsLess);
+        if (newBegin != ptsList.end())
+        {
+            auto mergeBegin = std::upper_bound(ptsList.begin(), newBegin, *newBegin, ptsLess);
+            std::inplace_merge(mergeBegin, newBegin, ptsList.end(), ptsLess);
+        }
+    }
+    return appendCount;
+}
+
+int Mp4ParseData::querySamples(uint32_t trackIdx, const SampleFilter &filter, SampleQueryResult &result)
+{
+    // in UI thread, the parse thread builds the indices
+    if (!dataAvailable || (isRunning() && OPERATION_PARSE_FILE == mOperation) || trackIdx >= tracksSampleIndex.size())
+        return -1;
+
+    auto  startTime = std::chrono::steady_clock::now();
+    auto &samples   = tracksSamples[trackIdx];
+    auto &index     = tracksSampleIndex[trackIdx];
+    // tail appends made it stale, only the appended samples are sorted
+    if (!index.isBuiltFor(samples))
+    {
+        TRACE_SCOPE("extend_sample_index");
+        index.extend(samples);
+    }
+    // the extractor is still running or its types never went into the index
+    if (0 != filter.frameTypes && index.needFrameTypes())
+    {
+        bool final = !isRunning() && getParseFrameTypeProgress() >= 1.0f;
+        index.updateFrameTypes(
+            [this, trackIdx](uint32_t sampleIdx, bool &parsed)
+            {
+                parsed = isFrameTypeParsed(trackIdx, sampleIdx);
+                return getFrameType(trackIdx, sampleIdx);
+            },
+            final);
+    }
+    double prepareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    int ret = index.query(samples, filter, result);
+    // the query costs what the user waited for, updating the index included
+    result.costMs += prepareMs;
+    return ret;
+}
+
+uint64_t Mp4ParseData::getFrameCacheBytes() const
+{
+    // read every frame for all sessions, without waiting for a decode
+    return mFrameCacheBytes;
+}
+
+uint64_t Mp4ParseData::dropFrameCache()
+{
+    // no decode lock, a decode running goes on and caches its frames again
+    uint64_t bytes = mFrameCacheBytes;
+    clearFrameCache();
+    return bytes;
+}
+
+void Mp4ParseData::clearFrameCache()
+{
+    mFrameCompressor.clear();
+    StdMutexGuard locker(mFrameCacheLock);
+    mFrameCache.clear();
+    mFrameCacheBytes = 0;
+}
+
+bool Mp4ParseData::isFrameCached(uint32_t trackIdx, uint32_t frameIdx)
+{
+    // queued first, a frame leaves the queue only after it's in the cache
+    if (mFrameCompressor.isPending(trackIdx, frameIdx))
+        return true;
+    StdMutexGuard locker(mFrameCacheLock);
+    return mFrameCache.contains(trackIdx, frameIdx);
+}
+
+int Mp4ParseData::getCachedFrame(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame &frame)
+{
+    if (mFrameCompressor.getPending(trackIdx, frameIdx, frame))
+        return 0;
+    StdMutexGuard locker(mFrameCacheLock);
+    auto          startTime = std::chrono::steady_clock::now();
+
+    // a delta frame is XORed with the frames before it, back to one kept whole
+    const FrameCacheData *chain[FRAME_CACHE_DELTA_MAX_CHAIN + 1];
+    int                   chainSize = 0;
+    const FrameCacheData *cacheData = mFrameCache.find(trackIdx, frameIdx);
+    while (cacheData)
+    {
+        if (chainSize > FRAME_CACHE_DELTA_MAX_CHAIN)
+            return -1;
+        chain[chainSize++] = cacheData;
+        if (FRAME_CACHE_CODEC_DELTA != cacheData->codec || cacheData->refSampleIdx < 0)
+            break;
+        cacheData = mFrameCache.find(trackIdx, (uint32_t)cacheData->refSampleIdx);
+    }
+    if (!cacheData)
+        return -1;
+
+    for (int i = chainSize - 1; i >= 0; i--)
+    {
+        if (FrameCompressor::decompress(*chain[i], frame, mDecompressScratch) < 0)
+            return -1;
+    }
+
+    auto &stats = FrameCompressor::getStats(chain[0]->codec);
+    stats.decodedFrames++;
+    stats.decodedBytes += chain[0]->originalDataSize;
+    stats.decodeUs +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+    return 0;
+}
+
+void Mp4ParseData::startFrameCompressor()
+{
+    if (mFrameCompressor.isRunning())
+        return;
+    mFrameCompressor.setSink(
+        [this](uint32_t trackIdx, uint32_t sampleIdx, uint32_t keyFrameIdx, FrameCacheData &&data)
+        {
+            StdMutexGuard locker(mFrameCacheLock);
+            mFrameCache.setMaxBytes((uint64_t)std::max(getAppConfigure().frameCacheMB, 1) * 1024 * 1024);
+            mFrameCache.add(trackIdx, sampleIdx, keyFrameIdx, std::move(data));
+            mFrameCacheBytes = mFrameCache.getBytes();
+        });
+    mFrameCompressor.start();
+}
+
+void Mp4ParseData::startDecodeWorker()
+{
+    if (mDecodeWorker.isRunning())
+        return;
+    mDecodeWorker.setDecodeFunc(
+        [this](const DecodeRequest &request, MyAVFrame &frame, const std::function<bool()> &isCancelled)
+        { return decodeFrameAt(request.trackIdx, request.frameIdx, frame, request.acceptFormats, isCancelled); });
+    mDecodeWorker.start();
+}
+
+uint64_t Mp4ParseData::requestFrame(uint32_t trackIdx, uint32_t frameIdx, const std::vector<AVPixelFormat> &acceptFormats)
+{
+    startDecodeWorker();
+    return mDecodeWorker.request(trackIdx, frameIdx, acceptFormats);
+}
+
+void Mp4ParseData::setPlayAhead(uint32_t trackIdx, std::vector<uint32_t> &&frameIdxs,
+                                const std::vector<AVPixelFormat> &acceptFormats)
+{
+    if (frameIdxs.empty() && !mDecodeWorker.isRunning())
+        return;
+    startDecodeWorker();
+    mDecodeWorker.setPlayAhead(trackIdx, std::move(frameIdxs), acceptFormats);
+}
+
+void Mp4ParseData::getDecodeCost(uint32_t &averageUs, uint32_t &peakUs) const
+{
+    averageUs = mDecodeWorker.getAverageCostUs();
+    peakUs    = mDecodeWorker.getPeakCostUs();
 }
 
 void Mp4ParseData::clear()
 {
+    stopFollowTail();
     if (isRunning())
         stop();
+    if (mDecodeWorker.isRunning())
+        mDecodeWorker.stop();
+    if (mFrameCompressor.isRunning())
+        mFrameCompressor.stop();
 
     mParser->clear();
 
     clearData();
+    {
+        StdMutexGuard locker(mBoxTableLock);
+        mBoxTable.reset(); // holds the box data of the parser
+    }
 
     dataAvailable = false;
 }
@@ -708,7 +1108,9 @@ std::unique_ptr<uint8_t[]> Mp4ParseData::encodeFrameToJpeg(MyAVFrame &frame, uin
         frame.copyTo(srcFrame);
     }
 
-    if (transformFrameFormat(srcFrame, {AV_PIX_FMT_YUVJ420P}) < 0)
+    // a context of its own, the decode worker may be transforming with mFmtTransition
+    MySwsContext fmtTransition;
+    if (transformFrameFormat(srcFrame, {AV_PIX_FMT_YUVJ420P}, fmtTransition) < 0)
     {
         Z_ERR("transform frame format fail {}\n", ffmpeg_make_err_string(ret));
         return nullptr;
@@ -765,104 +1167,46 @@ int Mp4ParseData::decodeJpegToFrame(uint8_t *jpegData, uint32_t jpegSize, MyAVFr
     return 0;
 }
 
-FrameCacheData::FrameCacheData() {}
-
-FrameCacheData::~FrameCacheData() {}
-
-void Mp4ParseData::addFrameToCache(MyAVFrame &frame)
+void Mp4ParseData::addFrameToCache(uint32_t trackIdx, MyAVFrame &frame)
 {
+    // frames decoded again on the way to another one of the GOP
+    uint32_t sampleIdx = (uint32_t)mTracksDecodeStat[trackIdx].lastDecodedFrameIdx;
+    if (isFrameCached(trackIdx, sampleIdx))
+        return;
+
+    TRACE_SCOPE("add_frame_to_cache");
     MyAVFrame transformedFrame;
-    AVFrame  *frameToCache = frame.get();
-    auto      start        = std::chrono::high_resolution_clock::now();
+    MyAVFrame *frameToCache = &frame;
     if (isHardwareFormat((AVPixelFormat)frame->format))
     {
+        // surfaces of the decoder are few, they're not held while queued
         av_hwframe_transfer_data(transformedFrame.get(), frame.get(), 0);
         frame.copyPropsTo(transformedFrame);
-        frameToCache = transformedFrame.get();
-    }
-    auto           format     = (AVPixelFormat)frameToCache->format;
-    int            planeCount = av_pix_fmt_count_planes(format);
-    uint32_t       planeDataSize[4];
-    uint32_t       frameDataSize = 0;
-    FrameCacheData cacheData;
-
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
-    if (planeCount <= 0 || !desc || 0 == (desc->flags & AV_PIX_FMT_FLAG_PLANAR))
-        return;
-
-    for (int i = 0; i < planeCount; i++)
-    {
-        cacheData.lineSize[i] = frameToCache->linesize[i];
-        uint32_t planeHeight  = i > 0 ? AV_CEIL_RSHIFT(frameToCache->height, desc->log2_chroma_h) : frameToCache->height;
-        planeDataSize[i]      = frameToCache->linesize[i] * planeHeight;
-        frameDataSize += planeDataSize[i];
-    }
-
-    auto     frameDataBuffer = std::make_unique<uint8_t[]>(frameDataSize);
-    uint8_t *frameDataPtr    = frameDataBuffer.get();
-
-    size_t offset = 0;
-    for (int i = 0; i < planeCount; i++)
-    {
-        memcpy(frameDataPtr + offset, frameToCache->data[i], planeDataSize[i]);
-        offset += planeDataSize[i];
+        frameToCache = &transformedFrame;
     }
-    int  compressBufferSize = LZ4_compressBound((int)frameDataSize);
-    auto compressBuffer     = std::make_unique<uint8_t[]>(compressBufferSize);
-
-    uint8_t *compressedDataPtr = compressBuffer.get();
 
-    int compressedSize =
-        LZ4_compress_default((const char *)frameDataPtr, (char *)compressedDataPtr, (int)frameDataSize, compressBufferSize);
-    if (compressedSize <= 0)
+    startFrameCompressor();
+    mFrameCompressor.setCodec((FRAME_CACHE_CODEC_E)getAppConfigure().frameCacheCodec, getAppConfigure().lz4Acceleration);
+    uint32_t keyFrameIdx = 0;
     {
-        Z_ERR("LZ4_compress_default failed:%d\n", compressedSize);
-        return;
+        StdMutexGuard tableLocker(mTableLock);
+        keyFrameIdx = tracksSamples[trackIdx].findKeyFrame(sampleIdx);
     }
-
-    cacheData.width  = frameToCache->width;
-    cacheData.height = frameToCache->height;
-    cacheData.format = (AVPixelFormat)frameToCache->format;
-    cacheData.ptsMs  = (uint32_t)frameToCache->pts;
-
-    cacheData.originalDataSize   = frameDataSize;
-    cacheData.compressedDataSize = compressedSize;
-    cacheData.compressedData     = std::move(compressBuffer);
-
-    mDecodeFrameCache.emplace_back(std::move(cacheData));
-    auto end = std::chrono::high_resolution_clock::now();
-    Z_INFO("Add Frame Pts {} To Cache({} ms)\n", frameToCache->pts,
-           std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
+    mFrameCompressor.push(trackIdx, sampleIdx, keyFrameIdx, *frameToCache);
+    Z_INFO("Add Frame Pts {} To Cache\n", frame->pts);
 }
 
 int Mp4ParseData::saveFrameToFile(uint32_t trackIdx, uint32_t frameIdx)
 {
-    auto &samples = tracksInfo[trackIdx].mediaInfo->samplesInfo;
+    // in UI thread, the cache has its own lock, no need to wait for a decode
+    auto &samples = tracksSamples[trackIdx];
     if (frameIdx >= samples.size())
         return -1;
 
-    FrameCacheData *cacheData = nullptr;
-
-    for (auto &cache : mDecodeFrameCache)
-    {
-        if (cache.ptsMs == samples[frameIdx].ptsMs)
-        {
-            Z_INFO("Got Cache With Pts {}\n", cache.ptsMs);
-            cacheData = &cache;
-            break;
-        }
-    }
-
-    if (!cacheData)
-    {
-        Z_ERR("No Cache With Pts {}\n", samples[frameIdx].ptsMs);
-        return -1;
-    }
     MyAVFrame frame;
-
-    if (getCachedFrame(*cacheData, frame) < 0)
+    if (getCachedFrame(trackIdx, frameIdx, frame) < 0)
     {
-        Z_ERR("Failed to get cached frame\n");
+        Z_ERR("No Cache Of Frame {}\n", frameIdx);
         return -1;
     }
 
@@ -2,6 +2,8 @@
 #ifndef _DATA_SHARE_H_
 #define _DATA_SHARE_H_
 
+#include <atomic>
+#include <chrono>
 #include <map>
 
 #include "ImGuiTools.h"
@@ -9,35 +11,18 @@
 #include "Mp4Parse.h"
 #include "imgui.h"
 #include "myThread.h"
-
-struct BoxInfo
-{
-    int                         layer     = 0;
-    int                         box_index = 0;
-    std::string                 box_type;
-    std::shared_ptr<Mp4BoxData> pdata = nullptr;
-
-    // Position In File
-    ImS64 boxPosition = 0;
-    ImS64 boxSize     = 0;
-
-    std::unique_ptr<uint8_t[]> buffer = nullptr;
-
-#define MAX_BUFFERED_SIZE (1024 * 1024)
-    ImS64 bufferSize     = 0;
-    ImS64 bufferedOffset = 0;
-
-    std::vector<std::shared_ptr<BoxInfo>> sub_list; // to make sure sub box address will not change
-    enum
-    {
-        CLOSED,
-        OPENED,
-        FORCE_CLOSE,
-        FORCE_OPEN,
-    } open_state;
-
-    std::map<std::string, std::shared_ptr<ImGui::ImGuiBinaryViewer>> binaryValueViewers;
-};
+#include "FrameTypeExtractor.h"
+#include "IndexCache.h"
+#include "BoxScanner.h"
+#include "FragmentTail.h"
+#include "SampleTable.h"
+#include "NaluScanner.h"
+#include "SampleReader.h"
+#include "BoxTable.h"
+#include "SampleQuery.h"
+#include "DecodeWorker.h"
+#include "FrameCache.h"
+#include "FrameCompressor.h"
 
 enum PARSE_OPERATION_E
 {
@@ -46,43 +31,45 @@ enum PARSE_OPERATION_E
     OPERATION_DECODE_FRAME,
 };
 
-struct FrameCacheData
-{
-    FrameCacheData();
-    virtual ~FrameCacheData();
-    FrameCacheData(FrameCacheData &&)            = default;
-    FrameCacheData &operator=(FrameCacheData &&) = default;
-
-    int width  = 0;
-    int height = 0;
-
-    AVPixelFormat format = AV_PIX_FMT_NONE;
-
-    uint32_t originalDataSize   = 0;
-    uint32_t compressedDataSize = 0;
-    uint32_t ptsMs              = 0;
-
-    std::unique_ptr<uint8_t[]> compressedData;
-
-    int lineSize[AV_NUM_DATA_POINTERS] = {0};
-};
-
 class Mp4ParseData : public MyThread
 {
 public:
     Mp4ParseData() {}
-    void                       init(const std::function<void(MP4_LOG_LEVEL_E level, const char *str)> &logCallback);
-    std::shared_ptr<Mp4Parser> getParser() { return mParser; }
-    int                        startParse(PARSE_OPERATION_E op);
-    PARSE_OPERATION_E          getCurrentOperation() const { return mOperation; }
-    void                       updateData();
-    float                      getParseFileProgress();
-    float                      getParseFrameTypeProgress();
-    void                       recreateDecoder();
-    void                       clear();
-    void                       clearData();
-
-    int decodeFrameAt(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats);
+    void                                 init(const std::function<void(MP4_LOG_LEVEL_E level, const char *str)> &logCallback);
+    std::shared_ptr<Mp4Parser>           getParser() { return mParser; }
+    int                                  startParse(PARSE_OPERATION_E op);
+    PARSE_OPERATION_E                    getCurrentOperation() const { return mOperation; }
+    void                                 updateData();
+    float                                getParseFileProgress();
+    float                                getParseFrameTypeProgress();
+    uint64_t                             getParsedFrameTypeCount() const { return mFrameTypeExtractor.getParsedCount(); }
+    void                                 setFrameTypePriority(uint32_t trackIdx, const FrameTypeExtractor::SampleRanges &ranges);
+    bool                                 isFrameTypeParsed(uint32_t trackIdx, uint32_t sampleIdx) const;
+    H26X_FRAME_TYPE_E                    getFrameType(uint32_t trackIdx, uint32_t sampleIdx) const;
+    FrameTypeExtractor::NaluTypes        getNaluTypes(uint32_t trackIdx, uint32_t sampleIdx) const;
+    std::shared_ptr<const BoxTable>      getBoxTable(); // box headers before the full parse finishes, every box after
+    const std::string                   &getLocalFilePath() const { return mLocalFilePath; }
+    int64_t                              getElapsedMs() const; // since the file was opened
+    int                                  startFollowTail(); // < 0: not a fragmented file
+    void                                 stopFollowTail();
+    bool                                 isFollowingTail() { return mFragmentTail.isRunning(); }
+    uint32_t                             applyTailAppends(); // in UI thread, return count of appended samples
+    int                                  querySamples(uint32_t trackIdx, const SampleFilter &filter, SampleQueryResult &result);
+    void                                 recreateDecoder();
+    uint64_t                             getFrameCacheBytes() const;
+    uint64_t                             dropFrameCache(); // return bytes freed
+    void                                 clear();
+    void                                 clearData();
+
+    // blocks until the frame is decoded, -1 if isCancelled turns true between two decoded frames
+    int decodeFrameAt(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats,
+                      const std::function<bool()> &isCancelled = nullptr);
+    // in UI thread: decoded by the decode worker, the frame comes back through takeDecodedFrame
+    uint64_t requestFrame(uint32_t trackIdx, uint32_t frameIdx, const std::vector<AVPixelFormat> &acceptFormats);
+    bool     takeDecodedFrame(DecodedFrame &frame) { return mDecodeWorker.takeFrame(frame); }
+    // in UI thread: frames playing reaches next, they come back through takeDecodedFrame as ahead frames
+    void setPlayAhead(uint32_t trackIdx, std::vector<uint32_t> &&frameIdxs, const std::vector<AVPixelFormat> &acceptFormats);
+    void getDecodeCost(uint32_t &averageUs, uint32_t &peakUs) const;
     enum SeekResult
     {
         SeekToKeyFrame        = 0,
@@ -93,19 +80,33 @@ public:
     SeekResult seekToFrame(uint32_t trackIdx, uint32_t frameIdx, uint32_t &keyFrameIdx);
 
     int saveFrameToFile(uint32_t trackIdx, uint32_t frameIdx);
+    // start codes and parameter sets, same bytes as Mp4Parser::getVideoSample gives
+    int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frame);
+    // same bytes as Mp4Parser::getSample, samples appended from the tail are read here too
+    int getRawSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &sample);
 
 private:
     virtual void run() override;
     virtual void starting() override;
     virtual void stopping() override;
 
-    int sendPacketToDecoder(uint32_t trackIdx, uint32_t frameIdx);
-    int decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame);
-    int transformFrameFormat(MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats);
+    int                     sendPacketToDecoder(uint32_t trackIdx, uint32_t frameIdx);
+    const SampleWrapLayout *getWrapLayout(uint32_t trackIdx, bool &directRead);
+    int                     readSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &sample); // at its table offset
+    bool                    isParserSample(uint32_t trackIdx, uint32_t sampleIdx); // the parser can still read it
+    void                    releaseParserSamples(uint32_t trackIdx);
+    int                     decodeOneFrame(uint32_t trackIdx, MyAVFrame &frame);
+    void                    startDecodeWorker();
+    int                     transformFrameFormat(MyAVFrame &frame, const std::vector<AVPixelFormat> &acceptFormats,
+                                                 MySwsContext &fmtTransition);
 
     std::unique_ptr<uint8_t[]> encodeFrameToJpeg(MyAVFrame &frame, uint32_t &jpegSize);
     int                        decodeJpegToFrame(uint8_t *jpegData, uint32_t jpegSize, MyAVFrame &frame);
-    void                       addFrameToCache(MyAVFrame &frame);
+    void                       addFrameToCache(uint32_t trackIdx, MyAVFrame &frame); // the frame decoded last
+    bool                       isFrameCached(uint32_t trackIdx, uint32_t frameIdx);
+    int                        getCachedFrame(uint32_t trackIdx, uint32_t frameIdx, MyAVFrame &frame);
+    void                       clearFrameCache();
+    void                       startFrameCompressor();
 
 public:
     std::string toParseFilePath;
@@ -116,8 +117,11 @@ public:
     std::vector<uint32_t> videoTracksIdx;
 
     std::vector<Mp4TrackInfo> tracksInfo;
+    std::vector<SampleTable>  tracksSamples; // same index as tracksInfo, tail appends go here
+    std::vector<SampleIndex>  tracksSampleIndex; // same index as tracksInfo, built again if tail appends made it stale
 
     std::function<void(unsigned int track_id, int frame_idx, H26X_FRAME_TYPE_E frame_type)> onFrameParsed;
+    std::function<void(const std::string &status)>                                          onStatus; // from the worker thread
 
     std::map<int /* trackIdx */, std::vector<uint32_t>> tracksFramePtsList; // sort by pts
     std::map<int /* trackIdx */, std::vector<uint32_t>> tracksIFrameList;
@@ -129,9 +133,26 @@ private:
     std::map<int /* trackIdx */, MyAVCodecContext> mVideoDecoders;
     MySwsContext                                   mFmtTransition;
 
-    volatile uint64_t mParsingFrameCount    = 0;
-    uint64_t          mTotalVideoFrameCount = 0;
-    volatile bool     mIsContinue           = false;
+    FrameTypeExtractor mFrameTypeExtractor;
+    IndexCache         mIndexCache;
+    volatile bool      mIsContinue = false;
+
+    std::string                           mLocalFilePath;
+    std::chrono::steady_clock::time_point mOpenTime;
+    StdMutex                              mBoxTableLock;
+    std::shared_ptr<const BoxTable>       mBoxTable;
+
+    FragmentTail mFragmentTail;
+
+    struct TrackWrapState
+    {
+        SampleWrapLayout layout;
+        bool             directRead   = false; // raw samples from mSampleReader instead of the parser
+        bool             rowsReleased = false; // the parser's sample rows are freed, it can't read samples of the track
+    };
+    StdMutex                                          mWrapLock;
+    std::map<uint32_t /* trackIdx */, TrackWrapState> mWrapStates; // probed on first use, invalid ones too
+    SampleReader                                      mSampleReader;
 
     struct TrackDecodeInfo
     {
@@ -140,8 +161,20 @@ private:
     };
     std::map<int /* trackIdx */, TrackDecodeInfo> mTracksDecodeStat;
 
-    std::vector<FrameCacheData> mDecodeFrameCache; // cache decoded frames as jpeg
+    // decoded frames, compressed by mFrameCompressor. its own lock, compressed frames go in while a decode runs
+    StdMutex                 mFrameCacheLock;
+    FrameCache               mFrameCache;
+    FrameCompressor          mFrameCompressor;
+    FrameCompressor::Scratch mDecompressScratch; // under mFrameCacheLock
+    std::atomic<uint64_t>    mFrameCacheBytes{0};
+
+    // decoders and decode states, the decode worker holds it for a whole decode
+    StdMutex     mDecodeLock;
+    DecodeWorker mDecodeWorker;
+    // tables, pts and key frame lists growing by tail appends. the decode worker takes it per packet, not per decode.
+    // after mDecodeLock, before mWrapLock
+    StdMutex mTableLock;
 };
 
-Mp4ParseData &getMp4DataShare();
+Mp4ParseData &getMp4DataShare(); // of the active session
 #endif
\ No newline at end of file
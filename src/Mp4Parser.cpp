@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <memory>
 #include <filesystem>
 
@@ -16,6 +17,8 @@
 
 #include "Mp4Parser.h"
 #include "AppConfigure.h"
+#include "Trace.h"
+#include "SessionManager.h"
 #include "resource.h"
 
 using std::ref;
@@ -108,14 +111,14 @@ ImS64 getBoxSize(void *boxInfo)
 {
     if (!boxInfo)
         return 0;
-    auto pBoxInfo = static_cast<BoxInfo *>(boxInfo);
+    auto pBoxInfo = static_cast<BoxDataBuffer *>(boxInfo);
     return pBoxInfo->boxSize;
 }
 uint8_t getBoxData(ImS64 offset, void *boxInfo)
 {
     if (!boxInfo)
         return 0;
-    auto pBoxInfo = static_cast<BoxInfo *>(boxInfo);
+    auto pBoxInfo = static_cast<BoxDataBuffer *>(boxInfo);
     if (!pBoxInfo->buffer || offset < pBoxInfo->bufferedOffset || offset >= pBoxInfo->bufferedOffset + pBoxInfo->bufferSize)
     {
         if (!pBoxInfo->buffer)
@@ -129,7 +132,7 @@ uint8_t getBoxData(ImS64 offset, void *boxInfo)
         pBoxInfo->bufferedOffset = MAX(0, offset - pBoxInfo->bufferSize / 2);
         ImS64 loadSize           = MIN(pBoxInfo->boxSize - pBoxInfo->bufferedOffset, pBoxInfo->bufferSize);
 
-        FILE *fp = fopen(getMp4DataShare().getParser()->getFilePath().c_str(), "rb");
+        FILE *fp = fopen(getMp4DataShare().getLocalFilePath().c_str(), "rb");
         if (fp)
         {
             ImS64 seekPos = pBoxInfo->boxPosition + pBoxInfo->bufferedOffset;
@@ -150,14 +153,14 @@ void SaveBoxData(const string &filePath, void *boxInfo)
 {
     if (!boxInfo)
         return;
-    auto  pBoxInfo = static_cast<BoxInfo *>(boxInfo);
+    auto  pBoxInfo = static_cast<BoxDataBuffer *>(boxInfo);
     FILE *fp       = fopen(filePath.c_str(), "wb");
     if (!fp)
     {
         ADD_APPLICATION_LOG("Open %s error: %s\n", filePath.c_str(), getSystemError().c_str());
         return;
     }
-    FILE *srcFp = fopen(getMp4DataShare().getParser()->getFilePath().c_str(), "rb");
+    FILE *srcFp = fopen(getMp4DataShare().getLocalFilePath().c_str(), "rb");
     if (!srcFp)
     {
         ADD_APPLICATION_LOG("Open %s error: %s\n", getMp4DataShare().curFilePath.c_str(), getSystemError().c_str());
@@ -186,75 +189,111 @@ void SaveBoxData(const string &filePath, void *boxInfo)
     IMPORTANT_LOG("Save To %s Success\n", localToUtf8(filePath).c_str());
 }
 
-void Mp4ParserApp::ShowTreeNode(BoxInfo *cur_box)
+void Mp4ParserApp::selectBox(uint32_t boxIdx)
 {
-    if (!cur_box)
+    if (mCurrBoxSelect != boxIdx)
+        mFocusChanged = true;
+    mCurrBoxSelect = boxIdx;
+
+    auto &row                       = mBoxTable->row(boxIdx);
+    mSelectedBoxData.boxPosition    = row.position;
+    mSelectedBoxData.boxSize        = row.size;
+    mSelectedBoxData.buffer         = nullptr;
+    mSelectedBoxData.bufferSize     = 0;
+    mSelectedBoxData.bufferedOffset = 0;
+    mBoxBinaryViewer.setUserData(&mSelectedBoxData);
+}
+
+void Mp4ParserApp::updateVisibleBoxes()
+{
+    mVisibleBoxes.clear();
+    mSomeTreeNodeOpened = false;
+    // preorder, a closed box skips its whole subtree
+    for (uint32_t boxIdx = 0; boxIdx < mBoxTable->size();)
     {
-        Z_ERR("cur_box is nullptr\n");
-        return;
+        auto &row = mBoxTable->row(boxIdx);
+        mVisibleBoxes.push_back(boxIdx);
+        if (row.childCount > 0 && mBoxOpened[boxIdx])
+        {
+            mSomeTreeNodeOpened = true;
+            boxIdx++;
+        }
+        else
+        {
+            boxIdx = row.subtreeEnd;
+        }
     }
-    int node_flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick | ImGuiTreeNodeFlags_SpanAvailWidth;
+    mVisibleBoxesDirty = false;
+}
 
-    bool node_opened = false;
+void Mp4ParserApp::resetBoxOpenStates()
+{
+    mBoxOpened.assign(mBoxTable ? mBoxTable->size() : 0, false);
+    mVisibleBoxes.clear();
+    mVisibleBoxesDirty  = true;
+    mSomeTreeNodeOpened = false;
+}
 
-    if (mCurrBoxSelect == cur_box)
+void Mp4ParserApp::ShowTreeNode(uint32_t boxIdx)
+{
+    // rows are drawn flat, the tree only shows in the indent, so nothing is pushed
+    int node_flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick | ImGuiTreeNodeFlags_SpanAvailWidth
+                   | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+
+    bool        node_opened = false;
+    auto       &row         = mBoxTable->row(boxIdx);
+    const char *boxType     = mBoxTable->getType(boxIdx);
+    float       indent      = (float)row.layer * ImGui::GetStyle().IndentSpacing;
+
+    if (indent > 0)
+        ImGui::Indent(indent);
+    if (mCurrBoxSelect == boxIdx)
         node_flags |= ImGuiTreeNodeFlags_Selected;
-    if (cur_box->sub_list.size() == 0)
+    if (row.childCount == 0)
     {
-        node_flags |= (ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen);
-        ImGui::TreeNodeEx((cur_box->box_type + std::to_string(cur_box->box_index)).c_str(), node_flags, "%s",
-                          cur_box->box_type.c_str());
+        node_flags |= ImGuiTreeNodeFlags_Leaf;
+        ImGui::TreeNodeEx((void *)(intptr_t)boxIdx, node_flags, "%s", boxType);
     }
     else
     {
-        if (BoxInfo::FORCE_OPEN == cur_box->open_state)
-        {
-            ImGui::SetNextItemOpen(true);
-            cur_box->open_state = BoxInfo::OPENED;
-        }
-        else if (BoxInfo::FORCE_CLOSE == cur_box->open_state)
+        ImGui::SetNextItemOpen(mBoxOpened[boxIdx]);
+        node_opened = ImGui::TreeNodeEx((void *)(intptr_t)boxIdx, node_flags, "%s", boxType);
+        if (node_opened != mBoxOpened[boxIdx])
         {
-            ImGui::SetNextItemOpen(false);
-            cur_box->open_state = BoxInfo::CLOSED;
+            // rows change from the next frame, the clipper is still walking this one
+            mBoxOpened[boxIdx] = node_opened;
+            mVisibleBoxesDirty = true;
         }
-        node_opened = ImGui::TreeNodeEx((cur_box->box_type + std::to_string(cur_box->box_index)).c_str(), node_flags, "%s",
-                                        cur_box->box_type.c_str());
     }
     if (isItemClicked())
     {
-        if (mCurrBoxSelect != cur_box)
-            mFocusChanged = true;
-        mCurrBoxSelect = cur_box;
-        mBoxBinaryViewer.setUserData(cur_box);
-        Z_INFO("cur select {}| clicked {} open {}\n", mCurrBoxSelect->box_type, isItemClicked(), node_opened);
-    }
-
-    if (node_opened)
-    {
-        mSomeTreeNodeOpened = true;
-        for (auto &sub_box : cur_box->sub_list)
-        {
-            if (!sub_box)
-            {
-                Z_WARN("box {} has a null subBox\n", cur_box->box_type);
-            }
-            ShowTreeNode(sub_box.get());
-        }
-        ImGui::TreePop();
+        selectBox(boxIdx);
+        Z_INFO("cur select {}| clicked {} open {}\n", boxType, isItemClicked(), node_opened);
     }
+    if (indent > 0)
+        ImGui::Unindent(indent);
 }
 
 void Mp4ParserApp::ShowBoxesTreeView()
 {
-    mSomeTreeNodeOpened = false;
     if (!ImGui::BeginTabItem("Boxes"))
         return;
 
     ImGui::BeginChild("Boxes Tree");
 
-    if (mVirtFileBox)
+    if (mBoxTable && !mBoxTable->empty())
     {
-        ShowTreeNode(mVirtFileBox.get());
+        if (mVisibleBoxesDirty)
+            updateVisibleBoxes();
+
+        // only the rows in the window are drawn, expanding every box of a huge file costs the same per frame
+        ImGuiListClipper clipper;
+        clipper.Begin((int)mVisibleBoxes.size());
+        while (clipper.Step())
+        {
+            for (int rowIdx = clipper.DisplayStart; rowIdx < clipper.DisplayEnd; rowIdx++)
+                ShowTreeNode(mVisibleBoxes[rowIdx]);
+        }
     }
 
     if (mFocusOn != FOCUS_ON_BOXES)
@@ -315,16 +354,10 @@ void Mp4ParserApp::ShowTracksTreeView()
     ImGui::EndTabItem();
 }
 
-void Mp4ParserApp::set_all_open_state(BoxInfo *pBox, bool isClose)
+void Mp4ParserApp::set_all_open_state(bool isClose)
 {
-    pBox->open_state = isClose ? BoxInfo::FORCE_CLOSE : BoxInfo::FORCE_OPEN;
-    if (pBox->sub_list.size() > 0)
-    {
-        for (auto &sub_box : pBox->sub_list)
-        {
-            set_all_open_state(sub_box.get(), isClose);
-        }
-    }
+    mBoxOpened.assign(mBoxOpened.size(), !isClose);
+    mVisibleBoxesDirty = true;
 }
 
 void Mp4ParserApp::ShowInfoItem(uint64_t boxIdx, const std::string &key, const Mp4BoxData &value)
@@ -357,20 +390,14 @@ void Mp4ParserApp::ShowInfoItem(uint64_t boxIdx, const std::string &key, const M
     }
     else if (value.getDataType() == MP4_BOX_DATA_TYPE_TABLE)
     {
-        auto table = mBoxInfoTables.find(&value);
-        if (table == mBoxInfoTables.end())
-            return;
-
         TextCentral(key);
 
-        table->second.show();
+        getBoxDataTable(boxIdx, key, value).show();
     }
     else if (value.getDataType() == MP4_BOX_DATA_TYPE_BINARY)
     {
         ImGui::Text("%s: ", key.c_str());
-        auto binaryViewer = mAllBoxes[boxIdx]->binaryValueViewers.find(key);
-        if (binaryViewer != mAllBoxes[boxIdx]->binaryValueViewers.end())
-            binaryViewer->second->show();
+        getBinaryViewer((uint32_t)boxIdx, key, value).show();
     }
     else
     {
@@ -411,7 +438,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
                 return -1;
 
             auto &trackInfo = getMp4DataShare().tracksInfo[trackIdx];
-            auto &samples   = trackInfo.mediaInfo->samplesInfo;
+            auto &samples   = getMp4DataShare().tracksSamples[trackIdx];
             if (itemIdx >= samples.size())
                 return -1;
 
@@ -424,7 +451,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
             if (TRACK_TYPE_VIDEO == trackInfo.trackType && getAppConfigure().showWrappedData)
             {
                 auto pVideoFrame = std::make_unique<Mp4VideoFrame>();
-                ret              = parser->getVideoSample((uint32_t)trackIdx, (uint32_t)itemIdx, *pVideoFrame);
+                ret              = getMp4DataShare().getVideoSample((uint32_t)trackIdx, (uint32_t)itemIdx, *pVideoFrame);
                 pSample          = std::move(pVideoFrame);
             }
             else if (TRACK_TYPE_AUDIO == trackInfo.trackType && getAppConfigure().showWrappedData)
@@ -436,7 +463,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
             else
             {
                 pSample = std::make_unique<Mp4RawSample>();
-                ret     = parser->getSample((uint32_t)trackIdx, (uint32_t)itemIdx, *pSample);
+                ret     = getMp4DataShare().getRawSample((uint32_t)trackIdx, (uint32_t)itemIdx, *pSample);
             }
 
             if (ret < 0)
@@ -463,7 +490,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
                 return -1;
             auto &trackInfo = getMp4DataShare().tracksInfo[trackIdx];
 
-            auto &chunks = trackInfo.mediaInfo->chunksInfo;
+            auto &chunks = getMp4DataShare().tracksSamples[trackIdx].getChunks();
             if (itemIdx >= chunks.size())
                 return -1;
 
@@ -474,7 +501,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
             for (size_t sampleIdx = chunks[itemIdx].sampleStartIdx;
                  sampleIdx < chunks[itemIdx].sampleStartIdx + chunks[itemIdx].sampleCount; sampleIdx++)
             {
-                if (sampleIdx >= getMp4DataShare().tracksInfo[trackIdx].mediaInfo->samplesInfo.size())
+                if (sampleIdx >= getMp4DataShare().tracksSamples[trackIdx].size())
                     break;
                 unique_ptr<Mp4RawSample> sample;
 
@@ -483,7 +510,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
                 if (TRACK_TYPE_VIDEO == trackInfo.trackType && getAppConfigure().showWrappedData)
                 {
                     auto pVideoFrame = std::make_unique<Mp4VideoFrame>();
-                    ret              = parser->getVideoSample((uint32_t)trackIdx, (uint32_t)sampleIdx, *pVideoFrame);
+                    ret              = getMp4DataShare().getVideoSample((uint32_t)trackIdx, (uint32_t)sampleIdx, *pVideoFrame);
                     sample           = std::move(pVideoFrame);
                 }
                 else if (TRACK_TYPE_AUDIO == trackInfo.trackType && getAppConfigure().showWrappedData)
@@ -495,7 +522,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
                 else
                 {
                     auto pSample = std::make_unique<Mp4RawSample>();
-                    ret          = parser->getSample((uint32_t)trackIdx, (uint32_t)sampleIdx, *pSample);
+                    ret          = getMp4DataShare().getRawSample((uint32_t)trackIdx, (uint32_t)sampleIdx, *pSample);
                     sample       = std::move(pSample);
                 }
 
@@ -531,7 +558,7 @@ int Mp4ParserApp::updateData(int type, size_t trackIdx, size_t itemIdx)
     return 0;
 }
 
-bool sampleTableClickable(const std::vector<Mp4SampleItem> &samples, size_t rowIdx, size_t colIdx)
+bool sampleTableClickable(const SampleTable &samples, size_t rowIdx, size_t colIdx)
 {
     if (rowIdx >= samples.size())
         return false;
@@ -562,15 +589,18 @@ void Mp4ParserApp::sampleTableClicked(size_t trackIdx, size_t rowIdx, size_t col
     if (trackIdx >= getMp4DataShare().tracksInfo.size())
         return;
 
-    auto &samples = getMp4DataShare().tracksInfo[trackIdx].mediaInfo->samplesInfo;
+    auto &samples = getMp4DataShare().tracksSamples[trackIdx];
     if (rowIdx >= samples.size())
         return;
 
-    Z_INFO("show Sample {}, offset {}, size {}\n", rowIdx, samples[rowIdx].sampleOffset, samples[rowIdx].sampleSize);
+    Z_INFO("show Sample {}, offset {}, size {}\n", rowIdx, samples.sampleOffset((uint32_t)rowIdx),
+           samples.sampleSize((uint32_t)rowIdx));
     if (updateData(0, trackIdx, rowIdx) < 0)
         return;
 
-    mDataViewer.setUserData(&samples[rowIdx]);
+    // the table keeps no rows, hold the shown one here
+    mSelectedSample = samples.getSample((uint32_t)rowIdx);
+    mDataViewer.setUserData(&mSelectedSample);
     mDataViewer.setDataCallbacks(
         [](void *userData) -> ImS64
         {
@@ -615,12 +645,12 @@ void Mp4ParserApp::chunkTableClicked(size_t trackIdx, size_t rowIdx, size_t colI
     if (trackIdx >= getMp4DataShare().tracksInfo.size())
         return;
 
-    auto &chunks = getMp4DataShare().tracksInfo[trackIdx].mediaInfo->chunksInfo;
+    auto &chunks = getMp4DataShare().tracksSamples[trackIdx].getChunks();
     if (rowIdx >= chunks.size())
         return;
 
     Z_INFO("show Chunk {}, offset {}, size {}\n", rowIdx, chunks[rowIdx].chunkOffset, chunks[rowIdx].chunkSize);
-    mDataViewer.setUserData(&chunks[rowIdx]);
+    mDataViewer.setUserData((void *)&chunks[rowIdx]);
     if (updateData(1, trackIdx, rowIdx) < 0)
         return;
 
@@ -645,173 +675,398 @@ void Mp4ParserApp::chunkTableClicked(size_t trackIdx, size_t rowIdx, size_t colI
     mDataViewer.open();
 }
 
+static bool hasFrameTypeColumn(const Mp4TrackInfo &track)
+{
+    auto codecType = mp4GetCodecType(track.mediaInfo->codecCode);
+    return TRACK_TYPE_VIDEO == track.trackType && (MP4_CODEC_H264 == codecType || MP4_CODEC_H265 == codecType);
+}
+
 void Mp4ParserApp::updateSamplesTable()
 {
+    for (auto &sorter : mSampleTableSorters)
+        sorter.clear();
+    mSampleTableSorters.resize(getMp4DataShare().tracksInfo.size());
+    mSampleCellCaches.clear();
+    mSampleCellCaches.resize(getMp4DataShare().tracksInfo.size());
     mSampleDataTables.resize(getMp4DataShare().tracksInfo.size());
 
     for (size_t i = 0; i < mSampleDataTables.size(); i++)
     {
         auto &sampleTable = mSampleDataTables[i];
         sampleTable.ScrollFreezeRows(1);
-        sampleTable.setTableFlag(TABLE_FLAGS);
+        sampleTable.setTableFlag(SORTABLE_TABLE_FLAGS);
         sampleTable.clearColumns();
         sampleTable.addColumn("Idx").addColumn("Offset").addColumn("Size").addColumn("PTS(ms)");
 
+        // columns here, cells in formatSampleRow
         switch (getMp4DataShare().tracksInfo[i].trackType)
         {
             case TRACK_TYPE_VIDEO:
-            {
-                bool showFrameType = false;
-                auto codecType     = mp4GetCodecType(getMp4DataShare().tracksInfo[i].mediaInfo->codecCode);
-                if (MP4_CODEC_H264 == codecType || MP4_CODEC_H265 == codecType)
-                    showFrameType = true;
-
                 sampleTable.addColumn("DTS(ms)").addColumn("DTS Delta(ms)");
                 sampleTable.addColumn("Sample Description Index");
-                if (showFrameType)
+                if (hasFrameTypeColumn(getMp4DataShare().tracksInfo[i]))
                     sampleTable.addColumn("Frame Type");
                 sampleTable.addColumn("KeyFrame");
-
-                sampleTable.setDataCallbacks(
-                    [i]() { return getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size(); },
-                    [i, showFrameType](size_t rowIdx, size_t colIdx) -> string
-                    {
-                        if (rowIdx >= getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size())
-                            return "";
-                        auto &curItem = getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo[rowIdx];
-                        switch (colIdx)
-                        {
-                            default:
-                                break;
-                            case 0:
-                                return to_string(curItem.sampleIdx + 1);
-                            case 1:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", curItem.sampleOffset);
-                                else
-                                    return to_string(curItem.sampleOffset);
-                            case 2:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", curItem.sampleSize);
-                                else
-                                    return to_string(curItem.sampleSize);
-                            case 3:
-                                return to_string(curItem.ptsMs);
-                            case 4:
-                                return to_string(curItem.dtsMs);
-                            case 5:
-                                return to_string(curItem.dtsDeltaMs);
-                            case 6:
-                                return to_string(curItem.sampleDescriptionIndex);
-                        }
-                        if (showFrameType)
-                        {
-                            if (colIdx == 7)
-                            {
-                                if (getAppConfigure().showRawFrameType)
-                                {
-                                    string str;
-                                    for (size_t idx = 0; idx < curItem.naluTypes.size(); idx++)
-                                    {
-                                        str += to_string(curItem.naluTypes[idx]);
-                                        if (idx < curItem.naluTypes.size() - 1)
-                                        {
-                                            str += ", ";
-                                        }
-                                    }
-                                    return str;
-                                }
-                                else
-                                {
-                                    return mp4GetFrameTypeStr(curItem.frameType);
-                                }
-                            }
-                            else if (colIdx == 8)
-                                return curItem.isKeyFrame ? "True" : "False";
-                        }
-                        else
-                        {
-                            if (colIdx == 7)
-                                return curItem.isKeyFrame ? "True" : "False";
-                        }
-                        return "";
-                    },
-                    std::bind(sampleTableClickable, std::ref(getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo),
-                              std::placeholders::_1, std::placeholders::_2),
-                    std::bind(&Mp4ParserApp::sampleTableClicked, this, i, std::placeholders::_1, std::placeholders::_2));
                 break;
-            }
             case TRACK_TYPE_AUDIO:
-            {
                 sampleTable.addColumn("PTS Delta(ms)");
-                sampleTable.setDataCallbacks(
-                    [i]() { return getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size(); },
-                    [i](size_t rowIdx, size_t colIdx) -> string
-                    {
-                        if (rowIdx >= getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size())
-                            return "";
-                        auto &cur_item = getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo[rowIdx];
-                        switch (colIdx)
-                        {
-                            case 0:
-                                return to_string(cur_item.sampleIdx);
-                            case 1:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", cur_item.sampleOffset);
-                                else
-                                    return to_string(cur_item.sampleOffset);
-                            case 2:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", cur_item.sampleSize);
-                                else
-                                    return to_string(cur_item.sampleSize);
-                            case 3:
-                                return to_string(cur_item.ptsMs);
-                            case 4:
-                                return to_string(cur_item.dtsDeltaMs);
-                            default:
-                                return "";
-                        }
-                    },
-                    std::bind(sampleTableClickable, ref(getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo),
-                              std::placeholders::_1, std::placeholders::_2),
-                    std::bind(&Mp4ParserApp::sampleTableClicked, this, i, std::placeholders::_1, std::placeholders::_2));
                 break;
-            }
             default:
-            {
-                sampleTable.setDataCallbacks(
-                    [i]() { return getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size(); },
-                    [i](size_t rowIdx, size_t colIdx) -> string
-                    {
-                        if (rowIdx >= getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo.size())
-                            return "";
-                        auto &cur_item = getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo[rowIdx];
-                        switch (colIdx)
-                        {
-                            case 0:
-                                return to_string(cur_item.sampleIdx);
-                            case 1:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", cur_item.sampleOffset);
-                                else
-                                    return to_string(cur_item.sampleOffset);
-                            case 2:
-                                if (getAppConfigure().needShowInHex)
-                                    return Log::format("{#x}", cur_item.sampleSize);
-                                else
-                                    return to_string(cur_item.sampleSize);
-                            case 3:
-                                return to_string(cur_item.ptsMs);
-                            default:
-                                return "";
-                        }
-                    },
-                    std::bind(sampleTableClickable, ref(getMp4DataShare().tracksInfo[i].mediaInfo->samplesInfo),
-                              std::placeholders::_1, std::placeholders::_2),
-                    std::bind(&Mp4ParserApp::sampleTableClicked, this, i, std::placeholders::_1, std::placeholders::_2));
                 break;
+        }
+
+        // rows go through the sort order and the filter result of the track
+        sampleTable.setDataCallbacks(
+            [this, i]() { return getSampleRowCount(i); },
+            [this, i](size_t rowIdx, size_t colIdx) -> string { return getSampleCell(i, rowIdx, colIdx); },
+            [this, i](size_t rowIdx, size_t colIdx)
+            { return sampleTableClickable(getMp4DataShare().tracksSamples[i], getSampleIdx(i, rowIdx), colIdx); },
+            [this, i](size_t rowIdx, size_t colIdx) { sampleTableClicked(i, getSampleIdx(i, rowIdx), colIdx); });
+    }
+}
+
+void Mp4ParserApp::formatSampleRow(size_t trackIdx, size_t sampleIdx, vector<string> &cells)
+{
+    auto &track   = getMp4DataShare().tracksInfo[trackIdx];
+    auto  curItem = getMp4DataShare().tracksSamples[trackIdx].getSample((uint32_t)sampleIdx);
+    bool  inHex   = getAppConfigure().needShowInHex;
+
+    cells.push_back(to_string(TRACK_TYPE_VIDEO == track.trackType ? curItem.sampleIdx + 1 : curItem.sampleIdx));
+    cells.push_back(inHex ? Log::format("{#x}", curItem.sampleOffset) : to_string(curItem.sampleOffset));
+    cells.push_back(inHex ? Log::format("{#x}", curItem.sampleSize) : to_string(curItem.sampleSize));
+    cells.push_back(to_string(curItem.ptsMs));
+    if (TRACK_TYPE_AUDIO == track.trackType)
+        cells.push_back(to_string(curItem.dtsDeltaMs));
+    if (TRACK_TYPE_VIDEO != track.trackType)
+        return;
+
+    cells.push_back(to_string(curItem.dtsMs));
+    cells.push_back(to_string(curItem.dtsDeltaMs));
+    cells.push_back(to_string(curItem.sampleDescriptionIndex));
+    if (hasFrameTypeColumn(track))
+    {
+        if (getAppConfigure().showRawFrameType)
+        {
+            string str;
+            auto   naluTypes = getMp4DataShare().getNaluTypes((uint32_t)trackIdx, (uint32_t)sampleIdx);
+            for (uint32_t idx = 0; idx < naluTypes.size(); idx++)
+            {
+                str += to_string(naluTypes[idx]);
+                if (idx < naluTypes.size() - 1)
+                {
+                    str += ", ";
+                }
             }
+            cells.push_back(str);
+        }
+        else
+        {
+            cells.push_back(mp4GetFrameTypeStr(getMp4DataShare().getFrameType((uint32_t)trackIdx, (uint32_t)sampleIdx)));
+        }
+    }
+    cells.push_back(curItem.isKeyFrame ? "True" : "False");
+}
+
+string Mp4ParserApp::getSampleCell(size_t trackIdx, size_t rowIdx, size_t colIdx)
+{
+    auto sampleIdx = getSampleIdx(trackIdx, rowIdx);
+    if (sampleIdx >= getMp4DataShare().tracksSamples[trackIdx].size() || trackIdx >= mSampleCellCaches.size())
+        return "";
+
+    // cells are formatted again only when what they show changes, not every frame
+    auto    &configure = getAppConfigure();
+    uint64_t state     = (configure.needShowInHex ? 1 : 0) | (configure.showRawFrameType ? 2 : 0);
+    if (hasFrameTypeColumn(getMp4DataShare().tracksInfo[trackIdx]))
+        state |= getMp4DataShare().getParsedFrameTypeCount() << 2;
+
+    auto &cache = mSampleCellCaches[trackIdx];
+    cache.sync(state, ImGui::GetFrameCount());
+    return cache.get(sampleIdx, colIdx,
+                     [this, trackIdx](size_t idx, vector<string> &cells) { formatSampleRow(trackIdx, idx, cells); });
+}
+
+// seconds, "m:s" or "h:m:s", with decimals: "1:30.5" is 90500 ms
+static bool parseTimeMs(const char *str, uint64_t &ms)
+{
+    double seconds = 0;
+    int    fields  = 0;
+    while (true)
+    {
+        char  *end   = nullptr;
+        double value = strtod(str, &end);
+        if (end == str || value < 0 || ++fields > 3)
+            return false;
+        seconds = seconds * 60 + value;
+        if ('\0' == *end)
+            break;
+        if (':' != *end)
+            return false;
+        str = end + 1;
+    }
+    ms = (uint64_t)(seconds * 1000 + 0.5);
+    return true;
+}
+
+size_t Mp4ParserApp::getSampleRowCount(size_t trackIdx)
+{
+    auto filterView = mSampleFilters.find(trackIdx);
+    if (filterView != mSampleFilters.end() && filterView->second.result)
+        return filterView->second.result->samples.size();
+    return getMp4DataShare().tracksSamples[trackIdx].size();
+}
+
+void Mp4ParserApp::updateTableSort(TableSorter &sorter, uint32_t rowCount,
+                                   const std::function<void(int colIdx, vector<uint64_t> &keys)> &getKeys)
+{
+    sorter.update(rowCount);
+
+    // only valid while the table is drawn, the table callbacks come here
+    auto specs = ImGui::TableGetSortSpecs();
+    if (specs && specs->SpecsDirty)
+    {
+        if (specs->SpecsCount > 0)
+            sorter.setOrder(specs->Specs[0].ColumnIndex, ImGuiSortDirection_Descending == specs->Specs[0].SortDirection);
+        else
+            sorter.setOrder(TABLE_SORT_NONE, false);
+        specs->SpecsDirty = false;
+    }
+
+    if (!sorter.needKeys())
+        return;
+    vector<uint64_t> keys(rowCount);
+    getKeys(sorter.getColumn(), keys);
+    sorter.startSort(std::move(keys));
+}
+
+void Mp4ParserApp::getSampleSortKeys(size_t trackIdx, int colIdx, vector<uint64_t> &keys)
+{
+    auto &track         = getMp4DataShare().tracksInfo[trackIdx];
+    auto &samples       = getMp4DataShare().tracksSamples[trackIdx];
+    bool  showFrameType = hasFrameTypeColumn(track);
+    // same columns as updateSamplesTable
+    for (uint32_t row = 0; row < keys.size(); row++)
+    {
+        auto sampleIdx = getFilteredSampleIdx(trackIdx, row);
+        if (sampleIdx >= samples.size())
+            continue;
+
+        uint32_t idx = (uint32_t)sampleIdx;
+        uint64_t key = idx;
+        switch (colIdx)
+        {
+            case 1:
+                key = samples.sampleOffset(idx);
+                break;
+            case 2:
+                key = samples.sampleSize(idx);
+                break;
+            case 3:
+                key = samples.ptsMs(idx);
+                break;
+            case 4:
+                key = TRACK_TYPE_VIDEO == track.trackType ? samples.dtsMs(idx) : samples.dtsDeltaMs(idx);
+                break;
+            case 5:
+                key = samples.dtsDeltaMs(idx);
+                break;
+            case 6:
+                key = samples.descriptionIndex(idx);
+                break;
+            case 7:
+                if (showFrameType)
+                    key = getMp4DataShare().getFrameType((uint32_t)trackIdx, idx);
+                else
+                    key = samples.isKeyFrame(idx);
+                break;
+            case 8:
+                key = samples.isKeyFrame(idx);
+                break;
+            default:
+                break;
+        }
+        keys[row] = key;
+    }
+}
+
+size_t Mp4ParserApp::getSampleIdx(size_t trackIdx, size_t rowIdx)
+{
+    if (trackIdx < mSampleTableSorters.size())
+    {
+        auto &sorter = mSampleTableSorters[trackIdx];
+        updateTableSort(sorter, (uint32_t)getSampleRowCount(trackIdx),
+                        [this, trackIdx](int colIdx, vector<uint64_t> &keys) { getSampleSortKeys(trackIdx, colIdx, keys); });
+        rowIdx = sorter.getRow((uint32_t)rowIdx);
+    }
+    return getFilteredSampleIdx(trackIdx, rowIdx);
+}
+
+size_t Mp4ParserApp::getFilteredSampleIdx(size_t trackIdx, size_t rowIdx)
+{
+    auto filterView = mSampleFilters.find(trackIdx);
+    if (filterView == mSampleFilters.end() || !filterView->second.result)
+        return rowIdx;
+    auto &samples = filterView->second.result->samples;
+    return rowIdx < samples.size() ? samples[rowIdx] : SIZE_MAX;
+}
+
+void Mp4ParserApp::showSampleFilter(size_t trackIdx)
+{
+    auto &view   = mSampleFilters[trackIdx];
+    auto &filter = view.filter;
+
+    if (view.result)
+        ImGui::Text("Filter: %zu of %u samples, %.2f ms", view.result->samples.size(), view.result->totalCount,
+                    view.result->costMs);
+    if (!ImGui::TreeNode("Sample Filter"))
+        return;
+
+    static const float sInputWidth = 120;
+    ImGui::Checkbox("Size", &filter.useSize);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputScalar("##min size", ImGuiDataType_U32, &filter.minSize);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputScalar("Bytes##max size", ImGuiDataType_U32, &filter.maxSize);
+
+    ImGui::Checkbox("PTS ", &filter.usePts);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputTextWithHint("##pts from", "0:00", view.ptsFrom, sizeof(view.ptsFrom));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputTextWithHint("##pts to", "end", view.ptsTo, sizeof(view.ptsTo));
+
+    ImGui::Checkbox("DTS ", &filter.useDts);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputTextWithHint("##dts from", "0:00", view.dtsFrom, sizeof(view.dtsFrom));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(sInputWidth);
+    ImGui::InputTextWithHint("##dts to", "end", view.dtsTo, sizeof(view.dtsTo));
+    ImGui::SetItemTooltip("Seconds, m:s or h:m:s");
+
+    if (TRACK_TYPE_VIDEO == getMp4DataShare().tracksInfo[trackIdx].trackType)
+    {
+        ImGui::CheckboxFlags("I", &filter.frameTypes, 1u << H26X_FRAME_I);
+        ImGui::SameLine();
+        ImGui::CheckboxFlags("P", &filter.frameTypes, 1u << H26X_FRAME_P);
+        ImGui::SameLine();
+        ImGui::CheckboxFlags("B", &filter.frameTypes, 1u << H26X_FRAME_B);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(sInputWidth);
+        ImGui::Combo("##key frame", &view.keyFrameItem, "Any\0Key Frames\0Not Key Frames\0");
+    }
+
+    bool useDescIdx = filter.descriptionIndex >= 0;
+    if (ImGui::Checkbox("Sample Description Index", &useDescIdx))
+        filter.descriptionIndex = useDescIdx ? 1 : -1;
+    if (useDescIdx)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(sInputWidth);
+        ImGui::InputInt("##desc idx", &filter.descriptionIndex);
+        filter.descriptionIndex = std::max(filter.descriptionIndex, 0);
+    }
+
+    bool apply = ImGui::Button("Apply");
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+    {
+        view = SampleFilterView();
+        mVideoStreamInfo.setSampleHighlight((unsigned int)trackIdx, nullptr);
+        if (trackIdx < mSampleTableSorters.size())
+            mSampleTableSorters[trackIdx].reset();
+    }
+    ImGui::TreePop();
+    if (!apply)
+        return;
+
+    static const int sKeyFrameValues[] = {-1, 1, 0};
+    filter.keyFrame                    = sKeyFrameValues[view.keyFrameItem];
+    // empty inputs leave the range open on that side
+    filter.minPtsMs = filter.minDtsMs = 0;
+    filter.maxPtsMs = filter.maxDtsMs = UINT64_MAX;
+    std::pair<const char *, uint64_t *> times[] = {
+        {view.ptsFrom, &filter.minPtsMs},
+        {view.ptsTo,   &filter.maxPtsMs},
+        {view.dtsFrom, &filter.minDtsMs},
+        {view.dtsTo,   &filter.maxDtsMs},
+    };
+    for (auto &time : times)
+    {
+        if ('\0' != time.first[0] && !parseTimeMs(time.first, *time.second))
+        {
+            IMPORTANT_ERR("Invalid time %s\n", time.first);
+            return;
+        }
+    }
+
+    std::shared_ptr<SampleQueryResult> result;
+    if (!filter.isEmpty())
+    {
+        result = std::make_shared<SampleQueryResult>();
+        if (getMp4DataShare().querySamples((uint32_t)trackIdx, filter, *result) < 0)
+        {
+            IMPORTANT_ERR("Query samples of track %zu fail\n", trackIdx);
+            return;
+        }
+        Z_INFO("track {} query {} of {} samples in {} ms\n", trackIdx, result->samples.size(), result->totalCount,
+               result->costMs);
+    }
+    view.result = result;
+    mVideoStreamInfo.setSampleHighlight((unsigned int)trackIdx, result);
+    if (trackIdx < mSampleTableSorters.size())
+        mSampleTableSorters[trackIdx].reset();
+}
+
+size_t Mp4ParserApp::getChunkIdx(size_t trackIdx, size_t rowIdx)
+{
+    if (trackIdx >= mChunkTableSorters.size())
+        return rowIdx;
+
+    auto &sorter = mChunkTableSorters[trackIdx];
+    updateTableSort(sorter, (uint32_t)getMp4DataShare().tracksSamples[trackIdx].getChunks().size(),
+                    [this, trackIdx](int colIdx, vector<uint64_t> &keys) { getChunkSortKeys(trackIdx, colIdx, keys); });
+    return sorter.getRow((uint32_t)rowIdx);
+}
+
+void Mp4ParserApp::getChunkSortKeys(size_t trackIdx, int colIdx, vector<uint64_t> &keys)
+{
+    auto &chunks = getMp4DataShare().tracksSamples[trackIdx].getChunks();
+    // same columns as updateChunksTable
+    for (size_t row = 0; row < keys.size() && row < chunks.size(); row++)
+    {
+        auto &chunk = chunks[row];
+        switch (colIdx)
+        {
+            default:
+                keys[row] = chunk.chunkIdx;
+                break;
+            case 1:
+                keys[row] = chunk.chunkOffset;
+                break;
+            case 2:
+                keys[row] = chunk.chunkSize;
+                break;
+            case 3:
+                keys[row] = chunk.sampleStartIdx;
+                break;
+            case 4:
+                keys[row] = chunk.sampleCount;
+                break;
+            case 5:
+                keys[row] = chunk.sampleDescriptionIndex;
+                break;
+            case 6:
+                keys[row] = chunk.startPtsMs;
+                break;
+            case 7:
+                keys[row] = chunk.durationMs;
+                break;
+            case 8:
+                keys[row] = (uint64_t)chunk.avgBitrateBps;
+                break;
         }
     }
 }
@@ -821,11 +1076,14 @@ void Mp4ParserApp::updateChunksTable()
     if (mCurrTrackSelect >= (int)getMp4DataShare().tracksInfo.size())
         return;
     mChunkDataTables.resize(getMp4DataShare().tracksInfo.size());
+    for (auto &sorter : mChunkTableSorters)
+        sorter.clear();
+    mChunkTableSorters.resize(mChunkDataTables.size());
     for (size_t i = 0; i < mChunkDataTables.size(); i++)
     {
         auto &chunkTable = mChunkDataTables[i];
         chunkTable.ScrollFreezeRows(1);
-        chunkTable.setTableFlag(TABLE_FLAGS);
+        chunkTable.setTableFlag(SORTABLE_TABLE_FLAGS);
         chunkTable.clearColumns();
         chunkTable.addColumn("Idx");
         chunkTable.addColumn("Offset");
@@ -837,12 +1095,14 @@ void Mp4ParserApp::updateChunksTable()
         chunkTable.addColumn("Delta(ms)");
         chunkTable.addColumn("Avg Bitrate(Kbps)");
         chunkTable.setDataCallbacks(
-            [i]() { return getMp4DataShare().tracksInfo[i].mediaInfo->chunksInfo.size(); },
-            [i](size_t rowIdx, size_t colIdx) -> string
+            [i]() { return getMp4DataShare().tracksSamples[i].getChunks().size(); },
+            [this, i](size_t rowIdx, size_t colIdx) -> string
             {
-                if (rowIdx >= getMp4DataShare().tracksInfo[i].mediaInfo->chunksInfo.size())
+                auto &chunks = getMp4DataShare().tracksSamples[i].getChunks();
+                rowIdx       = getChunkIdx(i, rowIdx);
+                if (rowIdx >= chunks.size())
                     return "";
-                auto &cur_item = getMp4DataShare().tracksInfo[i].mediaInfo->chunksInfo[rowIdx];
+                auto &cur_item = chunks[rowIdx];
                 switch (colIdx)
                 {
                     case 0:
@@ -873,9 +1133,9 @@ void Mp4ParserApp::updateChunksTable()
                         return "";
                 }
             },
-            std::bind(chunkTableClickable, ref(getMp4DataShare().tracksInfo[i].mediaInfo->chunksInfo), std::placeholders::_1,
-                      std::placeholders::_2),
-            std::bind(&Mp4ParserApp::chunkTableClicked, this, i, std::placeholders::_1, std::placeholders::_2));
+            [this, i](size_t rowIdx, size_t colIdx)
+            { return chunkTableClickable(getMp4DataShare().tracksSamples[i].getChunks(), getChunkIdx(i, rowIdx), colIdx); },
+            [this, i](size_t rowIdx, size_t colIdx) { chunkTableClicked(i, getChunkIdx(i, rowIdx), colIdx); });
     }
 }
 
@@ -895,7 +1155,7 @@ void Mp4ParserApp::showMp4InfoTab()
     ImGui::BeginTabBar("Leadings", ImGuiTabBarFlags_FittingPolicyResizeDown);
 
     if (ImGui::IsKeyPressed(ImGuiKey_F) && ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows) && mFocusOn == FOCUS_ON_BOXES)
-        set_all_open_state(mVirtFileBox.get(), mSomeTreeNodeOpened);
+        set_all_open_state(mSomeTreeNodeOpened);
 
     ShowBoxesTreeView();
     ShowTracksTreeView();
@@ -949,9 +1209,40 @@ Mp4ParserApp::Mp4ParserApp() : mInfoWindow("Information")
     addSetting(
         SettingValue::SettingInt, "Play I Frame Rate", [](const void *val) { getAppConfigure().playIFrameRate = *(int *)val; },
         [](void *val) { *(int *)val = getAppConfigure().playIFrameRate; });
+    addSetting(
+        SettingValue::SettingInt, "Play Ahead Frames", [](const void *val) { getAppConfigure().playAheadFrames = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().playAheadFrames; });
     addSetting(
         SettingValue::SettingBool, "Show Frame Info", [](const void *val) { getAppConfigure().showFrameInfo = *(bool *)val; },
         [](void *val) { *(bool *)val = getAppConfigure().showFrameInfo; });
+    addSetting(
+        SettingValue::SettingInt, "Frame Type Workers", [](const void *val) { getAppConfigure().frameTypeWorkers = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().frameTypeWorkers; });
+    addSetting(
+        SettingValue::SettingBool, "Use Index Cache", [](const void *val) { getAppConfigure().useIndexCache = *(bool *)val; },
+        [](void *val) { *(bool *)val = getAppConfigure().useIndexCache; });
+    addSetting(
+        SettingValue::SettingInt, "Index Cache Size", [](const void *val) { getAppConfigure().indexCacheSizeMB = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().indexCacheSizeMB; });
+    addSetting(
+        ImGui::SettingValue::SettingStr, "Index Cache Path",
+        [](const void *val) { getAppConfigure().indexCachePath = (char *)val; },
+        [](void *val) { *(const char **)val = getAppConfigure().indexCachePath.c_str(); });
+    addSetting(
+        SettingValue::SettingInt, "Max Worker Threads", [](const void *val) { getAppConfigure().maxWorkerThreads = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().maxWorkerThreads; });
+    addSetting(
+        SettingValue::SettingInt, "Session Cache Size", [](const void *val) { getAppConfigure().sessionCacheMB = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().sessionCacheMB; });
+    addSetting(
+        SettingValue::SettingInt, "Frame Cache Size", [](const void *val) { getAppConfigure().frameCacheMB = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().frameCacheMB; });
+    addSetting(
+        SettingValue::SettingInt, "Frame Cache Codec", [](const void *val) { getAppConfigure().frameCacheCodec = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().frameCacheCodec; });
+    addSetting(
+        SettingValue::SettingInt, "LZ4 Acceleration", [](const void *val) { getAppConfigure().lz4Acceleration = *(int *)val; },
+        [](void *val) { *(int *)val = getAppConfigure().lz4Acceleration; });
     addSetting(
         ImGui::SettingValue::SettingStr, "Save Frame Path",
         [](const void *val) { getAppConfigure().saveFramePath = (char *)val; },
@@ -1006,13 +1297,53 @@ Mp4ParserApp::Mp4ParserApp() : mInfoWindow("Information")
                 }
             });
 
+    addMenu({"Menu", "Follow File Tail"},
+            [this]()
+            {
+                if (getMp4DataShare().isFollowingTail())
+                {
+                    getMp4DataShare().stopFollowTail();
+                    setStatus("Stop Following " + getProperFilePathForStatus(getMp4DataShare().curFilePath));
+                }
+                else if (getMp4DataShare().startFollowTail() < 0)
+                {
+                    IMPORTANT_ERR("Follow %s Fail, only fragmented file can be followed",
+                                  getProperFilePathForStatus(getMp4DataShare().curFilePath).c_str());
+                }
+                else
+                {
+                    setStatus("Following " + getProperFilePathForStatus(getMp4DataShare().curFilePath) + "...");
+                }
+            });
+    addMenu({"Menu", "Record Trace"},
+            [this]()
+            {
+                if (!Trace::isEnabled())
+                {
+                    Trace::setEnabled(true);
+                    setStatus("Recording Trace, Click Record Trace Again To Save");
+                    return;
+                }
+
+                Trace::setEnabled(false);
+                std::error_code ec;
+                fs::path        tracePath = fs::temp_directory_path(ec);
+                tracePath /= "mp4parser_trace_" + std::to_string(gettime_ms()) + ".json";
+                int spanCount = Trace::exportChromeJson(tracePath.string());
+                if (spanCount < 0)
+                {
+                    IMPORTANT_ERR("Save Trace To %s Fail", localToUtf8(tracePath.string()).c_str());
+                }
+                else
+                {
+                    IMPORTANT_LOG("Save %d Trace Spans To %s\n", spanCount, localToUtf8(tracePath.string()).c_str());
+                }
+            });
     addMenu({"Menu", "Reset"}, [this]() { reset(); });
 
-    getMp4DataShare().onFrameParsed = [this](unsigned int trackIdx, int frameIdx, H26X_FRAME_TYPE_E frameType)
-    {
-        string name = mp4GetFrameTypeStr(frameType);
-        mVideoStreamInfo.updateFrameInfo(trackIdx, frameIdx, frameType);
-    };
+    // the first session is made before the app
+    setupSession(getSessionManager().getActiveId());
+    getSessionManager().onCreate = [this](int sessionId) { setupSession(sessionId); };
 
     mBoxBinaryViewer.setDataCallbacks(getBoxSize, getBoxData, SaveBoxData);
 
@@ -1045,21 +1376,27 @@ Mp4ParserApp::Mp4ParserApp() : mInfoWindow("Information")
     }
 }
 
-Mp4ParserApp::~Mp4ParserApp() {}
-
-void Mp4ParserApp::reset()
+Mp4ParserApp::~Mp4ParserApp()
 {
-    getMp4DataShare().clear();
+    getSessionManager().onCreate = nullptr;
+}
 
-    mCurrBoxSelect      = nullptr;
+void Mp4ParserApp::clearView()
+{
+    mCurrBoxSelect      = BOX_TABLE_NONE;
     mCurrTrackSelect    = -1;
     mBoxCount           = 0;
-    mSomeTreeNodeOpened = false;
-    mVirtFileBox.reset();
-    mAllBoxes.clear();
+    mBoxTable.reset();
+    resetBoxOpenStates();
+    mSelectedBoxData = BoxDataBuffer();
     mBoxInfoTables.clear();
+    mBinaryValueViewers.clear();
     mSampleDataTables.clear();
+    mSampleFilters.clear();
+    mSampleTableSorters.clear();
+    mSampleCellCaches.clear();
     mChunkDataTables.clear();
+    mChunkTableSorters.clear();
     mVideoStreamInfo.resetData();
 
     mBinaryData.buffer.reset();
@@ -1069,9 +1406,159 @@ void Mp4ParserApp::reset()
     mBoxBinaryViewer.setUserData(nullptr);
     mDataViewer.setUserData(nullptr);
     mDataViewer.close();
+}
+
+
+void Mp4ParserApp::reset()
+{
+    // the file is closed, the session used last comes to front
+    int sessionId = getSessionManager().getActiveId();
+    getSessionManager().close(sessionId);
+    mSessionViews.erase(sessionId);
+    showActiveSession();
+}
+
+void Mp4ParserApp::setupSession(int sessionId)
+{
+    auto data = getSessionManager().get(sessionId);
+    if (!data)
+        return;
+
+    // files in the background parse on, only the one shown updates the UI
+    data->onFrameParsed = [this, sessionId](unsigned int trackIdx, int frameIdx, H26X_FRAME_TYPE_E frameType)
+    {
+        if (sessionId == getSessionManager().getActiveId())
+            mVideoStreamInfo.updateFrameInfo(trackIdx, frameIdx, frameType);
+    };
+    data->onStatus = [this, sessionId](const string &status)
+    {
+        if (sessionId == getSessionManager().getActiveId())
+            setStatus(status);
+    };
+}
+
+void Mp4ParserApp::switchSession(int sessionId)
+{
+    auto &sessions = getSessionManager();
+    if (sessionId == sessions.getActiveId())
+        return;
+
+    auto &view       = mSessionViews[sessions.getActiveId()];
+    view.boxOpened   = mBoxOpened;
+    view.boxSelect   = mCurrBoxSelect;
+    view.trackSelect = mCurrTrackSelect;
+    if (!sessions.activate(sessionId))
+        return;
+    showActiveSession();
+}
 
-    setApplicationTitle(mApplicationName);
-    setStatus("");
+void Mp4ParserApp::showActiveSession()
+{
+    auto &data = getMp4DataShare();
+    clearView();
+    mSessionTabSelect = true;
+
+    // what is parsed is kept in the session, only the UI items are made again
+    if (data.dataAvailable)
+        resetFileInfo();
+    else if (auto boxTable = data.getBoxTable())
+        resetPreviewBoxes(boxTable);
+
+    auto view = mSessionViews.find(getSessionManager().getActiveId());
+    if (view != mSessionViews.end())
+    {
+        if (mBoxTable && view->second.boxOpened.size() == mBoxTable->size())
+        {
+            mBoxOpened         = view->second.boxOpened;
+            mVisibleBoxesDirty = true;
+            if (view->second.boxSelect < mBoxTable->size())
+                selectBox(view->second.boxSelect);
+        }
+        if (data.dataAvailable)
+            mCurrTrackSelect = view->second.trackSelect;
+        mSessionViews.erase(view);
+    }
+
+    if (data.toParseFilePath.empty())
+    {
+        setApplicationTitle(mApplicationName);
+        setStatus("");
+    }
+    else
+    {
+        setApplicationTitle(localToUtf8(fs::path(utf8ToLocal(data.toParseFilePath)).filename().string()));
+        setStatus(getProperFilePathForStatus(data.toParseFilePath));
+    }
+    if (!data.isRunning())
+        setStatusProgressBar(false);
+}
+
+void Mp4ParserApp::showSessionTabs()
+{
+    auto &sessions = getSessionManager();
+    if (sessions.getSessions().size() < 2)
+        return;
+    if (!ImGui::BeginTabBar("Open Files", ImGuiTabBarFlags_FittingPolicyResizeDown))
+        return;
+
+    int toShow  = -1;
+    int toClose = -1;
+    for (auto &session : sessions.getSessions())
+    {
+        string name = session.data->toParseFilePath.empty()
+                        ? string("Empty")
+                        : localToUtf8(fs::path(utf8ToLocal(session.data->toParseFilePath)).filename().string());
+        name += "##session" + std::to_string(session.id);
+
+        // a session switched to from elsewhere(open, close) is selected here once, the bar doesn't know it yet
+        bool              opened = true;
+        ImGuiTabItemFlags flags  = 0;
+        if (mSessionTabSelect && session.id == sessions.getActiveId())
+            flags |= ImGuiTabItemFlags_SetSelected;
+        if (ImGui::BeginTabItem(name.c_str(), &opened, flags))
+        {
+            if (!mSessionTabSelect && session.id != sessions.getActiveId())
+                toShow = session.id;
+            ImGui::EndTabItem();
+        }
+        if (!opened)
+            toClose = session.id;
+    }
+    ImGui::EndTabBar();
+    mSessionTabSelect = false;
+
+    if (toClose >= 0)
+    {
+        if (toClose == sessions.getActiveId())
+        {
+            reset();
+        }
+        else
+        {
+            sessions.close(toClose);
+            mSessionViews.erase(toClose);
+        }
+    }
+    else if (toShow >= 0)
+    {
+        switchSession(toShow);
+    }
+}
+
+void Mp4ParserApp::updateSessions()
+{
+    auto &sessions = getSessionManager();
+    for (auto &session : sessions.getSessions())
+    {
+        if (session.id == sessions.getActiveId() || MyThread::STATE_FINISHED != session.data->getState())
+            continue;
+
+        // files in the background go on to the frame types by themselves
+        session.data->stop();
+        if (OPERATION_PARSE_FILE == session.data->getCurrentOperation() && session.data->dataAvailable)
+            session.data->startParse(OPERATION_PARSE_FRAME_TYPE);
+    }
+    sessions.trimFrameCaches((uint64_t)std::max(getAppConfigure().sessionCacheMB, 1) * 1024 * 1024);
 }
 
 void Mp4ParserApp::WrapDatacheckBox()
@@ -1090,14 +1577,18 @@ void Mp4ParserApp::ShowInfoView()
 {
     if (mFocusChanged)
     {
-        Z_INFO("Focus on {}, select {}:{}\n", mFocusOn, mCurrBoxSelect ? mCurrBoxSelect->box_type : "null", mCurrTrackSelect);
+        const char *boxType = BOX_TABLE_NONE != mCurrBoxSelect ? mBoxTable->getType(mCurrBoxSelect) : "null";
+        Z_INFO("Focus on {}, select {}:{}\n", mFocusOn, boxType, mCurrTrackSelect);
         mFocusChanged = false;
     }
+    evictBinaryViewers();
 
     if (FOCUS_ON_BOXES == mFocusOn)
     {
-        if (mCurrBoxSelect)
+        if (BOX_TABLE_NONE != mCurrBoxSelect)
         {
+            auto &row   = mBoxTable->row(mCurrBoxSelect);
+            auto  pdata = mBoxTable->getData(mCurrBoxSelect);
             if (getAppConfigure().showBoxBinaryData)
             {
                 mBoxBinaryViewer.show();
@@ -1112,13 +1603,19 @@ void Mp4ParserApp::ShowInfoView()
                     err = mBoxBinaryViewer.getError();
                 }
             }
+            else if (!pdata)
+            {
+                // box from the preview scan, fields come when parsing is done
+                ImGui::Text("Offset: %lld, Size: %lld", (long long)row.position, (long long)row.size);
+                ImGui::TextDisabled("Parsing...");
+            }
             else
             {
-                for (size_t item_idx = 0; item_idx < mCurrBoxSelect->pdata->size(); item_idx++)
+                for (size_t item_idx = 0; item_idx < pdata->size(); item_idx++)
                 {
-                    string key   = mCurrBoxSelect->pdata->kvGetKey(item_idx);
-                    auto   value = mCurrBoxSelect->pdata->kvGetValue(key);
-                    ShowInfoItem(mCurrBoxSelect->box_index, key, *value);
+                    string key   = pdata->kvGetKey(item_idx);
+                    auto   value = pdata->kvGetValue(key);
+                    ShowInfoItem(mCurrBoxSelect, key, *value);
                 }
             }
         }
@@ -1127,13 +1624,16 @@ void Mp4ParserApp::ShowInfoView()
     {
         if (mCurrTrackSelect >= 0)
         {
-            if (mCurrTrackSelect < (int)getMp4DataShare().tracksInfo.size())
+            if (mCurrTrackSelect < (int)getMp4DataShare().tracksInfo.size() && mCurrTrackSelect < (int)mSampleDataTables.size())
             {
                 ImGui::BeginTabBar("Informations", ImGuiTabBarFlags_FittingPolicyResizeDown);
 
                 if (ImGui::BeginTabItem("Sample Info"))
                 {
                     WrapDatacheckBox();
+                    showSampleFilter(mCurrTrackSelect);
+                    if (mSampleTableSorters[mCurrTrackSelect].isSorting())
+                        ImGui::TextDisabled("Sorting...");
                     mSampleDataTables[mCurrTrackSelect].show();
                     ImGui::EndTabItem();
                 }
@@ -1141,6 +1641,8 @@ void Mp4ParserApp::ShowInfoView()
                 if (ImGui::BeginTabItem("Chunk Info"))
                 {
                     WrapDatacheckBox();
+                    if (mCurrTrackSelect < (int)mChunkTableSorters.size() && mChunkTableSorters[mCurrTrackSelect].isSorting())
+                        ImGui::TextDisabled("Sorting...");
                     mChunkDataTables[mCurrTrackSelect].show();
 
                     ImGui::EndTabItem();
@@ -1228,14 +1730,79 @@ void Mp4ParserApp::initSettingsWindowInternal()
             items.insert(mHWTypeItems.begin(), mHWTypeItems.end());
         },
         []() { getMp4DataShare().recreateDecoder(); });
+    addSettingWindowItemCombo(category, "Frame Type Workers", &getAppConfigure().frameTypeWorkers,
+                              {
+                                  {0,  "Auto"},
+                                  {1,  "1"   },
+                                  {2,  "2"   },
+                                  {4,  "4"   },
+                                  {8,  "8"   },
+                                  {16, "16"  },
+    });
     addSettingWindowItemPath(category, "Save Frame Path", &getAppConfigure().saveFramePath,
                              SettingPathFlags_SelectDir | SettingPathFlags_CreateWhenNotExist);
+    addSettingWindowItemBool(category, "Use Index Cache", &getAppConfigure().useIndexCache);
+    addSettingWindowItemCombo(category, "Index Cache Size", &getAppConfigure().indexCacheSizeMB,
+                              {
+                                  {64,   "64 MB"  },
+                                  {256,  "256 MB" },
+                                  {1024, "1 GB"   },
+                                  {4096, "4 GB"   },
+    });
+    addSettingWindowItemPath(category, "Index Cache Path", &getAppConfigure().indexCachePath,
+                             SettingPathFlags_SelectDir | SettingPathFlags_CreateWhenNotExist);
+    addSettingWindowItemCombo(category, "Max Worker Threads", &getAppConfigure().maxWorkerThreads,
+                              {
+                                  {0,  "Auto"},
+                                  {2,  "2"   },
+                                  {4,  "4"   },
+                                  {8,  "8"   },
+                                  {16, "16"  },
+                                  {32, "32"  },
+    });
+    addSettingWindowItemCombo(category, "Frame Cache Of All Files", &getAppConfigure().sessionCacheMB,
+                              {
+                                  {512,   "512 MB"},
+                                  {2048,  "2 GB"  },
+                                  {8192,  "8 GB"  },
+                                  {32768, "32 GB" },
+    });
+    addSettingWindowItemCombo(category, "Frame Cache Of One File", &getAppConfigure().frameCacheMB,
+                              {
+                                  {256,  "256 MB"},
+                                  {1024, "1 GB"  },
+                                  {4096, "4 GB"  },
+                                  {8192, "8 GB"  },
+    });
+    addSettingWindowItemCombo(category, "Frame Cache Encoding", &getAppConfigure().frameCacheCodec,
+                              {
+                                  {FRAME_CACHE_CODEC_RAW,   "Raw"      },
+                                  {FRAME_CACHE_CODEC_LZ4,   "LZ4"      },
+                                  {FRAME_CACHE_CODEC_LZ4HC, "LZ4 HC"   },
+                                  {FRAME_CACHE_CODEC_DELTA, "LZ4 Delta"},
+    });
+    addSettingWindowItemCombo(category, "LZ4 Acceleration", &getAppConfigure().lz4Acceleration,
+                              {
+                                  {1,  "1"  },
+                                  {2,  "2"  },
+                                  {4,  "4"  },
+                                  {8,  "8"  },
+                                  {16, "16" },
+    });
 
     addSettingWindowItemCombo(category, "Action On End Playing", (ComboTag *)&getAppConfigure().playStrategy,
                               {
                                   {AppConfigures::RestartOnEnd, "Restart"},
                                   {AppConfigures::StopOnEnd,    "Stop"   },
     });
+    addSettingWindowItemCombo(category, "Frames Decoded Ahead Of Playing", &getAppConfigure().playAheadFrames,
+                              {
+                                  {0,  "Off"},
+                                  {4,  "4"  },
+                                  {8,  "8"  },
+                                  {16, "16" },
+                                  {24, "24" },
+    });
     addSettingWindowItemCombo(category, "Image Sample Method", (ComboTag *)&getAppConfigure().imageSampleType,
                               {
                                   {ImGui::ImGuiImageSampleType_Linear,  "Bilinear"   },
@@ -1249,6 +1816,7 @@ void Mp4ParserApp::initSettingsWindowInternal()
 
 bool Mp4ParserApp::renderUI()
 {
+    TRACE_SCOPE("render_ui");
     static bool firstTime = true;
     if (firstTime)
     {
@@ -1278,6 +1846,7 @@ bool Mp4ParserApp::renderUI()
         startParseFile(mToParseFile);
         mToParseFile.clear();
     }
+    updateSessions();
 
     if (getMp4DataShare().isRunning())
     {
@@ -1288,6 +1857,22 @@ bool Mp4ParserApp::renderUI()
 
         Z_INFO("Wait for parsing\n");
     }
+    if (getMp4DataShare().isFollowingTail())
+    {
+        uint32_t appendCount = getMp4DataShare().applyTailAppends();
+        if (appendCount > 0)
+        {
+            mVideoStreamInfo.samplesAppended();
+            setStatus(Log::format("Following {}, {} new samples", getProperFilePathForStatus(getMp4DataShare().curFilePath),
+                                  appendCount));
+        }
+    }
+    if (!mBoxTable && getMp4DataShare().isRunning() && OPERATION_PARSE_FILE == getMp4DataShare().getCurrentOperation())
+    {
+        auto previewTable = getMp4DataShare().getBoxTable();
+        if (previewTable)
+            resetPreviewBoxes(previewTable);
+    }
     if (MyThread::STATE_FINISHED == getMp4DataShare().getState())
     {
         getMp4DataShare().stop();
@@ -1303,8 +1888,8 @@ bool Mp4ParserApp::renderUI()
                 setApplicationTitle(newTitle);
 
                 getMp4DataShare().startParse(OPERATION_PARSE_FRAME_TYPE);
-                setStatus(combineString("Parse ", getProperFilePathForStatus(getMp4DataShare().curFilePath),
-                                        " Done, Extracting type of every frame..."));
+                setStatus(combineString("Parse ", getProperFilePathForStatus(getMp4DataShare().curFilePath), " Done in ",
+                                        getMp4DataShare().getElapsedMs(), " ms, Extracting type of every frame..."));
             }
             else
             {
@@ -1317,12 +1902,15 @@ bool Mp4ParserApp::renderUI()
         {
             if (getMp4DataShare().dataAvailable)
             {
-                setStatus(combineString("Parse " + getProperFilePathForStatus(getMp4DataShare().curFilePath)) + " Done");
+                setStatus(combineString("Parse ", getProperFilePathForStatus(getMp4DataShare().curFilePath),
+                                        " Done, Frame Types in ", getMp4DataShare().getElapsedMs(), " ms"));
             }
             setStatusProgressBar(false);
         }
     }
 
+    showSessionTabs();
+
     ImGui::BeginTabBar("Different Infos", ImGuiTabBarFlags_FittingPolicyResizeDown);
 
     if (ImGui::BeginTabItem("Mp4Info"))
@@ -1344,166 +1932,133 @@ bool Mp4ParserApp::renderUI()
     return justClosed();
 }
 
-void Mp4ParserApp::updateBoxDataTables(uint64_t boxIdx, const string &key, const Mp4BoxData &value)
+ImGuiItemTable &Mp4ParserApp::getBoxDataTable(uint64_t boxIdx, const string &key, const Mp4BoxData &value)
 {
-    if (MP4_BOX_DATA_TYPE_KEY_VALUE_PAIRS == value.getDataType())
-    {
-        for (size_t item_idx = 0; item_idx < value.size(); item_idx++)
-        {
-            string subKey   = value.kvGetKey(item_idx);
-            auto   subValue = value.kvGetValue(key);
-            updateBoxDataTables(boxIdx, subKey, *subValue);
-        }
-    }
-    else if (MP4_BOX_DATA_TYPE_TABLE == value.getDataType())
-    {
-        ImGuiItemTable table(key + "Table##" + std::to_string(boxIdx));
-        table.setTableFlag(TABLE_FLAGS);
-        for (size_t header_idx = 0; header_idx < value.tableGetColumnCount(); header_idx++)
-        {
-            table.addColumn(value.tableGetColumnName(header_idx));
-        }
-        table.setDataCallbacks([&]() { return value.size(); },
-                               [&](size_t rowIdx, size_t colIdx) -> string
-                               {
-                                   if (rowIdx >= value.size())
-                                       return "";
-                                   auto cur_item = value.tableGetRow(rowIdx);
-                                   if (getAppConfigure().needShowInHex
-                                       && (value.tableGetColumnName(colIdx).find("Offset") != string::npos
-                                           || value.tableGetColumnName(colIdx).find("Size") != string::npos))
-                                       return cur_item->arrayGetData(colIdx)->toHexString();
-                                   else
-                                       return cur_item->arrayGetData(colIdx)->toString();
-                               });
-
-        mBoxInfoTables[&value] = table;
-    }
-}
-void Mp4ParserApp::updateBoxDataTables(const BoxInfo &box)
-{
-    for (uint64_t item_idx = 0; item_idx < box.pdata->size(); item_idx++)
-    {
-        string key   = box.pdata->kvGetKey(item_idx);
-        auto  &value = *box.pdata->kvGetValue(key);
-        updateBoxDataTables(box.box_index, key, value);
-    }
-    for (auto &sub_box : box.sub_list)
+    auto found = mBoxInfoTables.find(&value);
+    if (found != mBoxInfoTables.end())
+        return found->second;
+
+    ImGuiItemTable table(key + "Table##" + std::to_string(boxIdx));
+    table.setTableFlag(TABLE_FLAGS);
+    for (size_t header_idx = 0; header_idx < value.tableGetColumnCount(); header_idx++)
     {
-        updateBoxDataTables(*sub_box.get());
+        table.addColumn(value.tableGetColumnName(header_idx));
     }
+    table.setDataCallbacks([&value]() { return value.size(); },
+                           [&value](size_t rowIdx, size_t colIdx) -> string
+                           {
+                               if (rowIdx >= value.size())
+                                   return "";
+                               auto cur_item = value.tableGetRow(rowIdx);
+                               if (getAppConfigure().needShowInHex
+                                   && (value.tableGetColumnName(colIdx).find("Offset") != string::npos
+                                       || value.tableGetColumnName(colIdx).find("Size") != string::npos))
+                                   return cur_item->arrayGetData(colIdx)->toHexString();
+                               else
+                                   return cur_item->arrayGetData(colIdx)->toString();
+                           });
+
+    return mBoxInfoTables[&value] = table;
 }
 
-void createBinaryViewer(BoxInfo *pBoxInfo, const string &key, const Mp4BoxData *pData)
+ImGuiBinaryViewer &Mp4ParserApp::getBinaryViewer(uint32_t boxIdx, const string &key, const Mp4BoxData &value)
 {
-    if (pData->getDataType() == MP4_BOX_DATA_TYPE_BINARY)
-    {
-        auto title = std::to_string(pBoxInfo->box_index) + " " + pBoxInfo->box_type + key;
-        if (pBoxInfo->binaryValueViewers.find(key) != pBoxInfo->binaryValueViewers.end())
+    auto &item          = mBinaryValueViewers[&value];
+    item.lastShownFrame = ImGui::GetFrameCount();
+    if (item.viewer)
+        return *item.viewer;
+
+    auto  title     = std::to_string(boxIdx) + " " + mBoxTable->getType(boxIdx) + key;
+    auto *pData     = &value;
+    auto  newViewer = std::make_shared<ImGuiBinaryViewer>(title, true);
+    newViewer->setSize(ImVec2(0, 150));
+    newViewer->setUserData((void *)pData);
+    newViewer->setDataCallbacks(
+        [](const void *userData)
         {
-            ADD_APPLICATION_LOG("duplicate key: %s for box %s(%d_\n", key.c_str(), pBoxInfo->box_type.c_str(),
-                                pBoxInfo->box_index);
-            return;
-        }
+            auto pData = (Mp4BoxData *)userData;
+            return pData->size();
+        },
+        [](uint64_t offset, const void *userData) -> uint8_t
+        {
+            auto pData = (Mp4BoxData *)userData;
+            if (offset >= pData->size())
+                return 0;
+            return pData->binaryGetData(offset);
+        },
+        [](const std::string &filePath, const void *userData)
+        {
+            auto     pData = (Mp4BoxData *)userData;
+            uint64_t size  = pData->binaryGetSize();
 
-        auto newViewer = std::make_shared<ImGuiBinaryViewer>(title, true);
-        newViewer->setSize(ImVec2(0, 150));
-        newViewer->setUserData((void *)pData);
-        newViewer->setDataCallbacks(
-            [](const void *userData)
+            FILE *fp = fopen(filePath.c_str(), "wb+");
+            if (fp == nullptr)
             {
-                auto pData = (Mp4BoxData *)userData;
-                return pData->size();
-            },
-            [](uint64_t offset, const void *userData) -> uint8_t
-            {
-                auto pData = (Mp4BoxData *)userData;
-                if (offset >= pData->size())
-                    return 0;
-                return pData->binaryGetData(offset);
-            },
-            [](const std::string &filePath, const void *userData)
+                IMPORTANT_ERR("Open %s Fail: %s", localToUtf8(filePath).c_str(), getLastError().c_str());
+                return;
+            }
+            for (uint64_t i = 0; i < size; i++)
             {
-                auto     pData = (Mp4BoxData *)userData;
-                uint64_t size  = pData->binaryGetSize();
+                uint8_t data = pData->binaryGetData(i);
+                fwrite(&data, sizeof(uint8_t), 1, fp);
+            }
+            fclose(fp);
+            IMPORTANT_LOG("Save To %s Success\n", localToUtf8(filePath).c_str());
+        });
+    item.viewer = newViewer;
+    return *newViewer;
+}
 
-                FILE *fp = fopen(filePath.c_str(), "wb+");
-                if (fp == nullptr)
-                {
-                    IMPORTANT_ERR("Open %s Fail: %s", localToUtf8(filePath).c_str(), getLastError().c_str());
-                    return;
-                }
-                for (uint64_t i = 0; i < size; i++)
-                {
-                    uint8_t data = pData->binaryGetData(i);
-                    fwrite(&data, sizeof(uint8_t), 1, fp);
-                }
-                fclose(fp);
-                IMPORTANT_LOG("Save To %s Success\n", localToUtf8(filePath).c_str());
-            });
-        pBoxInfo->binaryValueViewers.insert(std::make_pair(key, newViewer));
-    }
-    else if (pData->getDataType() == MP4_BOX_DATA_TYPE_KEY_VALUE_PAIRS)
-    {
-        for (size_t item_idx = 0; item_idx < pData->size(); item_idx++)
-        {
-            string subKey   = pData->kvGetKey(item_idx);
-            auto   subValue = pData->kvGetValue(subKey);
-            createBinaryViewer(pBoxInfo, subKey, subValue.get());
-        }
-    }
-    else if (pData->getDataType() == MP4_BOX_DATA_TYPE_ARRAY)
+void Mp4ParserApp::evictBinaryViewers()
+{
+    int frameCount = ImGui::GetFrameCount();
+    for (auto it = mBinaryValueViewers.begin(); it != mBinaryValueViewers.end();)
     {
-        for (size_t item_idx = 0; item_idx < pData->size(); item_idx++)
-        {
-            auto subValue = pData->arrayGetData(item_idx);
-            createBinaryViewer(pBoxInfo, combineString(key, "[", item_idx, "]"), subValue.get());
-        }
+        if (frameCount - it->second.lastShownFrame > BINARY_VIEWER_KEEP_FRAMES)
+            it = mBinaryValueViewers.erase(it);
+        else
+            it++;
     }
 }
 
-shared_ptr<BoxInfo> Mp4ParserApp::getBoxInfo(const Mp4Box *pBox, int layer, int &boxCount)
+void Mp4ParserApp::resetPreviewBoxes(const shared_ptr<const BoxTable> &previewTable)
 {
-    shared_ptr<BoxInfo> boxInfo = std::make_shared<BoxInfo>();
-
-    boxInfo->layer     = layer;
-    boxInfo->box_index = boxCount++;
-    boxInfo->box_type  = pBox->getBoxTypeStr();
-    boxInfo->pdata     = pBox->getData();
+    mBoxTable = previewTable;
+    resetBoxOpenStates();
+    selectBox(0);
 
-    boxInfo->boxPosition = pBox->getBoxPos();
-    boxInfo->boxSize     = pBox->getBoxSize();
-
-    createBinaryViewer(boxInfo.get(), "", boxInfo->pdata.get());
-
-    mAllBoxes.push_back(boxInfo.get());
-    auto boxes = pBox->getSubBoxes();
-    for (auto &sub_box : boxes)
-    {
-        auto subBoxInfo = getBoxInfo(sub_box.get(), layer + 1, boxCount);
-        boxInfo->sub_list.push_back(subBoxInfo);
-    }
-    return boxInfo;
+    setStatus(Log::format("Parsing {}..., {} boxes ready in {} ms", getProperFilePathForStatus(getMp4DataShare().toParseFilePath),
+                          mBoxTable->size(), getMp4DataShare().getElapsedMs()));
 }
 
 void Mp4ParserApp::resetFileInfo()
 {
-    mCurrBoxSelect   = nullptr;
-    mCurrTrackSelect = -1;
+    // keep what the user selected in the preview tree
+    ImS64  selectPosition = -1;
+    string selectType;
+    if (mBoxTable && BOX_TABLE_NONE != mCurrBoxSelect)
+    {
+        selectPosition = mBoxTable->row(mCurrBoxSelect).position;
+        selectType     = mBoxTable->getType(mCurrBoxSelect);
+    }
 
-    getMp4DataShare().updateData();
+    mCurrBoxSelect   = BOX_TABLE_NONE;
+    mCurrTrackSelect = -1;
 
-    // update box table data
-    int  boxCount          = 0;
-    auto top               = getMp4DataShare().getParser()->asBox();
-    mVirtFileBox           = getBoxInfo(top.get(), 0, boxCount);
-    mVirtFileBox->box_type = localToUtf8(mVirtFileBox->box_type);
+    // the table is built in the parse thread, only the viewers are made here
+    mBoxTable = getMp4DataShare().getBoxTable();
+    if (!mBoxTable || mBoxTable->empty())
+    {
+        Z_ERR("no box table after parsing\n");
+        return;
+    }
+    resetBoxOpenStates();
 
     mBoxInfoTables.clear();
-    updateBoxDataTables(*mVirtFileBox);
+    mBinaryValueViewers.clear();
 
-    mCurrBoxSelect = mVirtFileBox.get();
-    mBoxBinaryViewer.setUserData(mVirtFileBox.get());
+    uint32_t selectIdx = mBoxTable->find(selectPosition, selectType);
+    selectBox(BOX_TABLE_NONE != selectIdx ? selectIdx : 0);
     mCurrTrackSelect = 0;
 
     // update imgui items
@@ -1518,12 +2073,32 @@ void Mp4ParserApp::resetFileInfo()
 
 void Mp4ParserApp::startParseFile(const std::string &file_path)
 {
-    if (getMp4DataShare().isRunning())
+    auto &sessions  = getSessionManager();
+    int   sessionId = sessions.find(file_path);
+    if (sessionId >= 0)
     {
-        getMp4DataShare().stop();
+        auto data = sessions.get(sessionId);
+        if (data->dataAvailable || data->isRunning())
+        {
+            // already open, nothing to parse again
+            switchSession(sessionId);
+            return;
+        }
+        // parsing it failed before, try again in the same session
+        switchSession(sessionId);
+        getMp4DataShare().clear();
+        clearView();
+    }
+    else if (!sessions.isEmpty(sessions.getActiveId()))
+    {
+        // the file open now keeps its parse, decoders and frame cache
+        sessionId = sessions.create();
+        switchSession(sessionId);
+    }
+    else
+    {
+        clearView();
     }
-
-    reset();
 
     getMp4DataShare().toParseFilePath = file_path;
     if (getMp4DataShare().startParse(OPERATION_PARSE_FILE) < 0)
@@ -1535,7 +2110,7 @@ void Mp4ParserApp::startParseFile(const std::string &file_path)
 }
 void Mp4ParserApp::exitInternal()
 {
-    getMp4DataShare().clear();
+    getSessionManager().clearAll();
     mVideoStreamInfo.resetData();
 }
 
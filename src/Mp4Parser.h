@@ -9,10 +9,26 @@
 #include "ImGuiTools.h"
 
 #include "VideoStreamInfo.h"
+#include "TableSorter.h"
+#include "CellCache.h"
 
 #define TABLE_FLAGS                                                                                                        \
     (ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_Borders \
      | ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX)
+#define SORTABLE_TABLE_FLAGS (TABLE_FLAGS | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortTristate)
+
+// bytes of the selected box around where the box binary viewer shows
+struct BoxDataBuffer
+{
+    ImS64 boxPosition = 0;
+    ImS64 boxSize     = 0;
+
+    std::unique_ptr<uint8_t[]> buffer = nullptr;
+
+#define MAX_BUFFERED_SIZE (1024 * 1024)
+    ImS64 bufferSize     = 0;
+    ImS64 bufferedOffset = 0;
+};
 
 class Mp4ParserApp : public ImGui::ImGuiApplication
 {
@@ -34,32 +50,56 @@ protected:
 
 private:
     void startParseFile(const std::string &file);
+    void resetPreviewBoxes(const std::shared_ptr<const BoxTable> &previewTable);
     void resetFileInfo();
 
     void showMp4InfoTab();
 
-    void ShowTreeNode(BoxInfo *cur_box);
+    void ShowTreeNode(uint32_t boxIdx);
     void ShowBoxesTreeView();
     void ShowTracksTreeView();
-    void set_all_open_state(BoxInfo *pBox, bool isClose);
+    void set_all_open_state(bool isClose);
+    void resetBoxOpenStates();
+    void updateVisibleBoxes();
+    void selectBox(uint32_t boxIdx);
 
     void ShowInfoItem(uint64_t boxIdx, const std::string &key, const Mp4BoxData &value);
     void ShowInfoView();
     void WrapDatacheckBox();
 
-    std::shared_ptr<BoxInfo> getBoxInfo(const Mp4Box *pBox, int layer, int &boxCount);
-    void                     updateSamplesTable();
-    void                     updateChunksTable();
+    void updateSamplesTable();
+    void updateChunksTable();
 
-    void updateBoxDataTables(const BoxInfo &pBox);
-    void updateBoxDataTables(uint64_t boxIdx, const std::string &key, const Mp4BoxData &value);
+    ImGui::ImGuiItemTable    &getBoxDataTable(uint64_t boxIdx, const std::string &key, const Mp4BoxData &value);
+    ImGui::ImGuiBinaryViewer &getBinaryViewer(uint32_t boxIdx, const std::string &key, const Mp4BoxData &value);
+    void                      evictBinaryViewers();
 
     void sampleTableClicked(size_t trackIdx, size_t rowIdx, size_t colIdx);
-    void chunkTableClicked(size_t trackIdx, size_t rowIdx, size_t colIdx);
+    void showSampleFilter(size_t trackIdx);
+    // the sample table shows the samples a filter matched, or all of them, in the order of the sorted column
+    size_t      getSampleRowCount(size_t trackIdx);
+    size_t      getSampleIdx(size_t trackIdx, size_t rowIdx); // SIZE_MAX if the row is gone
+    size_t      getFilteredSampleIdx(size_t trackIdx, size_t rowIdx);
+    void        getSampleSortKeys(size_t trackIdx, int colIdx, std::vector<uint64_t> &keys);
+    void        formatSampleRow(size_t trackIdx, size_t sampleIdx, std::vector<std::string> &cells);
+    std::string getSampleCell(size_t trackIdx, size_t rowIdx, size_t colIdx);
+    void        chunkTableClicked(size_t trackIdx, size_t rowIdx, size_t colIdx);
+    size_t      getChunkIdx(size_t trackIdx, size_t rowIdx);
+    void        getChunkSortKeys(size_t trackIdx, int colIdx, std::vector<uint64_t> &keys);
+    // read the sort specs of the table being drawn, start a sort if the column has no order yet
+    void updateTableSort(TableSorter &sorter, uint32_t rowCount,
+                         const std::function<void(int colIdx, std::vector<uint64_t> &keys)> &getKeys);
     void saveCurrentData(const std::string &fileName, size_t size);
 
     int  updateData(int type, size_t trackIdx, size_t itemIdx);
-    void reset();
+    void reset(); // close the file shown
+    void clearView();
+
+    void setupSession(int sessionId);
+    void switchSession(int sessionId);
+    void showActiveSession();
+    void showSessionTabs();
+    void updateSessions(); // in UI thread, every frame
 
 private:
     std::string mToParseFile;
@@ -70,7 +110,7 @@ private:
 
     IImGuiWindow mInfoWindow;
 
-    BoxInfo *mCurrBoxSelect   = nullptr;
+    uint32_t mCurrBoxSelect   = BOX_TABLE_NONE; // index in mBoxTable
     int      mCurrTrackSelect = -1;
 
     enum
@@ -84,15 +124,53 @@ private:
     int  mBoxCount           = 0;
     bool mSomeTreeNodeOpened = false;
 
-    std::shared_ptr<BoxInfo> mVirtFileBox;
-    std::vector<BoxInfo *>   mAllBoxes;
+    std::shared_ptr<const BoxTable> mBoxTable;
+    std::vector<bool>               mBoxOpened;   // one bit per box, same index as mBoxTable
+    std::vector<uint32_t>           mVisibleBoxes; // rows of the tree view, boxes whose parents are all opened
+    bool                            mVisibleBoxesDirty = true;
+    BoxDataBuffer                   mSelectedBoxData;
 
-    // for table, we use map to store them instead of extract data every time render
+    // tree state of the files not shown, back when they are shown again
+    struct SessionView
+    {
+        std::vector<bool> boxOpened;
+        uint32_t          boxSelect   = BOX_TABLE_NONE;
+        int               trackSelect = -1;
+    };
+    std::map<int /* sessionId */, SessionView> mSessionViews;
+    bool                                       mSessionTabSelect = false;
+
+    // for table, we use map to store them instead of extract data every time render, created when first shown
     std::map<const Mp4BoxData *, ImGui::ImGuiItemTable> mBoxInfoTables;
     std::vector<ImGui::ImGuiItemTable>                  mSampleDataTables;
     std::vector<ImGui::ImGuiItemTable>                  mChunkDataTables;
+    std::vector<TableSorter>                            mSampleTableSorters; // same index as mSampleDataTables
+    std::vector<TableSorter>                            mChunkTableSorters;
+    std::vector<CellCache>                              mSampleCellCaches; // same index as mSampleDataTables
     VideoStreamInfo                                     mVideoStreamInfo;
 
+    // filter input of a track's sample table, result is null when no filter is applied
+    struct SampleFilterView
+    {
+        SampleFilter                             filter;
+        int                                      keyFrameItem = 0; // any, key frames, not key frames
+        char                                     ptsFrom[32]  = {0};
+        char                                     ptsTo[32]    = {0};
+        char                                     dtsFrom[32]  = {0};
+        char                                     dtsTo[32]    = {0};
+        std::shared_ptr<const SampleQueryResult> result;
+    };
+    std::map<size_t /* trackIdx */, SampleFilterView> mSampleFilters;
+
+    // binary fields get a viewer when they are drawn, dropped after not being drawn for a while
+#define BINARY_VIEWER_KEEP_FRAMES (600)
+    struct BinaryViewerItem
+    {
+        std::shared_ptr<ImGui::ImGuiBinaryViewer> viewer;
+        int                                       lastShownFrame = 0;
+    };
+    std::map<const Mp4BoxData *, BinaryViewerItem> mBinaryValueViewers;
+
     ImGui::ImGuiBinaryViewer mBoxBinaryViewer = ImGui::ImGuiBinaryViewer("Box Data##Binary", true);
     ImGui::ImGuiBinaryViewer mDataViewer      = ImGui::ImGuiBinaryViewer("Binary Data##Data");
     struct
@@ -104,6 +182,7 @@ private:
         size_t                     trackIdx;
         size_t                     itemIdx; //  sample or chunk index
     } mBinaryData;
+    Mp4SampleItem mSelectedSample{}; // row shown in mDataViewer
 
     std::vector<std::pair<int, std::string>> mHWTypeItems = {
         {-1, "Off" },
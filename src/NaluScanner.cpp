@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NALU_SCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_SSE2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+#endif
+
+#include "NaluScanner.h"
+
+#define WRAP_PROBE_SEARCH_LIMIT (4096) // samples looked at for the probe frames
+#define SLICE_HEADER_BYTES      (32)   // enough for the first fields of any slice header or pps
+
+#define H264_NALU_SLICE     (1)
+#define H264_NALU_IDR_SLICE (5)
+#define H264_NALU_SPS       (7)
+#define H264_NALU_PPS       (8)
+#define HEVC_NALU_IRAP_MIN  (16)
+#define HEVC_NALU_IRAP_MAX  (23)
+#define HEVC_NALU_VCL_MAX   (31)
+#define HEVC_NALU_VPS       (32)
+#define HEVC_NALU_SPS       (33)
+#define HEVC_NALU_PPS       (34)
+
+using std::vector;
+
+static inline uint32_t countTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (uint32_t)idx;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+static size_t findStartCodeScalar(const uint8_t *data, size_t size, size_t pos)
+{
+    for (size_t i = pos; i + 2 < size; i++)
+    {
+        // no start code can cover a byte > 1, jump over it
+        if (data[i + 2] > 1)
+        {
+            i += 2;
+            continue;
+        }
+        if (0 == data[i] && 0 == data[i + 1] && 1 == data[i + 2])
+            return i;
+    }
+    return size;
+}
+
+#ifdef NALU_SCAN_X86
+// compare the block and the block shifted by 1 and 2 bytes, a start code sets a bit in all three masks
+TARGET_SSE2 static size_t findStartCodeSse2(const uint8_t *data, size_t size)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi8(1);
+
+    size_t i = 0;
+    for (; i + 18 <= size; i += 16)
+    {
+        __m128i byte0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+        __m128i byte1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), zero);
+        __m128i byte2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 2)), one);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(byte0, byte1), byte2));
+        if (0 != mask)
+            return i + countTrailingZeros(mask);
+    }
+    return findStartCodeScalar(data, size, i);
+}
+
+TARGET_AVX2 static size_t findStartCodeAvx2(const uint8_t *data, size_t size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi8(1);
+
+    size_t i = 0;
+    for (; i + 34 <= size; i += 32)
+    {
+        __m256i byte0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), zero);
+        __m256i byte1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), zero);
+        __m256i byte2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 2)), one);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(byte0, byte1), byte2));
+        if (0 != mask)
+            return i + countTrailingZeros(mask);
+    }
+    return findStartCodeScalar(data, size, i);
+}
+#endif
+
+static NaluScanIsa detectNaluScanIsa()
+{
+#ifdef NALU_SCAN_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2    = 0 != (info[3] & (1 << 26));
+    bool osAvx   = 0 != (info[2] & (1 << 27)) && 0 != (info[2] & (1 << 28)) && 6 == (_xgetbv(0) & 6);
+    bool avx2Cpu = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2Cpu = 0 != (info[1] & (1 << 5));
+    }
+    if (osAvx && avx2Cpu)
+        return NALU_SCAN_AVX2;
+    if (sse2)
+        return NALU_SCAN_SSE2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return NALU_SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return NALU_SCAN_SSE2;
+#endif
+#endif
+    return NALU_SCAN_SCALAR;
+}
+
+static const NaluScanIsa        sSupportedIsa = detectNaluScanIsa();
+static std::atomic<NaluScanIsa> sNaluScanIsa{sSupportedIsa};
+
+NaluScanIsa getNaluScanIsa()
+{
+    return sNaluScanIsa.load(std::memory_order_relaxed);
+}
+
+NaluScanIsa getSupportedNaluScanIsa()
+{
+    return sSupportedIsa;
+}
+
+const char *getNaluScanIsaName(NaluScanIsa isa)
+{
+    switch (isa)
+    {
+        case NALU_SCAN_AVX2:
+            return "avx2";
+        case NALU_SCAN_SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+void setNaluScanIsa(NaluScanIsa isa)
+{
+    sNaluScanIsa = std::min(isa, sSupportedIsa);
+}
+
+size_t findStartCode(const uint8_t *data, size_t size)
+{
+    switch (getNaluScanIsa())
+    {
+#ifdef NALU_SCAN_X86
+        case NALU_SCAN_AVX2:
+            return findStartCodeAvx2(data, size);
+        case NALU_SCAN_SSE2:
+            return findStartCodeSse2(data, size);
+#endif
+        default:
+            return findStartCodeScalar(data, size, 0);
+    }
+}
+
+uint8_t getNaluType(bool isHevc, const uint8_t *naluHeader)
+{
+    return isHevc ? (naluHeader[0] >> 1) & 0x3F : naluHeader[0] & 0x1F;
+}
+
+bool isParameterSetNalu(bool isHevc, uint8_t naluType)
+{
+    if (isHevc)
+        return HEVC_NALU_VPS == naluType || HEVC_NALU_SPS == naluType || HEVC_NALU_PPS == naluType;
+    return H264_NALU_SPS == naluType || H264_NALU_PPS == naluType;
+}
+
+int scanAnnexBNalus(const uint8_t *data, size_t size, bool isHevc, vector<NaluSpan> &nalus)
+{
+    nalus.clear();
+    size_t headerSize = isHevc ? 2 : 1;
+    size_t start      = findStartCode(data, size);
+    while (start < size)
+    {
+        size_t payload = start + 3;
+        size_t next    = payload + findStartCode(data + payload, size - payload);
+        size_t end     = next;
+        // leading zero of a 4 bytes start code, or trailing zero bytes
+        while (end > payload && 0 == data[end - 1])
+            end--;
+        if (end - payload >= headerSize)
+            nalus.push_back({(uint32_t)payload, (uint32_t)(end - payload), getNaluType(isHevc, data + payload)});
+        start = next;
+    }
+    return (int)nalus.size();
+}
+
+int scanLengthPrefixedNalus(const uint8_t *data, size_t size, int lengthSize, bool isHevc, vector<NaluSpan> &nalus)
+{
+    nalus.clear();
+    if (lengthSize < 1 || lengthSize > 4)
+        return -1;
+
+    size_t headerSize = isHevc ? 2 : 1;
+    size_t pos        = 0;
+    while (pos + lengthSize <= size)
+    {
+        uint32_t naluSize = 0;
+        for (int i = 0; i < lengthSize; i++)
+            naluSize = (naluSize << 8) | data[pos + i];
+        pos += lengthSize;
+        if (naluSize > size - pos)
+            return -1;
+        if (naluSize >= headerSize)
+            nalus.push_back({(uint32_t)pos, naluSize, getNaluType(isHevc, data + pos)});
+        pos += naluSize;
+    }
+    return pos == size ? (int)nalus.size() : -1;
+}
+
+// bits of the first bytes of a nal payload, emulation prevention bytes removed
+class HeaderBitReader
+{
+public:
+    HeaderBitReader(const uint8_t *data, size_t size)
+    {
+        int zeroCount = 0;
+        for (size_t i = 0; i < size && mSize < SLICE_HEADER_BYTES; i++)
+        {
+            if (zeroCount >= 2 && 3 == data[i])
+            {
+                zeroCount = 0;
+                continue;
+            }
+            zeroCount        = 0 == data[i] ? zeroCount + 1 : 0;
+            mBuffer[mSize++] = data[i];
+        }
+    }
+
+    bool readBits(int count, uint32_t &value)
+    {
+        if (mBitPos + count > mSize * 8)
+            return false;
+        value = 0;
+        for (int i = 0; i < count; i++, mBitPos++)
+            value = (value << 1) | ((mBuffer[mBitPos / 8] >> (7 - mBitPos % 8)) & 1);
+        return true;
+    }
+
+    bool readUe(uint32_t &value)
+    {
+        int      leadingZeros = 0;
+        uint32_t bit          = 0;
+        while (readBits(1, bit) && 0 == bit)
+        {
+            if (++leadingZeros > 31)
+                return false;
+        }
+        if (0 == bit)
+            return false;
+
+        uint32_t suffix = 0;
+        if (!readBits(leadingZeros, suffix))
+            return false;
+        value = (uint32_t)(((uint64_t)1 << leadingZeros) - 1 + suffix);
+        return true;
+    }
+
+private:
+    uint8_t mBuffer[SLICE_HEADER_BYTES];
+    size_t  mSize   = 0;
+    size_t  mBitPos = 0;
+};
+
+SliceTypeParser::SliceTypeParser(bool isHevc) : mIsHevc(isHevc)
+{
+    memset(mExtraSliceHeaderBits, -1, sizeof(mExtraSliceHeaderBits));
+}
+
+void SliceTypeParser::addParameterSets(const uint8_t *data, const vector<NaluSpan> &nalus)
+{
+    for (auto &nalu : nalus)
+    {
+        if (mIsHevc && HEVC_NALU_PPS == nalu.type)
+            parsePps(data, nalu);
+    }
+}
+
+void SliceTypeParser::parsePps(const uint8_t *data, const NaluSpan &nalu)
+{
+    HeaderBitReader reader(data + nalu.offset + 2, nalu.size - 2);
+
+    uint32_t ppsId = 0, spsId = 0, dependentSliceSegments = 0, outputFlagPresent = 0, extraBits = 0;
+    if (reader.readUe(ppsId) && reader.readUe(spsId) && reader.readBits(1, dependentSliceSegments)
+        && reader.readBits(1, outputFlagPresent) && reader.readBits(3, extraBits) && ppsId < HEVC_MAX_PPS)
+        mExtraSliceHeaderBits[ppsId] = (int8_t)extraBits;
+}
+
+H26X_FRAME_TYPE_E SliceTypeParser::parseSliceHeader(const uint8_t *data, const NaluSpan &nalu) const
+{
+    uint32_t sliceType = 0;
+    if (!mIsHevc)
+    {
+        HeaderBitReader reader(data + nalu.offset + 1, nalu.size - 1);
+
+        uint32_t firstMb = 0;
+        if (!reader.readUe(firstMb) || !reader.readUe(sliceType))
+            return H26X_FRAME_Unknown;
+        // P, B, I, SP, SI, then the same again for "all slices of the picture have this type"
+        switch (sliceType % 5)
+        {
+            case 0:
+            case 3:
+                return H26X_FRAME_P;
+            case 1:
+                return H26X_FRAME_B;
+            default:
+                return H26X_FRAME_I;
+        }
+    }
+
+    // irap pictures only have I slices
+    if (nalu.type >= HEVC_NALU_IRAP_MIN && nalu.type <= HEVC_NALU_IRAP_MAX)
+        return H26X_FRAME_I;
+
+    HeaderBitReader reader(data + nalu.offset + 2, nalu.size - 2);
+
+    // slice_segment_address of a later segment needs the sps picture size, only the first segment is read
+    uint32_t firstSliceSegment = 0, ppsId = 0, extraBits = 0;
+    if (!reader.readBits(1, firstSliceSegment) || 0 == firstSliceSegment || !reader.readUe(ppsId) || ppsId >= HEVC_MAX_PPS
+        || mExtraSliceHeaderBits[ppsId] < 0)
+        return H26X_FRAME_Unknown;
+    if (!reader.readBits(mExtraSliceHeaderBits[ppsId], extraBits) || !reader.readUe(sliceType))
+        return H26X_FRAME_Unknown;
+
+    switch (sliceType)
+    {
+        case 0:
+            return H26X_FRAME_B;
+        case 1:
+            return H26X_FRAME_P;
+        case 2:
+            return H26X_FRAME_I;
+        default:
+            return H26X_FRAME_Unknown;
+    }
+}
+
+H26X_FRAME_TYPE_E SliceTypeParser::getFrameType(const uint8_t *data, const vector<NaluSpan> &nalus)
+{
+    for (auto &nalu : nalus)
+    {
+        if (mIsHevc)
+        {
+            if (HEVC_NALU_PPS == nalu.type)
+                parsePps(data, nalu);
+            else if (nalu.type <= HEVC_NALU_VCL_MAX)
+                return parseSliceHeader(data, nalu);
+        }
+        else if (nalu.type >= H264_NALU_SLICE && nalu.type <= H264_NALU_IDR_SLICE)
+        {
+            return parseSliceHeader(data, nalu);
+        }
+    }
+    return H26X_FRAME_Unknown;
+}
+
+vector<WrapProbeSample> pickWrapProbeSamples(uint32_t sampleCount, const std::function<bool(uint32_t idx)> &isKeyFrame,
+                                             const std::function<uint32_t(uint32_t idx)> &descriptionIndex,
+                                             uint32_t                                     &probeDescriptionIndex)
+{
+    int64_t  firstKeyIdx  = -1;
+    int64_t  secondKeyIdx = -1;
+    int64_t  otherIdx     = -1;
+    uint32_t searchEnd    = std::min<uint32_t>(sampleCount, WRAP_PROBE_SEARCH_LIMIT);
+    for (uint32_t idx = 0; idx < searchEnd && (secondKeyIdx < 0 || otherIdx < 0); idx++)
+    {
+        if (firstKeyIdx < 0)
+        {
+            if (isKeyFrame(idx))
+            {
+                firstKeyIdx           = idx;
+                probeDescriptionIndex = descriptionIndex(idx);
+            }
+            continue;
+        }
+        if (descriptionIndex(idx) != probeDescriptionIndex)
+            continue;
+        if (isKeyFrame(idx))
+        {
+            if (secondKeyIdx < 0)
+                secondKeyIdx = idx;
+        }
+        else if (otherIdx < 0)
+        {
+            otherIdx = idx;
+        }
+    }
+
+    vector<WrapProbeSample> samples;
+    if (firstKeyIdx < 0)
+        return samples;
+    // the other frame goes before the second key frame, it tells whether all samples get the prefix
+    samples.push_back({(uint32_t)firstKeyIdx, true});
+    if (otherIdx >= 0)
+        samples.push_back({(uint32_t)otherIdx, false});
+    if (secondKeyIdx >= 0)
+        samples.push_back({(uint32_t)secondKeyIdx, true});
+    return samples;
+}
+
+static int wrapSampleData(const SampleWrapLayout &layout, const Mp4RawSample &sample, bool isKeyFrame, Mp4VideoFrame &frame)
+{
+    thread_local vector<NaluSpan> nalus;
+
+    const uint8_t *data = sample.sampleData.get();
+    if (!data || scanLengthPrefixedNalus(data, sample.dataSize, layout.lengthSize, layout.isHevc, nalus) < 0)
+        return -1;
+
+    size_t prefixSize  = isKeyFrame || layout.prefixAllSamples ? layout.keyFramePrefix.size() : 0;
+    size_t wrappedSize = prefixSize;
+    for (auto &nalu : nalus)
+        wrappedSize += layout.startCodeSize + nalu.size;
+
+    auto     buffer = std::make_unique<uint8_t[]>(wrappedSize);
+    uint8_t *dst    = buffer.get();
+    memcpy(dst, layout.keyFramePrefix.data(), prefixSize);
+    dst += prefixSize;
+    for (auto &nalu : nalus)
+    {
+        memset(dst, 0, layout.startCodeSize - 1);
+        dst[layout.startCodeSize - 1] = 1;
+        dst += layout.startCodeSize;
+        memcpy(dst, data + nalu.offset, nalu.size);
+        dst += nalu.size;
+    }
+
+    frame.sampleData = std::move(buffer);
+    frame.dataSize   = wrappedSize;
+    frame.ptsMs      = sample.ptsMs;
+    frame.dtsMs      = sample.dtsMs;
+    return 0;
+}
+
+static bool isWrappedSame(const SampleWrapLayout &layout, const Mp4RawSample &sample, bool isKeyFrame,
+                          const Mp4VideoFrame &expected)
+{
+    Mp4VideoFrame wrapped;
+    if (wrapSampleData(layout, sample, isKeyFrame, wrapped) < 0 || wrapped.dataSize != expected.dataSize)
+        return false;
+    return 0 == memcmp(wrapped.sampleData.get(), expected.sampleData.get(), wrapped.dataSize);
+}
+
+int probeSampleWrapLayout(Mp4Parser &parser, uint32_t trackIdx, bool isHevc, const vector<WrapProbeSample> &samples,
+                          SampleWrapLayout &layout)
+{
+    layout.valid  = false;
+    layout.isHevc = isHevc;
+    if (samples.empty() || !samples[0].isKeyFrame)
+        return -1;
+
+    Mp4RawSample  raw;
+    Mp4VideoFrame wrapped;
+    if (parser.getSample(trackIdx, samples[0].sampleIdx, raw) < 0
+        || parser.getVideoSample(trackIdx, samples[0].sampleIdx, wrapped) < 0 || !raw.sampleData || !wrapped.sampleData)
+        return -1;
+
+    // whatever is left before the converted key frame is the prefix
+    vector<NaluSpan> nalus;
+    bool             found = false;
+    for (int lengthSize : {4, 2, 1})
+    {
+        if (scanLengthPrefixedNalus(raw.sampleData.get(), raw.dataSize, lengthSize, isHevc, nalus) <= 0)
+            continue;
+        for (int startCodeSize : {4, 3})
+        {
+            size_t convertedSize = 0;
+            for (auto &nalu : nalus)
+                convertedSize += startCodeSize + nalu.size;
+            if (convertedSize > wrapped.dataSize)
+                continue;
+
+            layout.lengthSize    = lengthSize;
+            layout.startCodeSize = startCodeSize;
+            layout.keyFramePrefix.assign(wrapped.sampleData.get(), wrapped.sampleData.get() + wrapped.dataSize - convertedSize);
+            if (isWrappedSame(layout, raw, true, wrapped))
+            {
+                found = true;
+                break;
+            }
+        }
+        if (found)
+            break;
+    }
+    if (!found)
+        return -1;
+
+    scanAnnexBNalus(layout.keyFramePrefix.data(), layout.keyFramePrefix.size(), isHevc, nalus);
+    for (auto &nalu : nalus)
+    {
+        if (!isParameterSetNalu(isHevc, nalu.type))
+            return -1;
+    }
+
+    layout.prefixAllSamples = false;
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        if (parser.getSample(trackIdx, samples[i].sampleIdx, raw) < 0
+            || parser.getVideoSample(trackIdx, samples[i].sampleIdx, wrapped) < 0)
+            return -1;
+        if (isWrappedSame(layout, raw, samples[i].isKeyFrame, wrapped))
+            continue;
+        if (samples[i].isKeyFrame || layout.prefixAllSamples)
+            return -1;
+        layout.prefixAllSamples = true;
+        if (!isWrappedSame(layout, raw, false, wrapped))
+            return -1;
+    }
+
+    layout.valid = true;
+    return 0;
+}
+
+int wrapSample(const SampleWrapLayout &layout, const Mp4RawSample &sample, bool isKeyFrame, Mp4VideoFrame &frame)
+{
+    if (!layout.valid)
+        return -1;
+    return wrapSampleData(layout, sample, isKeyFrame, frame);
+}
@@ -0,0 +1,91 @@
+#ifndef _NALU_SCANNER_H_
+#define _NALU_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Mp4Parse.h"
+
+// nal unit boundaries and headers of H264/H265 samples.
+// start codes are searched 32(avx2) or 16(sse2) bytes a step, the implementation is picked at runtime
+enum NaluScanIsa
+{
+    NALU_SCAN_SCALAR = 0,
+    NALU_SCAN_SSE2,
+    NALU_SCAN_AVX2,
+};
+
+struct NaluSpan
+{
+    uint32_t offset = 0; // nal header, after the start code or length field
+    uint32_t size   = 0;
+    uint8_t  type   = 0;
+};
+
+NaluScanIsa getNaluScanIsa();
+NaluScanIsa getSupportedNaluScanIsa();
+const char *getNaluScanIsaName(NaluScanIsa isa);
+void        setNaluScanIsa(NaluScanIsa isa); // clamped to what the cpu supports
+
+// position of the first 00 00 01, size if there is none
+size_t  findStartCode(const uint8_t *data, size_t size);
+uint8_t getNaluType(bool isHevc, const uint8_t *naluHeader);
+bool    isParameterSetNalu(bool isHevc, uint8_t naluType);
+// start code(annex b) stream, like what Mp4Parser::getVideoSample gives
+int scanAnnexBNalus(const uint8_t *data, size_t size, bool isHevc, std::vector<NaluSpan> &nalus);
+// length field before every nal, like what mp4 samples store. < 0 if the lengths don't add up to size
+int scanLengthPrefixedNalus(const uint8_t *data, size_t size, int lengthSize, bool isHevc, std::vector<NaluSpan> &nalus);
+
+// frame type from the first slice header of a sample.
+// h265 slice headers depend on the pps, so the parameter sets must be seen before the slices
+class SliceTypeParser
+{
+public:
+    explicit SliceTypeParser(bool isHevc);
+
+    void addParameterSets(const uint8_t *data, const std::vector<NaluSpan> &nalus);
+    // H26X_FRAME_Unknown if there's no slice, or its header can't be read with what is known
+    H26X_FRAME_TYPE_E getFrameType(const uint8_t *data, const std::vector<NaluSpan> &nalus);
+
+private:
+    void              parsePps(const uint8_t *data, const NaluSpan &nalu);
+    H26X_FRAME_TYPE_E parseSliceHeader(const uint8_t *data, const NaluSpan &nalu) const;
+
+    enum
+    {
+        HEVC_MAX_PPS = 64,
+    };
+    bool   mIsHevc;
+    int8_t mExtraSliceHeaderBits[HEVC_MAX_PPS]; // num_extra_slice_header_bits by pps id, -1: pps not seen
+};
+
+// how Mp4Parser::getVideoSample wraps a raw sample: parameter sets before key frames, length fields to start codes.
+// learned by comparing both forms of a few real samples, a layout that doesn't reproduce them is left invalid
+struct SampleWrapLayout
+{
+    bool                 valid            = false;
+    bool                 isHevc           = false;
+    uint32_t             descriptionIndex = 0; // other sample descriptions have other parameter sets
+    int                  lengthSize       = 4;
+    int                  startCodeSize    = 4;
+    bool                 prefixAllSamples = false;
+    std::vector<uint8_t> keyFramePrefix;
+};
+
+struct WrapProbeSample
+{
+    uint32_t sampleIdx  = 0;
+    bool     isKeyFrame = false;
+};
+
+// first key frame, the next key frame and the first other frame of the same sample description
+std::vector<WrapProbeSample> pickWrapProbeSamples(uint32_t sampleCount, const std::function<bool(uint32_t idx)> &isKeyFrame,
+                                                  const std::function<uint32_t(uint32_t idx)> &descriptionIndex,
+                                                  uint32_t                                     &probeDescriptionIndex);
+int probeSampleWrapLayout(Mp4Parser &parser, uint32_t trackIdx, bool isHevc, const std::vector<WrapProbeSample> &samples,
+                          SampleWrapLayout &layout);
+int wrapSample(const SampleWrapLayout &layout, const Mp4RawSample &sample, bool isKeyFrame, Mp4VideoFrame &frame);
+
+#endif
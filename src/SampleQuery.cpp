@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <chrono>
+
+#include "SampleQuery.h"
+
+using std::vector;
+
+// frame types share 4 bits with the key flag in SampleTable
+#define SAMPLE_FRAME_TYPE_COUNT (16)
+
+static inline uint32_t countTrailingZeros64(uint64_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return (uint32_t)idx;
+#else
+    return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
+
+bool SampleFilter::isEmpty() const
+{
+    return !useSize && !usePts && !useDts && keyFrame < 0 && 0 == frameTypes && descriptionIndex < 0;
+}
+
+void SampleIndex::build(const SampleTable &samples)
+{
+    mSampleCount = samples.size();
+
+    mBySize.resize(mSampleCount);
+    mByPts.resize(mSampleCount);
+    for (uint32_t i = 0; i < mSampleCount; i++)
+    {
+        mBySize[i] = i;
+        mByPts[i]  = i;
+    }
+    // stable, samples of the same size or pts stay in sample order
+    std::stable_sort(mBySize.begin(), mBySize.end(),
+                     [&samples](uint32_t a, uint32_t b) { return samples.sampleSize(a) < samples.sampleSize(b); });
+    std::stable_sort(mByPts.begin(), mByPts.end(),
+                     [&samples](uint32_t a, uint32_t b) { return samples.ptsMs(a) < samples.ptsMs(b); });
+
+    mKeyFrameBits.assign((mSampleCount + 63) / 64, 0);
+    for (uint32_t i = 0; i < mSampleCount; i++)
+    {
+        if (samples.isKeyFrame(i))
+            mKeyFrameBits[i / 64] |= 1ull << (i % 64);
+    }
+
+    // frame types of the table until the extractor gives better ones
+    mFrameTypeBits.assign(SAMPLE_FRAME_TYPE_COUNT, vector<uint64_t>());
+    mPendingTypeWords.clear();
+    for (uint32_t word = 0; word < mKeyFrameBits.size(); word++)
+        mPendingTypeWords.push_back(word);
+    mFrameTypesFinal = false;
+    updateFrameTypes(
+        [&samples](uint32_t sampleIdx, bool &parsed)
+        {
+            parsed = false;
+            return samples.frameType(sampleIdx);
+        },
+        false);
+}
+
+void SampleIndex::extend(const SampleTable &samples)
+{
+    uint32_t oldCount = mSampleCount;
+    if (oldCount > samples.size() || mBySize.size() != oldCount)
+    {
+        build(samples);
+        return;
+    }
+    mSampleCount = samples.size();
+
+    // new samples sorted on their own, then merged, the stable merge keeps the old ones first
+    auto sizeLess = [&samples](uint32_t a, uint32_t b) { return samples.sampleSize(a) < samples.sampleSize(b); };
+    auto ptsLess  = [&samples](uint32_t a, uint32_t b) { return samples.ptsMs(a) < samples.ptsMs(b); };
+    for (uint32_t i = oldCount; i < mSampleCount; i++)
+    {
+        mBySize.push_back(i);
+        mByPts.push_back(i);
+    }
+    std::stable_sort(mBySize.begin() + oldCount, mBySize.end(), sizeLess);
+    std::inplace_merge(mBySize.begin(), mBySize.begin() + oldCount, mBySize.end(), sizeLess);
+    std::stable_sort(mByPts.begin() + oldCount, mByPts.end(), ptsLess);
+    std::inplace_merge(mByPts.begin(), mByPts.begin() + oldCount, mByPts.end(), ptsLess);
+
+    size_t wordCount = (mSampleCount + 63) / 64;
+    mKeyFrameBits.resize(wordCount, 0);
+    for (uint32_t i = oldCount; i < mSampleCount; i++)
+    {
+        if (samples.isKeyFrame(i))
+            mKeyFrameBits[i / 64] |= 1ull << (i % 64);
+    }
+
+    // types of appended samples come from the table only, they are set once
+    for (auto &bits : mFrameTypeBits)
+    {
+        if (!bits.empty())
+            bits.resize(wordCount, 0);
+    }
+    for (uint32_t i = oldCount; i < mSampleCount; i++)
+    {
+        uint32_t type = (uint32_t)samples.frameType(i);
+        if (type >= SAMPLE_FRAME_TYPE_COUNT)
+            continue;
+        auto &bits = mFrameTypeBits[type];
+        if (bits.empty())
+            bits.assign(wordCount, 0);
+        bits[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+void SampleIndex::updateFrameTypes(const std::function<H26X_FRAME_TYPE_E(uint32_t sampleIdx, bool &parsed)> &getFrameType,
+                                   bool final)
+{
+    if (mFrameTypesFinal)
+        return;
+
+    size_t wordCount = (mSampleCount + 63) / 64;
+    size_t kept      = 0;
+    for (auto word : mPendingTypeWords)
+    {
+        for (auto &bits : mFrameTypeBits)
+        {
+            if (!bits.empty())
+                bits[word] = 0;
+        }
+
+        bool     allParsed = true;
+        uint32_t end       = std::min<uint32_t>((word + 1) * 64, mSampleCount);
+        for (uint32_t i = word * 64; i < end; i++)
+        {
+            bool     parsed = false;
+            uint32_t type   = (uint32_t)getFrameType(i, parsed);
+            allParsed       = allParsed && parsed;
+            if (type >= SAMPLE_FRAME_TYPE_COUNT)
+                continue;
+            auto &bits = mFrameTypeBits[type];
+            if (bits.empty())
+                bits.assign(wordCount, 0);
+            bits[i / 64] |= 1ull << (i % 64);
+        }
+        if (!allParsed)
+            mPendingTypeWords[kept++] = word;
+    }
+    mPendingTypeWords.resize(kept);
+    mFrameTypesFinal = final;
+}
+
+int SampleIndex::query(const SampleTable &samples, const SampleFilter &filter, SampleQueryResult &result) const
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    result            = SampleQueryResult();
+    result.totalCount = mSampleCount;
+    if (!isBuiltFor(samples))
+        return -1;
+    result.bits.assign((mSampleCount + 63) / 64, 0);
+
+    // samples in [dtsBegin, dtsEnd), dts only grows with the sample index
+    uint32_t dtsBegin = 0;
+    uint32_t dtsEnd   = mSampleCount;
+    if (filter.useDts)
+    {
+        uint32_t lo = 0, hi = mSampleCount;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (samples.dtsMs(mid) < filter.minDtsMs)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        dtsBegin = lo;
+        hi       = mSampleCount;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (samples.dtsMs(mid) <= filter.maxDtsMs)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        dtsEnd = lo;
+    }
+
+    // slices of the sorted indices the size and pts ranges cover
+    auto sizeBegin = mBySize.begin(), sizeEnd = mBySize.end();
+    if (filter.useSize)
+    {
+        sizeBegin = std::lower_bound(mBySize.begin(), mBySize.end(), filter.minSize,
+                                     [&samples](uint32_t idx, uint32_t size) { return samples.sampleSize(idx) < size; });
+        sizeEnd   = std::upper_bound(sizeBegin, mBySize.end(), filter.maxSize,
+                                     [&samples](uint32_t size, uint32_t idx) { return size < samples.sampleSize(idx); });
+    }
+    auto ptsBegin = mByPts.begin(), ptsEnd = mByPts.end();
+    if (filter.usePts)
+    {
+        ptsBegin = std::lower_bound(mByPts.begin(), mByPts.end(), filter.minPtsMs,
+                                    [&samples](uint32_t idx, uint64_t pts) { return samples.ptsMs(idx) < pts; });
+        ptsEnd   = std::upper_bound(ptsBegin, mByPts.end(), filter.maxPtsMs,
+                                    [&samples](uint64_t pts, uint32_t idx) { return pts < samples.ptsMs(idx); });
+    }
+
+    // key flag and frame types, 64 samples a time
+    vector<const vector<uint64_t> *> typeBits;
+    for (uint32_t type = 0; type < SAMPLE_FRAME_TYPE_COUNT && 0 != filter.frameTypes; type++)
+    {
+        if (0 != (filter.frameTypes & (1u << type)) && type < mFrameTypeBits.size() && !mFrameTypeBits[type].empty())
+            typeBits.push_back(&mFrameTypeBits[type]);
+    }
+    auto wordMask = [&](size_t word) -> uint64_t
+    {
+        uint64_t mask = ~0ull;
+        if (filter.keyFrame >= 0)
+            mask &= filter.keyFrame > 0 ? mKeyFrameBits[word] : ~mKeyFrameBits[word];
+        if (0 != filter.frameTypes)
+        {
+            uint64_t types = 0;
+            for (auto bits : typeBits)
+                types |= (*bits)[word];
+            mask &= types;
+        }
+        return mask;
+    };
+    auto matchColumns = [&](uint32_t idx) -> bool
+    {
+        if (filter.useSize && (samples.sampleSize(idx) < filter.minSize || samples.sampleSize(idx) > filter.maxSize))
+            return false;
+        if (filter.usePts && (samples.ptsMs(idx) < filter.minPtsMs || samples.ptsMs(idx) > filter.maxPtsMs))
+            return false;
+        if (filter.useDts && (idx < dtsBegin || idx >= dtsEnd))
+            return false;
+        if (filter.descriptionIndex >= 0 && (int)samples.descriptionIndex(idx) != filter.descriptionIndex)
+            return false;
+        return true;
+    };
+
+    size_t dtsCount  = dtsEnd - dtsBegin;
+    size_t sizeCount = sizeEnd - sizeBegin;
+    size_t ptsCount  = ptsEnd - ptsBegin;
+    if (sizeCount < dtsCount && sizeCount <= ptsCount)
+    {
+        for (auto it = sizeBegin; it != sizeEnd; ++it)
+        {
+            if (0 != (wordMask(*it / 64) & (1ull << (*it % 64))) && matchColumns(*it))
+                result.bits[*it / 64] |= 1ull << (*it % 64);
+        }
+    }
+    else if (ptsCount < dtsCount)
+    {
+        for (auto it = ptsBegin; it != ptsEnd; ++it)
+        {
+            if (0 != (wordMask(*it / 64) & (1ull << (*it % 64))) && matchColumns(*it))
+                result.bits[*it / 64] |= 1ull << (*it % 64);
+        }
+    }
+    else
+    {
+        // a contiguous range, bitmaps drop whole words before any column is read
+        for (size_t word = dtsBegin / 64; word * 64 < dtsEnd; word++)
+        {
+            uint64_t mask = wordMask(word);
+            if (word == dtsBegin / 64)
+                mask &= ~0ull << (dtsBegin % 64);
+            if ((word + 1) * 64 > dtsEnd)
+                mask &= (1ull << (dtsEnd % 64)) - 1;
+            while (0 != mask)
+            {
+                uint32_t idx = (uint32_t)(word * 64 + countTrailingZeros64(mask));
+                mask &= mask - 1;
+                if (matchColumns(idx))
+                    result.bits[word] |= 1ull << (idx % 64);
+            }
+        }
+    }
+
+    for (size_t word = 0; word < result.bits.size(); word++)
+    {
+        uint64_t mask = result.bits[word];
+        while (0 != mask)
+        {
+            result.samples.push_back((uint32_t)(word * 64 + countTrailingZeros64(mask)));
+            mask &= mask - 1;
+        }
+    }
+
+    result.costMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef _SAMPLE_QUERY_H_
+#define _SAMPLE_QUERY_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Mp4Parse.h"
+#include "SampleTable.h"
+
+// predicates of a sample query, every one in use must match
+struct SampleFilter
+{
+    bool     useSize          = false;
+    uint32_t minSize          = 0;
+    uint32_t maxSize          = UINT32_MAX;
+    bool     usePts           = false;
+    uint64_t minPtsMs         = 0;
+    uint64_t maxPtsMs         = UINT64_MAX;
+    bool     useDts           = false;
+    uint64_t minDtsMs         = 0;
+    uint64_t maxDtsMs         = UINT64_MAX;
+    int      keyFrame         = -1; // -1: any, 0: not key frames, 1: key frames
+    uint32_t frameTypes       = 0;  // bit (1 << H26X_FRAME_TYPE_E) set for every type wanted, 0: any
+    int      descriptionIndex = -1; // -1: any
+
+    bool isEmpty() const;
+};
+
+struct SampleQueryResult
+{
+    std::vector<uint32_t> samples; // in sample order
+    std::vector<uint64_t> bits;    // bit per sample of the track, for highlighting
+    uint32_t              totalCount = 0;
+    double                costMs     = 0;
+
+    bool contains(uint32_t sampleIdx) const
+    {
+        return sampleIdx / 64 < bits.size() && 0 != (bits[sampleIdx / 64] & (1ull << (sampleIdx % 64)));
+    }
+};
+
+// indices over one SampleTable: samples sorted by size and by pts, bitmaps of key frames and frame types.
+// dts grows with the sample index, a dts range is found by binary search in the table itself.
+// a query starts from the predicate with the fewest candidates, the others are checked with bitmaps or columns
+class SampleIndex
+{
+public:
+    SampleIndex() {}
+
+    void build(const SampleTable &samples); // sorts, run it in a worker thread
+    void extend(const SampleTable &samples); // samples appended since build(), sorts only them and merges
+    bool isBuiltFor(const SampleTable &samples) const { return mSampleCount == samples.size(); }
+
+    // frame types come later than the sample table, final: the frame type pass is done, no need to update again.
+    // only the 64 sample words still having samples of unparsed types are read again
+    bool needFrameTypes() const { return !mFrameTypesFinal; }
+    void updateFrameTypes(const std::function<H26X_FRAME_TYPE_E(uint32_t sampleIdx, bool &parsed)> &getFrameType, bool final);
+
+    int query(const SampleTable &samples, const SampleFilter &filter, SampleQueryResult &result) const;
+
+private:
+    uint32_t mSampleCount = 0;
+
+    std::vector<uint32_t>              mBySize; // sample indices
+    std::vector<uint32_t>              mByPts;
+    std::vector<uint64_t>              mKeyFrameBits;
+    std::vector<std::vector<uint64_t>> mFrameTypeBits; // by H26X_FRAME_TYPE_E
+    std::vector<uint32_t>              mPendingTypeWords; // words of mFrameTypeBits not all parsed yet, ascending
+    bool                               mFrameTypesFinal = false;
+};
+
+#endif
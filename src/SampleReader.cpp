@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstring>
+
+#include "logger.h"
+
+#include "SampleReader.h"
+#include "Trace.h"
+
+#define PREFETCH_SIZE      (4 * 1024 * 1024)  // chunks are added to a read ahead until it reaches this
+#define PREFETCH_MAX_SIZE  (16 * 1024 * 1024) // one huge chunk is cut here
+#define SEQUENTIAL_READS   (2)                // direct reads in file order before reading ahead
+#define MAX_SEQUENTIAL_GAP (1024 * 1024)      // chunks of other tracks between two samples of this one
+
+using std::string;
+
+static int readAt(std::ifstream &file, uint64_t offset, uint64_t size, uint8_t *buffer)
+{
+    file.clear();
+    file.seekg((std::streamoff)offset);
+    if (!file.read((char *)buffer, (std::streamsize)size))
+        return -1;
+    return 0;
+}
+
+int SampleReader::open(const string &filePath)
+{
+    close();
+
+    std::lock_guard<std::mutex> locker(mLock);
+    mFile.open(filePath, std::ios::binary);
+    mPrefetchFile.open(filePath, std::ios::binary);
+    if (!mFile.is_open() || !mPrefetchFile.is_open())
+    {
+        Z_ERR("open {} fail\n", filePath);
+        mFile.close();
+        mPrefetchFile.close();
+        return -1;
+    }
+    return 0;
+}
+
+void SampleReader::close()
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    if (mPrefetchHits + mDirectReads > 0)
+        Z_INFO("sample reads: {} from read ahead, {} direct\n", mPrefetchHits, mDirectReads);
+
+    // futures of std::async wait for the read in their destructor
+    mTracks.clear();
+    mPrefetchHits = 0;
+    mDirectReads  = 0;
+    if (mFile.is_open())
+        mFile.close();
+    if (mPrefetchFile.is_open())
+        mPrefetchFile.close();
+}
+
+void SampleReader::setTrackChunks(uint32_t trackIdx, const std::vector<Mp4ChunkItem> *chunks)
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    mTracks[trackIdx].chunks = chunks;
+}
+
+bool SampleReader::isSameAsParser(Mp4Parser &parser, uint32_t trackIdx, uint32_t sampleIdx, uint64_t offset, uint32_t size)
+{
+    Mp4RawSample sample;
+    if (parser.getSample(trackIdx, sampleIdx, sample) < 0 || !sample.sampleData || sample.dataSize != size)
+        return false;
+
+    auto buffer = std::make_unique<uint8_t[]>(size);
+    if (read(trackIdx, sampleIdx, offset, size, buffer.get()) < 0)
+        return false;
+    return 0 == memcmp(buffer.get(), sample.sampleData.get(), size);
+}
+
+uint64_t SampleReader::getPrefetchEnd(const TrackState &track, uint32_t sampleIdx, uint64_t start) const
+{
+    if (!track.chunks || track.chunks->empty())
+        return start + PREFETCH_SIZE;
+
+    // chunk of the sample, then the first one not behind start
+    auto &chunks = *track.chunks;
+    auto  chunk  = std::upper_bound(chunks.begin(), chunks.end(), sampleIdx,
+                                    [](uint32_t idx, const Mp4ChunkItem &item) { return idx < item.sampleStartIdx; });
+    if (chunk != chunks.begin())
+        chunk--;
+    while (chunk != chunks.end() && chunk->chunkOffset + chunk->chunkSize <= start)
+        chunk++;
+
+    uint64_t end = start;
+    for (; chunk != chunks.end(); chunk++)
+    {
+        uint64_t chunkEnd = chunk->chunkOffset + chunk->chunkSize;
+        // the track goes backwards in the file, or the read is big enough
+        if (end > start && (chunk->chunkOffset < end || chunkEnd - start > PREFETCH_SIZE))
+            break;
+        end = std::max(end, chunkEnd);
+    }
+    if (end <= start)
+        end = start + PREFETCH_SIZE;
+    return std::min<uint64_t>(end, start + PREFETCH_MAX_SIZE);
+}
+
+void SampleReader::startPrefetch(TrackState &track, uint32_t sampleIdx, uint64_t start)
+{
+    Window window;
+    window.start = start;
+    window.size  = getPrefetchEnd(track, sampleIdx, start) - start;
+    window.data.reset(new uint8_t[window.size]); // no zero fill, the read overwrites it
+
+    uint8_t *data  = window.data.get();
+    uint64_t size  = window.size;
+    window.pending = std::async(std::launch::async,
+                                [this, start, size, data]()
+                                {
+                                    TRACE_SCOPE("sample_read_ahead");
+                                    std::lock_guard<std::mutex> locker(mPrefetchFileLock);
+                                    return readAt(mPrefetchFile, start, size, data);
+                                });
+    track.windows.push_back(std::move(window));
+}
+
+int SampleReader::read(uint32_t trackIdx, uint32_t sampleIdx, uint64_t offset, uint32_t size, uint8_t *buffer)
+{
+    std::lock_guard<std::mutex> locker(mLock);
+    if (!mFile.is_open())
+        return -1;
+
+    auto    &track = mTracks[trackIdx];
+    uint64_t end   = offset + size;
+    for (size_t i = 0; i < track.windows.size(); i++)
+    {
+        auto &window = track.windows[i];
+        if (offset < window.start || end > window.start + window.size)
+            continue;
+        if (window.pending.valid())
+        {
+            TRACE_SCOPE("wait_read_ahead");
+            window.result = window.pending.get();
+        }
+        if (window.result < 0) // past the file end, or an io error
+        {
+            track.windows.erase(track.windows.begin() + i);
+            break;
+        }
+
+        memcpy(buffer, window.data.get() + (offset - window.start), size);
+        mPrefetchHits++;
+        track.hasLastRead = true;
+        track.lastReadEnd = end;
+
+        // the windows before are passed, half way through the last one the next starts reading
+        track.windows.erase(track.windows.begin(), track.windows.begin() + i);
+        auto &current = track.windows.front();
+        if (1 == track.windows.size() && end - current.start > current.size / 2)
+            startPrefetch(track, sampleIdx, current.start + current.size);
+        return 0;
+    }
+
+    bool sequential = track.hasLastRead && offset >= track.lastReadEnd && offset - track.lastReadEnd <= MAX_SEQUENTIAL_GAP;
+    track.sequentialReads = sequential ? track.sequentialReads + 1 : 0;
+    track.hasLastRead     = true;
+    track.lastReadEnd     = end;
+
+    mDirectReads++;
+    if (readAt(mFile, offset, size, buffer) < 0)
+    {
+        Z_ERR("read {} bytes at {} fail\n", size, offset);
+        return -1;
+    }
+
+    track.windows.erase(std::remove_if(track.windows.begin(), track.windows.end(),
+                                       [end](const Window &window) { return window.start + window.size <= end; }),
+                        track.windows.end());
+    if (track.sequentialReads >= SEQUENTIAL_READS && track.windows.empty())
+        startPrefetch(track, sampleIdx, end);
+    return 0;
+}
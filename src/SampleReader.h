@@ -0,0 +1,70 @@
+#ifndef _SAMPLE_READER_H_
+#define _SAMPLE_READER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Mp4Parse.h"
+
+// read sample bytes straight from the file, by the offsets the parser gives.
+// when a track is read in file order the next chunks of it are read ahead in one large read on a background thread,
+// so the following samples come from memory instead of a seek and a small read each(cold HDD, network mounts)
+class SampleReader
+{
+public:
+    SampleReader() {}
+    ~SampleReader() { close(); }
+
+    int  open(const std::string &filePath);
+    void close();
+    bool isOpen() const { return mFile.is_open(); }
+    // chunks must stay alive until close(), they decide where a read ahead ends
+    void setTrackChunks(uint32_t trackIdx, const std::vector<Mp4ChunkItem> *chunks);
+
+    // sampleIdx locates the chunk, offset and size are the sample's
+    int  read(uint32_t trackIdx, uint32_t sampleIdx, uint64_t offset, uint32_t size, uint8_t *buffer);
+    // checked once before a track is read here instead of by the parser
+    bool isSameAsParser(Mp4Parser &parser, uint32_t trackIdx, uint32_t sampleIdx, uint64_t offset, uint32_t size);
+
+    uint64_t getPrefetchHits() const { return mPrefetchHits; }
+    uint64_t getDirectReads() const { return mDirectReads; }
+
+private:
+    struct Window
+    {
+        uint64_t                   start = 0;
+        uint64_t                   size  = 0;
+        std::unique_ptr<uint8_t[]> data;
+        std::future<int>           pending; // valid until the read is waited for
+        int                        result = 0;
+    };
+    struct TrackState
+    {
+        const std::vector<Mp4ChunkItem> *chunks          = nullptr;
+        bool                             hasLastRead     = false;
+        uint64_t                         lastReadEnd     = 0;
+        int                              sequentialReads = 0;
+        std::vector<Window>              windows; // in file order, the last one may still be reading
+    };
+
+    void     startPrefetch(TrackState &track, uint32_t sampleIdx, uint64_t start);
+    uint64_t getPrefetchEnd(const TrackState &track, uint32_t sampleIdx, uint64_t start) const;
+
+private:
+    std::mutex                     mLock;
+    std::ifstream                  mFile;
+    std::mutex                     mPrefetchFileLock;
+    std::ifstream                  mPrefetchFile; // only used by the background reads
+    std::map<uint32_t, TrackState> mTracks;
+
+    uint64_t mPrefetchHits = 0;
+    uint64_t mDirectReads  = 0;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <iterator>
+
+#include "SampleTable.h"
+
+using std::vector;
+
+void SampleTable::clear()
+{
+    mOffsets.clear();
+    mSizes.clear();
+    mDtsMs.clear();
+    mCtsMs.clear();
+    mDtsDeltaMs.clear();
+    mDescIdx.clear();
+    mFlags.clear();
+    mChunks.clear();
+    mParsedSize = 0;
+}
+
+void SampleTable::pushSample(const Mp4SampleItem &sample)
+{
+    mOffsets.push_back(sample.sampleOffset);
+    mSizes.push_back((uint32_t)sample.sampleSize);
+    mDtsMs.push_back(sample.dtsMs);
+    mCtsMs.push_back((int32_t)((int64_t)sample.ptsMs - (int64_t)sample.dtsMs));
+    mDtsDeltaMs.push_back((uint32_t)sample.dtsDeltaMs);
+    mDescIdx.push_back((uint16_t)sample.sampleDescriptionIndex);
+    mFlags.push_back((uint8_t)(((uint8_t)sample.frameType & FLAG_FRAME_TYPE_MASK) | (sample.isKeyFrame ? FLAG_KEY_FRAME : 0)));
+}
+
+void SampleTable::build(const Mp4MediaInfo &mediaInfo)
+{
+    clear();
+
+    auto &samples = mediaInfo.samplesInfo;
+    mOffsets.reserve(samples.size());
+    mSizes.reserve(samples.size());
+    mDtsMs.reserve(samples.size());
+    mCtsMs.reserve(samples.size());
+    mDtsDeltaMs.reserve(samples.size());
+    mDescIdx.reserve(samples.size());
+    mFlags.reserve(samples.size());
+
+    for (auto &sample : samples)
+        pushSample(sample);
+
+    mChunks     = mediaInfo.chunksInfo;
+    mParsedSize = size();
+}
+
+void SampleTable::append(const vector<Mp4SampleItem> &samples, vector<Mp4ChunkItem> &&chunks)
+{
+    for (auto &sample : samples)
+        pushSample(sample);
+    std::move(chunks.begin(), chunks.end(), std::back_inserter(mChunks));
+}
+
+Mp4SampleItem SampleTable::getSample(uint32_t idx) const
+{
+    Mp4SampleItem sample{};
+    sample.sampleIdx              = idx;
+    sample.sampleOffset           = sampleOffset(idx);
+    sample.sampleSize             = sampleSize(idx);
+    sample.ptsMs                  = ptsMs(idx);
+    sample.dtsMs                  = dtsMs(idx);
+    sample.dtsDeltaMs             = dtsDeltaMs(idx);
+    sample.sampleDescriptionIndex = descriptionIndex(idx);
+    sample.isKeyFrame             = isKeyFrame(idx);
+    sample.frameType              = frameType(idx);
+    return sample;
+}
+
+uint32_t SampleTable::getMaxSampleSize() const
+{
+    if (mSizes.empty())
+        return 0;
+    return *std::max_element(mSizes.begin(), mSizes.end());
+}
+
+uint32_t SampleTable::findKeyFrame(uint32_t idx) const
+{
+    if (mFlags.empty())
+        return 0;
+    idx = std::min<uint32_t>(idx, size() - 1);
+    for (; idx > 0; idx--)
+    {
+        if (mFlags[idx] & FLAG_KEY_FRAME)
+            break;
+    }
+    return idx;
+}
@@ -0,0 +1,65 @@
+#ifndef _SAMPLE_TABLE_H_
+#define _SAMPLE_TABLE_H_
+
+#include <vector>
+
+#include "Mp4Parse.h"
+
+// samples of one track stored by column, so a scan over one field(size, pts, key flag) reads only that array.
+// pts is kept as a 32 bits offset to dts, key flag and frame type share one byte.
+// chunks are few, they stay as rows
+class SampleTable
+{
+public:
+    SampleTable() {}
+
+    void build(const Mp4MediaInfo &mediaInfo);
+    void append(const std::vector<Mp4SampleItem> &samples, std::vector<Mp4ChunkItem> &&chunks);
+    void clear();
+
+    uint32_t size() const { return (uint32_t)mSizes.size(); }
+    bool     empty() const { return mSizes.empty(); }
+    // samples from build(), the parser knows them. appended ones come after
+    uint32_t parsedSize() const { return mParsedSize; }
+
+    uint64_t          sampleOffset(uint32_t idx) const { return mOffsets[idx]; }
+    uint32_t          sampleSize(uint32_t idx) const { return mSizes[idx]; }
+    uint64_t          dtsMs(uint32_t idx) const { return mDtsMs[idx]; }
+    uint64_t          ptsMs(uint32_t idx) const { return (uint64_t)((int64_t)mDtsMs[idx] + mCtsMs[idx]); }
+    uint32_t          dtsDeltaMs(uint32_t idx) const { return mDtsDeltaMs[idx]; }
+    uint32_t          descriptionIndex(uint32_t idx) const { return mDescIdx[idx]; }
+    bool              isKeyFrame(uint32_t idx) const { return 0 != (mFlags[idx] & FLAG_KEY_FRAME); }
+    H26X_FRAME_TYPE_E frameType(uint32_t idx) const { return (H26X_FRAME_TYPE_E)(mFlags[idx] & FLAG_FRAME_TYPE_MASK); }
+
+    // one row for the table callbacks, naluTypes are not kept here
+    Mp4SampleItem getSample(uint32_t idx) const;
+    uint32_t      getMaxSampleSize() const;
+    // last key frame at or before idx, 0 if none
+    uint32_t findKeyFrame(uint32_t idx) const;
+
+    const std::vector<uint32_t>     &getSizes() const { return mSizes; }
+    const std::vector<Mp4ChunkItem> &getChunks() const { return mChunks; }
+
+private:
+    enum
+    {
+        FLAG_FRAME_TYPE_MASK = 0x0F,
+        FLAG_KEY_FRAME       = 0x80,
+    };
+
+    void pushSample(const Mp4SampleItem &sample);
+
+private:
+    std::vector<uint64_t> mOffsets;
+    std::vector<uint32_t> mSizes;
+    std::vector<uint64_t> mDtsMs;
+    std::vector<int32_t>  mCtsMs; // pts - dts
+    std::vector<uint32_t> mDtsDeltaMs;
+    std::vector<uint16_t> mDescIdx;
+    std::vector<uint8_t>  mFlags;
+
+    std::vector<Mp4ChunkItem> mChunks;
+    uint32_t                  mParsedSize = 0;
+};
+
+#endif
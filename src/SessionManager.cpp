@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "logger.h"
+
+#include "SessionManager.h"
+
+using std::shared_ptr;
+using std::string;
+
+static uint64_t nowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void SessionScheduler::setMaxThreads(int count)
+{
+    if (count <= 0)
+        count = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    std::lock_guard<std::mutex> locker(mLock);
+    if (mMaxThreads == count)
+        return;
+    mMaxThreads = count;
+    mCondition.notify_all();
+}
+
+int SessionScheduler::acquireThreads(int wanted, const volatile bool *isContinue, int reserved)
+{
+    wanted = std::max(wanted, 1);
+
+    std::unique_lock<std::mutex> locker(mLock);
+    auto getFreeThreads = [&]() { return mMaxThreads - mUsedThreads - std::min(std::max(reserved, 0), mMaxThreads - 1); };
+    // woken up now and then to see if the session is stopped
+    while (getFreeThreads() <= 0)
+    {
+        if (isContinue && !*isContinue)
+            return 0;
+        mCondition.wait_for(locker, std::chrono::milliseconds(50));
+    }
+    if (isContinue && !*isContinue)
+        return 0;
+
+    int count = std::min(wanted, getFreeThreads());
+    mUsedThreads += count;
+    return count;
+}
+
+void SessionScheduler::releaseThreads(int count)
+{
+    if (count <= 0)
+        return;
+
+    std::lock_guard<std::mutex> locker(mLock);
+    mUsedThreads = std::max(mUsedThreads - count, 0);
+    mCondition.notify_all();
+}
+
+SessionManager::SessionManager()
+{
+    mScheduler.setMaxThreads(0);
+    activate(create());
+}
+
+int SessionManager::create()
+{
+    Session session;
+    session.id   = mNextId++;
+    session.data = std::make_shared<Mp4ParseData>();
+    mSessions.push_back(session);
+    if (onCreate)
+        onCreate(session.id);
+    return session.id;
+}
+
+int SessionManager::find(const string &filePath) const
+{
+    for (auto &session : mSessions)
+    {
+        if (session.data->toParseFilePath == filePath || session.data->curFilePath == filePath)
+            return session.id;
+    }
+    return -1;
+}
+
+bool SessionManager::activate(int id)
+{
+    for (auto &session : mSessions)
+    {
+        if (session.id != id)
+            continue;
+        session.lastActiveMs = nowMs();
+        mActive              = session.data;
+        mActiveId            = id;
+        return true;
+    }
+    return false;
+}
+
+void SessionManager::close(int id)
+{
+    auto session = std::find_if(mSessions.begin(), mSessions.end(), [id](const Session &item) { return item.id == id; });
+    if (session == mSessions.end())
+        return;
+
+    session->data->clear();
+    mSessions.erase(session);
+    if (id != mActiveId)
+        return;
+
+    // the one used last takes over
+    auto next = std::max_element(mSessions.begin(), mSessions.end(), [](const Session &a, const Session &b)
+                                 { return a.lastActiveMs < b.lastActiveMs; });
+    activate(next != mSessions.end() ? next->id : create());
+}
+
+void SessionManager::clearAll()
+{
+    for (auto &session : mSessions)
+        session.data->clear();
+}
+
+bool SessionManager::isEmpty(int id) const
+{
+    auto data = get(id);
+    return !data || data->toParseFilePath.empty();
+}
+
+shared_ptr<Mp4ParseData> SessionManager::get(int id) const
+{
+    for (auto &session : mSessions)
+    {
+        if (session.id == id)
+            return session.data;
+    }
+    return nullptr;
+}
+
+uint64_t SessionManager::trimFrameCaches(uint64_t maxBytes)
+{
+    uint64_t totalBytes = 0;
+    for (auto &session : mSessions)
+        totalBytes += session.data->getFrameCacheBytes();
+    if (totalBytes <= maxBytes)
+        return 0;
+
+    std::vector<const Session *> inactive;
+    for (auto &session : mSessions)
+    {
+        if (session.id != mActiveId)
+            inactive.push_back(&session);
+    }
+    std::sort(inactive.begin(), inactive.end(),
+              [](const Session *a, const Session *b) { return a->lastActiveMs < b->lastActiveMs; });
+
+    uint64_t droppedBytes = 0;
+    for (auto session : inactive)
+    {
+        if (totalBytes - droppedBytes <= maxBytes)
+            break;
+        droppedBytes += session->data->dropFrameCache();
+    }
+    if (droppedBytes > 0)
+        Z_INFO("drop {} bytes of frame caches, {} bytes cached in {} sessions\n", droppedBytes, totalBytes - droppedBytes,
+               mSessions.size());
+    return droppedBytes;
+}
+
+SessionManager &getSessionManager()
+{
+    static SessionManager manager;
+    return manager;
+}
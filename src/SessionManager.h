@@ -0,0 +1,80 @@
+#ifndef _SESSION_MANAGER_H_
+#define _SESSION_MANAGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Mp4ParseData.h"
+
+// threads all open files use together. parsing takes one, frame type extracting as many as it is given,
+// a session asking when every thread is taken waits for one to come back
+class SessionScheduler
+{
+public:
+    void setMaxThreads(int count); // <= 0: cpu cores
+    int  getMaxThreads() const { return mMaxThreads; }
+    int  getUsedThreads() const { return mUsedThreads; }
+
+    // at least one and at most wanted, 0 if isContinue turned false while waiting.
+    // reserved: threads left to others even if that means waiting, at most all but one
+    int  acquireThreads(int wanted, const volatile bool *isContinue, int reserved = 0);
+    void releaseThreads(int count);
+
+private:
+    std::mutex              mLock;
+    std::condition_variable mCondition;
+    std::atomic<int>        mMaxThreads{1};
+    std::atomic<int>        mUsedThreads{0};
+};
+
+// files open at the same time, every one with its own Mp4ParseData: parser, decoders, frame cache and worker thread.
+// getMp4DataShare() is the active session, switching only changes which one that is, nothing is parsed again.
+// there's always an active session, an empty one when no file is open. only used from the UI thread
+class SessionManager
+{
+public:
+    struct Session
+    {
+        int                           id = 0;
+        std::shared_ptr<Mp4ParseData> data;
+        uint64_t                      lastActiveMs = 0; // frame caches of the least recently used go first
+    };
+
+    SessionManager();
+
+    int  create();                                // an empty session, not activated, onCreate is called for it
+    int  find(const std::string &filePath) const; // utf8 path, -1 if the file is not open
+    bool activate(int id);
+    void close(int id); // another session becomes active if it's the active one
+    void clearAll();
+    bool isEmpty(int id) const; // no file opened in it yet
+
+    int                           getActiveId() const { return mActiveId; } // read from worker threads too
+    Mp4ParseData                 &getActive() { return *mActive; }
+    std::shared_ptr<Mp4ParseData> get(int id) const;
+    const std::vector<Session>   &getSessions() const { return mSessions; }
+    SessionScheduler             &getScheduler() { return mScheduler; }
+
+    // drop frame caches of inactive sessions, least recently used first, until all of them fit in maxBytes
+    uint64_t trimFrameCaches(uint64_t maxBytes);
+
+    // every session made after it's set, also the empty one close() makes when the last session is closed
+    std::function<void(int id)> onCreate;
+
+private:
+    std::vector<Session>          mSessions; // in open order
+    std::shared_ptr<Mp4ParseData> mActive;
+    std::atomic<int>              mActiveId{0};
+    int                           mNextId = 0;
+    SessionScheduler              mScheduler;
+};
+
+SessionManager &getSessionManager();
+
+#endif
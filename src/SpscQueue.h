@@ -0,0 +1,47 @@
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// ring buffer for one producer thread and one consumer thread, no locks.
+// head and tail only grow, each side writes its own and reads the other's
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+    static_assert(CAPACITY > 0 && 0 == (CAPACITY & (CAPACITY - 1)), "capacity must be a power of two");
+
+public:
+    // producer, false if full
+    bool push(T &&item)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) >= CAPACITY)
+            return false;
+        mItems[tail & (CAPACITY - 1)] = std::move(item);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer, false if empty
+    bool pop(T &item)
+    {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire))
+            return false;
+        item = std::move(mItems[head & (CAPACITY - 1)]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire); }
+
+private:
+    T mItems[CAPACITY];
+
+    alignas(64) std::atomic<size_t> mHead{0}; // written by the consumer
+    alignas(64) std::atomic<size_t> mTail{0}; // written by the producer
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <chrono>
+
+#include "Trace.h"
+
+#include "TableSorter.h"
+
+using std::vector;
+
+void TableSorter::setOrder(int column, bool descending)
+{
+    mColumn     = column;
+    mDescending = descending;
+
+    auto order = mOrders.find(column);
+    mCurrOrder = order != mOrders.end() ? order->second : nullptr;
+}
+
+void TableSorter::update(uint32_t rowCount)
+{
+    if (rowCount != mRowCount)
+    {
+        mRowCount = rowCount;
+        reset();
+    }
+
+    if (!mPending.valid() || std::future_status::ready != mPending.wait_for(std::chrono::seconds(0)))
+        return;
+
+    auto task = mPending.get();
+    // rows changed while sorting, it's sorted again with the new keys
+    if (task.generation != mGeneration)
+        return;
+    auto order           = std::make_shared<const vector<uint32_t>>(std::move(task.order));
+    mOrders[task.column] = order;
+    if (task.column == mColumn)
+        mCurrOrder = order;
+}
+
+bool TableSorter::needKeys() const
+{
+    return TABLE_SORT_NONE != mColumn && !mCurrOrder && !mPending.valid();
+}
+
+void TableSorter::startSort(vector<uint64_t> &&keys)
+{
+    if (mPending.valid())
+        return;
+
+    mPending = std::async(std::launch::async,
+                          [column = mColumn, generation = mGeneration, keys = std::move(keys)]()
+                          {
+                              TRACE_SCOPE("table_sort");
+                              SortTask task;
+                              task.column     = column;
+                              task.generation = generation;
+                              task.order.resize(keys.size());
+                              for (uint32_t i = 0; i < (uint32_t)keys.size(); i++)
+                                  task.order[i] = i;
+                              // equal keys stay in index order
+                              std::stable_sort(task.order.begin(), task.order.end(),
+                                               [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+                              return task;
+                          });
+}
+
+uint32_t TableSorter::getRow(uint32_t viewRow) const
+{
+    if (!mCurrOrder || viewRow >= mCurrOrder->size())
+        return viewRow;
+    auto &order = *mCurrOrder;
+    return mDescending ? order[order.size() - 1 - viewRow] : order[viewRow];
+}
+
+void TableSorter::reset()
+{
+    mGeneration++;
+    mOrders.clear();
+    mCurrOrder.reset();
+}
+
+void TableSorter::clear()
+{
+    // the future of std::async waits for the sort in its destructor
+    if (mPending.valid())
+        mPending.wait();
+    mPending = std::future<SortTask>();
+    mOrders.clear();
+    mCurrOrder.reset();
+    mColumn   = TABLE_SORT_NONE;
+    mRowCount = 0;
+}
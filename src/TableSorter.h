@@ -0,0 +1,50 @@
+#ifndef _TABLE_SORTER_H_
+#define _TABLE_SORTER_H_
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define TABLE_SORT_NONE (-1)
+
+// row order of a table sorted by one column. the caller copies the column out as keys, the sort runs in a std::async
+// task and the table keeps its old order until the permutation is ready. the order of every sorted column is kept,
+// sorting by it again or flipping the direction costs nothing, rows added or removed drop them all
+class TableSorter
+{
+public:
+    void setOrder(int column, bool descending); // TABLE_SORT_NONE: index order
+    int  getColumn() const { return mColumn; }
+
+    // poll the running sort and follow the row count of the table, once a frame
+    void update(uint32_t rowCount);
+    // the column has no order for this row count yet and no sort is running
+    bool needKeys() const;
+    void startSort(std::vector<uint64_t> &&keys); // keys of the column set, one per row
+    bool isSorting() const { return mPending.valid(); }
+
+    uint32_t getRow(uint32_t viewRow) const; // row of the unsorted table
+    void     reset();                        // rows changed, keep the column and sort again
+    void     clear();
+
+private:
+    struct SortTask
+    {
+        int                   column     = TABLE_SORT_NONE;
+        uint32_t              generation = 0;
+        std::vector<uint32_t> order;
+    };
+
+    int      mColumn     = TABLE_SORT_NONE;
+    bool     mDescending = false;
+    uint32_t mRowCount   = 0;
+    uint32_t mGeneration = 0; // changes with the rows, sorts of older rows are dropped
+
+    std::map<int /* column */, std::shared_ptr<const std::vector<uint32_t>>> mOrders; // ascending
+    std::shared_ptr<const std::vector<uint32_t>>                            mCurrOrder;
+    std::future<SortTask>                                                   mPending;
+};
+
+#endif
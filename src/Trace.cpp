@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "logger.h"
+
+#include "Trace.h"
+
+#define MAX_TRACE_SPANS (4 * 1024 * 1024) // about 100MB of json, later spans are dropped
+
+using std::string;
+using std::vector;
+
+namespace Trace
+{
+std::atomic<bool> gTraceEnabled{false};
+
+struct Span
+{
+    const char *name;
+    int64_t     startUs;
+    int64_t     durationUs;
+};
+
+struct ThreadBuffer
+{
+    uint32_t     tid = 0;
+    std::mutex   lock; // only contended while exporting
+    vector<Span> spans;
+};
+
+static std::mutex                            sBuffersLock;
+static vector<std::shared_ptr<ThreadBuffer>> sBuffers;
+static uint32_t                              sNextTid = 1;
+static std::atomic<uint64_t>                 sSpanCount{0};
+
+static const auto sTraceStart = std::chrono::steady_clock::now();
+
+int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sTraceStart).count();
+}
+
+static ThreadBuffer &getThreadBuffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer)
+    {
+        buffer = std::make_shared<ThreadBuffer>();
+
+        std::lock_guard<std::mutex> locker(sBuffersLock);
+        buffer->tid = sNextTid++;
+        sBuffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void setEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        std::lock_guard<std::mutex> locker(sBuffersLock);
+        // threads which are gone only held their spans for the last export
+        sBuffers.erase(std::remove_if(sBuffers.begin(), sBuffers.end(),
+                                      [](const std::shared_ptr<ThreadBuffer> &buffer) { return buffer.use_count() <= 1; }),
+                       sBuffers.end());
+        for (auto &buffer : sBuffers)
+        {
+            std::lock_guard<std::mutex> bufferLocker(buffer->lock);
+            buffer->spans.clear();
+        }
+        sSpanCount = 0;
+    }
+    gTraceEnabled = enabled;
+}
+
+void addSpan(const char *name, int64_t startUs, int64_t endUs)
+{
+    if (sSpanCount.fetch_add(1, std::memory_order_relaxed) >= MAX_TRACE_SPANS)
+        return;
+
+    auto                       &buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> locker(buffer.lock);
+    buffer.spans.push_back({name, startUs, endUs - startUs});
+}
+
+int exportChromeJson(const string &filePath)
+{
+    FILE *fp = fopen(filePath.c_str(), "w");
+    if (!fp)
+    {
+        Z_ERR("open {} fail\n", filePath);
+        return -1;
+    }
+
+    int spanCount = 0;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    {
+        std::lock_guard<std::mutex> locker(sBuffersLock);
+        for (auto &buffer : sBuffers)
+        {
+            std::lock_guard<std::mutex> bufferLocker(buffer->lock);
+            for (auto &span : buffer->spans)
+            {
+                fprintf(fp, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %lld, \"dur\": %lld}",
+                        spanCount > 0 ? "," : "", span.name, buffer->tid, (long long)span.startUs, (long long)span.durationUs);
+                spanCount++;
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    bool writeFail = ferror(fp);
+    fclose(fp);
+    if (writeFail)
+        return -1;
+
+    if (sSpanCount > MAX_TRACE_SPANS)
+        Z_INFO("trace full, {} spans dropped\n", sSpanCount - MAX_TRACE_SPANS);
+    return spanCount;
+}
+} // namespace Trace
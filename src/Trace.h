@@ -0,0 +1,52 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// scoped spans of the hot paths, exported as chrome trace json(chrome://tracing, ui.perfetto.dev).
+// disabled: a span is one relaxed load and a branch. enabled: every thread appends to its own buffer,
+// buffers outlive their threads so the frame type workers still show up in the export.
+// define MP4PARSER_NO_TRACE to compile the spans out
+namespace Trace
+{
+extern std::atomic<bool> gTraceEnabled;
+
+inline bool isEnabled()
+{
+    return gTraceEnabled.load(std::memory_order_relaxed);
+}
+void    setEnabled(bool enabled); // enabling drops what was recorded before
+int64_t nowUs();
+void    addSpan(const char *name, int64_t startUs, int64_t endUs); // name must be a string literal
+int     exportChromeJson(const std::string &filePath);             // return count of spans written, < 0 on error
+
+class ScopedSpan
+{
+public:
+    explicit ScopedSpan(const char *name) : mName(name), mStartUs(isEnabled() ? nowUs() : -1) {}
+    ~ScopedSpan()
+    {
+        if (mStartUs >= 0)
+            addSpan(mName, mStartUs, nowUs());
+    }
+    ScopedSpan(const ScopedSpan &)            = delete;
+    ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+private:
+    const char *mName;
+    int64_t     mStartUs;
+};
+} // namespace Trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b)       TRACE_CONCAT_INNER(a, b)
+
+#ifdef MP4PARSER_NO_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_SCOPE(name) Trace::ScopedSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 #include "Mp4ParseData.h"
 #include "AppConfigure.h"
 #include "timer.h"
+#include "Trace.h"
 #include "ImGuiApplication.h"
 
 #include "logger.h"
@@ -72,20 +73,20 @@ void VideoStreamInfo::updateCurrFrameInfo()
         mCurrentFrameInfo.reset();
         return;
     }
-    auto &samples = getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->samplesInfo;
+    auto &samples = getMp4DataShare().tracksSamples[mCurSelectTrack];
     auto &ptsList = getMp4DataShare().tracksFramePtsList[mCurSelectTrack];
     if (ptsList.empty())
     {
         mCurrentFrameInfo.reset();
         return;
     }
-    auto &sample                  = samples[ptsList[mCurSelectFrame[mCurSelectTrack]]];
-    mCurrentFrameInfo.frameIdx    = (uint32_t)sample.sampleIdx;
-    mCurrentFrameInfo.frameType   = mp4GetFrameTypeStr(sample.frameType);
-    mCurrentFrameInfo.frameOffset = sample.sampleOffset;
-    mCurrentFrameInfo.frameSize   = sample.sampleSize;
-    mCurrentFrameInfo.dtsMs       = sample.dtsMs;
-    mCurrentFrameInfo.ptsMs       = sample.ptsMs;
+    uint32_t sampleIdx            = ptsList[mCurSelectFrame[mCurSelectTrack]];
+    mCurrentFrameInfo.frameIdx    = sampleIdx;
+    mCurrentFrameInfo.frameType   = mp4GetFrameTypeStr(getMp4DataShare().getFrameType(mCurSelectTrack, sampleIdx));
+    mCurrentFrameInfo.frameOffset = samples.sampleOffset(sampleIdx);
+    mCurrentFrameInfo.frameSize   = samples.sampleSize(sampleIdx);
+    mCurrentFrameInfo.dtsMs       = samples.dtsMs(sampleIdx);
+    mCurrentFrameInfo.ptsMs       = samples.ptsMs(sampleIdx);
 }
 
 static std::vector<AVPixelFormat> supportFormats = {
@@ -133,17 +134,57 @@ ImGui::ImGuiImageFormat transFormat(AVPixelFormat format)
 }
 void VideoStreamInfo::updateFrameTexture()
 {
-    MyAVFrame frame;
-    auto     &ptsList = getMp4DataShare().tracksFramePtsList[mCurSelectTrack];
+    auto &ptsList = getMp4DataShare().tracksFramePtsList[mCurSelectTrack];
     if (ptsList.empty())
         return;
     uint32_t realFrameIdx = ptsList[mCurSelectFrame[mCurSelectTrack]];
     updateCurrFrameInfo();
 
-    if (getMp4DataShare().decodeFrameAt(mCurSelectTrack, realFrameIdx, frame, supportFormats) < 0)
+    auto ahead = mAheadFrames.find(realFrameIdx);
+    if (ahead != mAheadFrames.end())
+    {
+        showDecodedFrame(*ahead->second);
+        mAheadFrames.erase(ahead);
+        mShownRequestId  = DecodeWorker::getLastRequestId();
+        mDecodeRequestId = 0;
         return;
+    }
 
-    ImageData imageData;
+    // decoded in the worker, the last frame stays on screen until this one is ready
+    mDecodeRequestId = getMp4DataShare().requestFrame(mCurSelectTrack, realFrameIdx, supportFormats);
+}
+
+void VideoStreamInfo::takeDecodedFrames()
+{
+    // only the newest one is drawn, frames read ahead wait for playing to reach them
+    DecodedFrame decoded;
+    DecodedFrame newest;
+    while (getMp4DataShare().takeDecodedFrame(decoded))
+    {
+        if (decoded.requestId < mMinRequestId)
+            continue;
+        if (decoded.isAhead)
+        {
+            if (decoded.result >= 0 && decoded.frame && decoded.trackIdx == mCurSelectTrack
+                && std::find(mAheadWindow.begin(), mAheadWindow.end(), decoded.frameIdx) != mAheadWindow.end())
+                mAheadFrames[decoded.frameIdx] = std::move(decoded.frame);
+            continue;
+        }
+        newest = std::move(decoded);
+    }
+    if (0 == newest.requestId)
+        return;
+    if (newest.requestId >= mDecodeRequestId)
+        mDecodeRequestId = 0;
+    // a frame read ahead went on screen after it was asked for
+    if (newest.requestId <= mShownRequestId || newest.result < 0 || !newest.frame)
+        return;
+    showDecodedFrame(*newest.frame);
+}
+
+void VideoStreamInfo::showDecodedFrame(MyAVFrame &frame)
+{
+    ImageData  imageData;
     imageData.format = transFormat((AVPixelFormat)frame->format);
     if (imageData.format == ImGui::ImGuiImageFormat_None)
         return;
@@ -167,22 +208,72 @@ void VideoStreamInfo::updateFrameTexture()
     imageData.width  = frame->width;
     imageData.height = frame->height;
 
-    updateImageTexture(imageData, mFrameTexture);
+    {
+        TRACE_SCOPE("update_texture");
+        updateImageTexture(imageData, mFrameTexture);
+    }
 
     mImageDisplay.setTexture(mFrameTexture);
     mFrameDisplay.open();
 }
 
+void VideoStreamInfo::updatePlayAhead()
+{
+    auto                 &data = getMp4DataShare();
+    std::vector<uint32_t> window;
+    auto                  ptsList = data.tracksFramePtsList.find(mCurSelectTrack);
+    if (mIsPlaying && ptsList != data.tracksFramePtsList.end() && !ptsList->second.empty())
+    {
+        // enough frames to ride out the slowest frame decoded lately, playing takes one each interval meanwhile
+        uint32_t averageUs = 0, peakUs = 0;
+        data.getDecodeCost(averageUs, peakUs);
+        uint32_t intervalUs = std::max(mPlayIntervalMs, 1u) * 1000;
+        uint32_t maxDepth   = (uint32_t)std::clamp(getAppConfigure().playAheadFrames, 0, PLAY_AHEAD_MAX_FRAMES);
+        mPlayAheadDepth     = std::min(1 + (peakUs + intervalUs - 1) / intervalUs, maxDepth);
+
+        uint32_t curFrame = mCurSelectFrame[mCurSelectTrack];
+        if (getAppConfigure().onlyPlayIFrame)
+        {
+            auto &iFrames = data.tracksIFrameList[mCurSelectTrack];
+            for (auto it = std::upper_bound(iFrames.begin(), iFrames.end(), curFrame);
+                 it != iFrames.end() && window.size() < mPlayAheadDepth; ++it)
+                window.push_back(ptsList->second[*it]);
+        }
+        else
+        {
+            for (uint32_t i = curFrame + 1; i < ptsList->second.size() && window.size() < mPlayAheadDepth; i++)
+                window.push_back(ptsList->second[i]);
+        }
+    }
+    if (window == mAheadWindow)
+        return;
+
+    // frames played or out of the window
+    for (auto it = mAheadFrames.begin(); it != mAheadFrames.end();)
+    {
+        if (std::find(window.begin(), window.end(), it->first) == window.end())
+            it = mAheadFrames.erase(it);
+        else
+            ++it;
+    }
+    mAheadWindow = window;
+    data.setPlayAhead(mCurSelectTrack, std::move(window), supportFormats);
+}
+
 // #FF0000FF
-#define I_FRAME_COLOR  (bswap_32(0xFF0000FFu))
+#define I_FRAME_COLOR   (bswap_32(0xFF0000FFu))
 // #0032FFFF
-#define P_FRAME_COLOR  (bswap_32(0x0032FFFFu))
+#define P_FRAME_COLOR   (bswap_32(0x0032FFFFu))
 // #2BBE44FF
-#define B_FRAME_COLOR  (bswap_32(0x2BBE44FFu))
+#define B_FRAME_COLOR   (bswap_32(0x2BBE44FFu))
+// #808080FF
+#define UNPARSED_COLOR  (bswap_32(0x808080FFu))
 // #8065bFFF
-#define BORDER_COLOR   (bswap_32(0x8065bFFFu))
+#define BORDER_COLOR    (bswap_32(0x8065bFFFu))
 // #13082CFF
-#define SEL_LINE_COLOR (bswap_32(0x13082CFFu))
+#define SEL_LINE_COLOR  (bswap_32(0x13082CFFu))
+// #FFD700FF
+#define HIGHLIGHT_COLOR (bswap_32(0xFFD700FFu))
 #define SEL_LINE_WIDTH 4
 
 VideoStreamInfo::VideoStreamInfo()
@@ -235,41 +326,14 @@ int VideoStreamInfo::seekToFrame(uint32_t frameIdx, bool seekToIFrame)
     if (ptsList == getMp4DataShare().tracksFramePtsList.end() || frameIdx >= ptsList->second.size())
         return -1;
 
-    uint32_t keyFrameIdx = 0;
-    int      ret         = getMp4DataShare().seekToFrame(mCurSelectTrack, ptsList->second[frameIdx], keyFrameIdx);
-    if (ret < 0)
-        return ret;
+    // frames before a key frame all show before it, it's at the same index in both orders
     if (seekToIFrame)
-    {
-        if (Mp4ParseData::SeekToKeyFrame == ret || Mp4ParseData::ContinueDecodeToFrame == ret)
-        {
-            mSeekToFrame                     = keyFrameIdx;
-            mCurSelectFrame[mCurSelectTrack] = keyFrameIdx;
-        }
-        else if (Mp4ParseData::FrameInCache == ret)
-        {
-            mSeekToFrame                     = frameIdx;
-            mCurSelectFrame[mCurSelectTrack] = frameIdx;
-        }
-    }
-    else
-    {
-        mSeekToFrame = frameIdx;
-        if (Mp4ParseData::SeekToKeyFrame == ret)
-        {
-            mCurSelectFrame[mCurSelectTrack] = keyFrameIdx;
-        }
-        else if (Mp4ParseData::FrameInCache == ret)
-        {
-            mCurSelectFrame[mCurSelectTrack] = frameIdx;
-        }
-        else if (Mp4ParseData::ContinueDecodeToFrame == ret)
-        {
-            mCurSelectFrame[mCurSelectTrack]++;
-        }
-    }
+        frameIdx = getMp4DataShare().tracksSamples[mCurSelectTrack].findKeyFrame(ptsList->second[frameIdx]);
 
-    mIsSeeking = true;
+    // the decode worker goes from the key frame to it, the caller requests the frame
+    mSeekToFrame                     = frameIdx;
+    mCurSelectFrame[mCurSelectTrack] = frameIdx;
+    mIsSeeking                       = true;
     return 0;
 }
 
@@ -351,13 +415,15 @@ bool VideoStreamInfo::drawHistogram(bool updateScroll)
     ImGui::BeginChild("HistRender##Real", ImVec2(0, -scrollbar_size));
     mHistogramStartIdx = (uint32_t)mHistogramScrollPos;
     mHistogramEndIdx   = (uint32_t)MIN(mTotalVideoFrameCount - 1, mHistogramStartIdx + showCols - 1);
-    auto &samples      = getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->samplesInfo;
+    auto &sampleSizes  = getMp4DataShare().tracksSamples[mCurSelectTrack].getSizes();
+    auto  highlightIt  = mSampleHighlights.find(mCurSelectTrack);
+    auto  highlight    = highlightIt != mSampleHighlights.end() ? highlightIt->second.get() : nullptr;
 
     for (uint32_t frameIdx = mHistogramStartIdx; frameIdx <= mHistogramEndIdx; frameIdx++)
     {
         int               realFrameIdx = getMp4DataShare().tracksFramePtsList[mCurSelectTrack][frameIdx];
-        H26X_FRAME_TYPE_E frameType    = samples[realFrameIdx].frameType;
-        uint64_t          frameSize    = samples[realFrameIdx].sampleSize;
+        H26X_FRAME_TYPE_E frameType    = getMp4DataShare().getFrameType(mCurSelectTrack, realFrameIdx);
+        uint64_t          frameSize    = sampleSizes[realFrameIdx];
         ImVec2            colSize;
         if (getAppConfigure().logarithmicAxis)
             colSize = ImVec2(histColWidth, logf((float)frameSize) * histDrawHeightMax
@@ -372,22 +438,31 @@ bool VideoStreamInfo::drawHistogram(bool updateScroll)
         ImVec2 colInnerPos  = colPos + ImVec2(colBorderWidth, colBorderWidth);
 
         ImU32 colColor = 0;
-        switch (frameType)
+        if (!getMp4DataShare().isFrameTypeParsed(mCurSelectTrack, realFrameIdx))
+        {
+            colColor = UNPARSED_COLOR;
+        }
+        else
         {
-            case H26X_FRAME_I:
-                colColor = I_FRAME_COLOR;
-                break;
-            case H26X_FRAME_P:
-                colColor = P_FRAME_COLOR;
-                break;
-            default:
-            case H26X_FRAME_B:
-                colColor = B_FRAME_COLOR;
-                break;
-                break;
+            switch (frameType)
+            {
+                case H26X_FRAME_I:
+                    colColor = I_FRAME_COLOR;
+                    break;
+                case H26X_FRAME_P:
+                    colColor = P_FRAME_COLOR;
+                    break;
+                default:
+                case H26X_FRAME_B:
+                    colColor = B_FRAME_COLOR;
+                    break;
+                    break;
+            }
         }
         ImGui::GetWindowDrawList()->AddRectFilled(colPos, colPos + colSize, BORDER_COLOR);
         ImGui::GetWindowDrawList()->AddRectFilled(colInnerPos, colInnerPos + colInnerSize, colColor);
+        if (highlight && highlight->contains((uint32_t)realFrameIdx))
+            ImGui::GetWindowDrawList()->AddRect(colPos, colPos + colSize, HIGHLIGHT_COLOR, 0, 0, MAX(1, colBorderWidth));
         if (mCurSelectFrame[mCurSelectTrack] == frameIdx)
         {
             ImVec2 selLinePos  = ImVec2(colPos.x + (histColWidth - selectLineWidth) / 2, mHistogramPos.y);
@@ -707,22 +782,22 @@ bool VideoStreamInfo::show()
     bool playNextFrame = false;
     bool selectFrame   = false;
 
+    takeDecodedFrames();
     if (mIsSeeking)
     {
-        if (mCurSelectFrame[mCurSelectTrack] == mSeekToFrame)
+        if (0 == mDecodeRequestId)
         {
             mIsSeeking = false;
             SET_APPLICATION_STATUS("Seeking To Frame %d Done", mSeekToFrame + 1);
         }
         else
         {
-            mCurSelectFrame[mCurSelectTrack]++;
-            playNextFrame = true;
-            SET_APPLICATION_STATUS("Seeking To Frame %d...now at %d", mSeekToFrame + 1, mCurSelectFrame[mCurSelectTrack]);
+            SET_APPLICATION_STATUS("Seeking To Frame %d...", mSeekToFrame + 1);
         }
     }
 
-    if (mIsPlaying)
+    // the next frame is asked for when the last one is shown, playing never runs ahead of decoding
+    if (mIsPlaying && 0 == mDecodeRequestId)
     {
         uint64_t curTimeMs = gettime_ms();
         if (curTimeMs - mLastPlayTimeMs >= mPlayIntervalMs)
@@ -752,7 +827,7 @@ bool VideoStreamInfo::show()
             }
             else
             {
-                if (mCurSelectFrame[mCurSelectTrack] >= getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->sampleCount - 1)
+                if (mCurSelectFrame[mCurSelectTrack] >= getMp4DataShare().tracksSamples[mCurSelectTrack].size() - 1)
                 {
                     if (AppConfigures::RestartOnEnd == getAppConfigure().playStrategy)
                     {
@@ -801,7 +876,7 @@ bool VideoStreamInfo::show()
 
     if (mNextFrameButton.isClicked() || mNextFrameButton.isActiveFor(500))
     {
-        if (mCurSelectFrame[mCurSelectTrack] < getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->sampleCount - 1)
+        if (mCurSelectFrame[mCurSelectTrack] < getMp4DataShare().tracksSamples[mCurSelectTrack].size() - 1)
         {
             seekToFrame(mCurSelectFrame[mCurSelectTrack] + 1);
             selectFrame = true;
@@ -851,8 +926,11 @@ bool VideoStreamInfo::show()
         ImGui::EndChild();
     }
 
+    updateFrameTypePriority();
+
     if (selectFrame || playNextFrame || mSelectChanged)
         updateFrameTexture();
+    updatePlayAhead();
 
     bool frameChanged = mSelectChanged || selectFrame || playNextFrame;
     mSelectChanged    = false;
@@ -865,10 +943,52 @@ bool VideoStreamInfo::show()
     return frameChanged;
 }
 
+// let the frame type workers handle the visible columns and the frames around the current one first
+void VideoStreamInfo::updateFrameTypePriority()
+{
+    if (!getMp4DataShare().isRunning() || OPERATION_PARSE_FRAME_TYPE != getMp4DataShare().getCurrentOperation())
+        return;
+
+    auto &ptsList = getMp4DataShare().tracksFramePtsList[mCurSelectTrack];
+    if (ptsList.empty())
+        return;
+
+    auto getSampleRange = [&ptsList](uint32_t first, uint32_t last) -> std::pair<uint32_t, uint32_t>
+    {
+        uint32_t minIdx = UINT32_MAX;
+        uint32_t maxIdx = 0;
+        last            = MIN(last, (uint32_t)ptsList.size() - 1);
+        for (uint32_t i = first; i <= last; i++)
+        {
+            minIdx = MIN(minIdx, ptsList[i]);
+            maxIdx = MAX(maxIdx, ptsList[i]);
+        }
+        return {minIdx, maxIdx};
+    };
+
+    uint32_t curFrame = mCurSelectFrame[mCurSelectTrack];
+
+    FrameTypeExtractor::SampleRanges ranges;
+    ranges.push_back(getSampleRange(curFrame > PRIORITY_MARGIN ? curFrame - PRIORITY_MARGIN : 0, curFrame + PRIORITY_MARGIN));
+    if (getAppConfigure().showFrameInfo && mHistogramStartIdx <= mHistogramEndIdx)
+        ranges.push_back(getSampleRange(mHistogramStartIdx, mHistogramEndIdx));
+
+    getMp4DataShare().setFrameTypePriority(mCurSelectTrack, ranges);
+}
+
+void VideoStreamInfo::setSampleHighlight(unsigned int trackIdx, const std::shared_ptr<const SampleQueryResult> &result)
+{
+    if (result)
+        mSampleHighlights[trackIdx] = result;
+    else
+        mSampleHighlights.erase(trackIdx);
+}
+
 void VideoStreamInfo::resetData()
 {
     mCurSelectTrack = 0;
     mCurSelectFrame.clear();
+    mSampleHighlights.clear();
     if (!getMp4DataShare().videoTracksIdx.empty())
     {
         mCurSelectTrack = getMp4DataShare().videoTracksIdx[0];
@@ -880,6 +1000,15 @@ void VideoStreamInfo::resetData()
     updateData();
 }
 
+void VideoStreamInfo::samplesAppended()
+{
+    if (getMp4DataShare().videoTracksIdx.empty())
+        return;
+
+    mTotalVideoFrameCount = getMp4DataShare().tracksSamples[mCurSelectTrack].size();
+    mHistogramMaxSize     = getMp4DataShare().tracksMaxSampleSize[mCurSelectTrack];
+}
+
 void VideoStreamInfo::updateData()
 {
     freeTexture(mFrameTexture);
@@ -888,14 +1017,21 @@ void VideoStreamInfo::updateData()
     if (getMp4DataShare().videoTracksIdx.empty())
         return;
 
-    auto &samples = getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->samplesInfo;
-
-    mTotalVideoFrameCount = (uint32_t)samples.size();
+    mTotalVideoFrameCount = getMp4DataShare().tracksSamples[mCurSelectTrack].size();
 
     mHistogramMaxSize = getMp4DataShare().tracksMaxSampleSize[mCurSelectTrack];
 
     mIsPlaying = false;
 
+    // frames still queued for the file or track shown before are not taken
+    mMinRequestId    = DecodeWorker::getLastRequestId() + 1;
+    mDecodeRequestId = 0;
+    mAheadFrames.clear();
+    if (!mAheadWindow.empty())
+    {
+        mAheadWindow.clear();
+        getMp4DataShare().setPlayAhead(mCurSelectTrack, {}, supportFormats);
+    }
     updateFrameTexture();
 }
 
@@ -916,6 +1052,36 @@ void VideoStreamInfo::showFrameInfo()
     }
     ImGui::Text("Dts: %.2fs", mCurrentFrameInfo.dtsMs / 1000.f);
     ImGui::Text("Pts: %.2fs", mCurrentFrameInfo.ptsMs / 1000.f);
+    ImGui::Text("Frame Cache: %.1f MB", getMp4DataShare().getFrameCacheBytes() / (1024.0 * 1024.0));
+    if (ImGui::IsItemHovered())
+    {
+        BeginTooltip();
+        showFrameCacheStats();
+        EndTooltip();
+    }
+}
+
+// every cache encoding used so far by all files, bytes per microsecond are MB/s
+void VideoStreamInfo::showFrameCacheStats()
+{
+    ImGui::Text("Encoding: %s", FrameCompressor::getCodecName((FRAME_CACHE_CODEC_E)getAppConfigure().frameCacheCodec));
+    for (int codec = 0; codec < FRAME_CACHE_CODEC_COUNT; codec++)
+    {
+        auto    &stats         = FrameCompressor::getStats((FRAME_CACHE_CODEC_E)codec);
+        uint64_t encodedFrames = stats.encodedFrames;
+        uint64_t decodedFrames = stats.decodedFrames;
+        if (0 == encodedFrames && 0 == decodedFrames)
+            continue;
+        uint64_t storedBytes = stats.storedBytes;
+        uint64_t encodeUs    = stats.encodeUs;
+        uint64_t decodeUs    = stats.decodeUs;
+        ImGui::Separator();
+        ImGui::Text("%s", FrameCompressor::getCodecName((FRAME_CACHE_CODEC_E)codec));
+        ImGui::Text("  %llu frames cached, %.2fx smaller", (unsigned long long)encodedFrames,
+                    storedBytes ? (double)stats.rawBytes / storedBytes : 0.0);
+        ImGui::Text("  encode %.0f MB/s, decode %.0f MB/s(%llu frames)", encodeUs ? (double)stats.rawBytes / encodeUs : 0.0,
+                    decodeUs ? (double)stats.decodedBytes / decodeUs : 0.0, (unsigned long long)decodedFrames);
+    }
 }
 
 void VideoStreamInfo::updateFrameInfo(unsigned int trackIdx, uint32_t frameIdx, H26X_FRAME_TYPE_E frameType)
@@ -959,7 +1125,7 @@ void VideoStreamInfo::showFrameDisplay()
     mPrevFrameButton.showDisabled(mCurSelectFrame[mCurSelectTrack] <= 0);
     SameLine();
     mNextFrameButton.showDisabled(mCurSelectFrame[mCurSelectTrack]
-                                  >= getMp4DataShare().tracksInfo[mCurSelectTrack].mediaInfo->sampleCount - 1);
+                                  >= getMp4DataShare().tracksSamples[mCurSelectTrack].size() - 1);
     SameLine();
     mNextIFrameButton.showDisabled(mCurSelectFrame[mCurSelectTrack]
                                    >= getMp4DataShare().tracksIFrameList[mCurSelectTrack].back());
@@ -987,6 +1153,11 @@ void VideoStreamInfo::showFrameDisplay()
             mPlayIntervalMs                 = 1000 / getAppConfigure().playFrameRate;
         }
     }
+    if (mIsPlaying && mPlayAheadDepth > 0)
+    {
+        SameLine();
+        TextDisabled("%d/%u ahead", (int)mAheadFrames.size(), mPlayAheadDepth);
+    }
 
     SameLine();
     if (getAppConfigure().showFrameInfo)
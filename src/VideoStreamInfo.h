@@ -3,10 +3,13 @@
 
 #include <functional>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "ImGuiTools.h"
 #include "ImGuiWindow.h"
 #include "Mp4Types.h"
+#include "SampleQuery.h"
 #include "imgui.h"
 
 #define MAX_VIDEO_FRAMES  (180000)
@@ -20,6 +23,10 @@
 #define HIST_HEIGHT       (360)
 #define HIST_BORDER_WIDTH (5)
 
+#define PRIORITY_MARGIN (60) // frames around the selected one which get their frame type first
+
+class MyAVFrame;
+
 #define BUTTON_W (15)
 #define BUTTON_H (15)
 
@@ -45,23 +52,32 @@ public:
     virtual ~VideoStreamInfo();
     bool show();
     void resetData();
+    void samplesAppended(); // tail of a growing file indexed, keep position and texture
     void updateFrameTexture();
     void updateFrameInfo(unsigned int trackIdx, uint32_t frameIdx, H26X_FRAME_TYPE_E frameType);
     void setImageSampleType(ImGui::ImGuiImageSampleType sampleType);
+    // outline the samples a query matched, null to clear
+    void setSampleHighlight(unsigned int trackIdx, const std::shared_ptr<const SampleQueryResult> &result);
 
 private:
     void updateData();
     bool drawHistogram(bool updateScroll);
     void updateCurrFrameInfo();
     void showFrameInfo();
+    void showFrameCacheStats();
     void showFrameDisplay();
     bool showHistogramAndFrameInfo(bool updateScroll);
     int  seekToFrame(uint32_t frameIdx, bool seekToIFrame = false);
+    void takeDecodedFrames();
+    void showDecodedFrame(MyAVFrame &frame);
+    void updatePlayAhead(); // the frames to decode ahead follow the play position
+    void updateFrameTypePriority();
 
     int saveFrameToFile();
 
 private:
-    std::map<unsigned int /* trackIdx */, uint32_t /* frameIdx sort by pts */> mCurSelectFrame;
+    std::map<unsigned int /* trackIdx */, uint32_t /* frameIdx sort by pts */>      mCurSelectFrame;
+    std::map<unsigned int /* trackIdx */, std::shared_ptr<const SampleQueryResult>> mSampleHighlights;
 
     uint32_t mSeekToFrame = 0;
 
@@ -129,10 +145,17 @@ private:
 
     ImGui::ImGuiInputCombo mFrameRateCombo = ImGui::ImGuiInputCombo("Framerate");
 
-    bool     mIsPlaying      = false;
-    bool     mIsSeeking      = false;
-    uint64_t mLastPlayTimeMs = 0;
-    uint32_t mPlayIntervalMs = 50; // 20fps
+    bool     mIsPlaying       = false;
+    bool     mIsSeeking       = false; // till the frame sought is decoded
+    uint64_t mDecodeRequestId = 0;     // the request waiting for its frame, 0 if none
+    uint64_t mMinRequestId    = 0;     // frames of older requests belong to another file or track
+    uint64_t mShownRequestId  = 0;     // frames of requests up to it are older than the one shown
+    uint64_t mLastPlayTimeMs  = 0;
+    uint32_t mPlayIntervalMs  = 50; // 20fps
+    uint32_t mPlayAheadDepth  = 0;
+
+    std::vector<uint32_t>                                           mAheadWindow; // sample indices, last sent to the worker
+    std::map<uint32_t /* sample idx */, std::shared_ptr<MyAVFrame>> mAheadFrames; // decoded, waiting to be shown
     ImVec2   mPlayControlPanelSize;
 
     uint64_t       mLastMoveLeftTime  = 0;
@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+
+#include "logger.h"
+
+#include "BatchAnalyzer.h"
+#include "FrameTypeExtractor.h"
+#include "SampleTable.h"
+
+using std::string;
+using std::vector;
+namespace fs = std::filesystem;
+
+static const std::set<string> sMediaExtensions = {".mp4", ".m4v", ".m4a", ".mov", ".3gp", ".mj2", ".heic"};
+
+static int64_t elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool isMediaFile(const fs::path &path)
+{
+    string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+    return sMediaExtensions.count(ext) > 0;
+}
+
+static string codecName(uint32_t codecCode)
+{
+    switch (mp4GetCodecType(codecCode))
+    {
+        case MP4_CODEC_H264:
+            return "h264";
+        case MP4_CODEC_HEVC:
+            return "hevc";
+        case MP4_CODEC_MPEG4:
+            return "mpeg4";
+        case MP4_CODEC_MJPEG:
+            return "mjpeg";
+        case MP4_CODEC_JPEG2000:
+            return "jpeg2000";
+        case MP4_CODEC_MPEG1VIDEO:
+            return "mpeg1video";
+        case MP4_CODEC_MPEG2VIDEO:
+            return "mpeg2video";
+        case MP4_CODEC_VP9:
+            return "vp9";
+        default:
+            break;
+    }
+
+    // sample entry fourcc
+    string fourcc;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        char c = (char)((codecCode >> shift) & 0xFF);
+        fourcc.push_back(isprint((unsigned char)c) ? c : '.');
+    }
+    return fourcc;
+}
+
+static string jsonEscape(const string &str)
+{
+    string escaped;
+    for (char c : str)
+    {
+        switch (c)
+        {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    escaped += buf;
+                }
+                else
+                {
+                    escaped += c;
+                }
+                break;
+        }
+    }
+    return escaped;
+}
+
+static string csvEscape(const string &str)
+{
+    if (str.find_first_of(",\"\n") == string::npos)
+        return str;
+    string escaped = "\"";
+    for (char c : str)
+    {
+        if (c == '"')
+            escaped += '"';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+size_t BatchAnalyzer::collectFiles(const Options &options)
+{
+    mOptions = options;
+    mFiles.clear();
+
+    std::set<string> added;
+    auto             addFile = [&](const fs::path &path)
+    {
+        if (added.insert(path.string()).second)
+            mFiles.push_back(path.string());
+    };
+
+    for (auto &input : options.inputs)
+    {
+        std::error_code ec;
+        fs::path        path(input);
+        if (fs::is_directory(path, ec))
+        {
+            for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+                 !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (it->is_regular_file(ec) && isMediaFile(it->path()))
+                    addFile(it->path());
+            }
+        }
+        else if (fs::is_regular_file(path, ec))
+        {
+            addFile(path);
+        }
+        else
+        {
+            fprintf(stderr, "skip %s: not a file or directory\n", input.c_str());
+        }
+    }
+    return mFiles.size();
+}
+
+int BatchAnalyzer::run()
+{
+    if (mFiles.empty())
+        return 0;
+
+    std::error_code ec;
+    fs::create_directories(mOptions.outputDir, ec);
+
+    mIndexCache.setCacheDir(mOptions.indexCachePath);
+
+    int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+    int jobs            = mOptions.jobs > 0 ? mOptions.jobs : std::max(hardwareThreads / 2, 1);
+    jobs                = std::min(jobs, (int)mFiles.size());
+    // the frame type pass of every file has its own workers, don't oversubscribe the cores
+    if (mOptions.frameTypeWorkers <= 0)
+        mOptions.frameTypeWorkers = std::max(hardwareThreads / jobs, 1);
+
+    mNextFile    = 0;
+    mFailedCount = 0;
+    mDoneBytes   = 0;
+    mDoneCount   = 0;
+
+    printf("analyze %zu files with %d jobs, %d frame type workers per file\n", mFiles.size(), jobs, mOptions.frameTypeWorkers);
+
+    auto                start = std::chrono::steady_clock::now();
+    vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++)
+        workers.emplace_back(&BatchAnalyzer::workerRun, this);
+    for (auto &worker : workers)
+        worker.join();
+
+    double seconds = std::max(elapsedMs(start), (int64_t)1) / 1000.0;
+    double doneMB  = mDoneBytes / (1024.0 * 1024.0);
+    printf("%zu files, %d failed, %.1f MB in %.2f s: %.2f files/s, %.2f MB/s\n", mDoneCount.load(), mFailedCount.load(), doneMB,
+           seconds, mDoneCount / seconds, doneMB / seconds);
+    return mFailedCount;
+}
+
+void BatchAnalyzer::workerRun()
+{
+    while (1)
+    {
+        size_t fileIdx = mNextFile++;
+        if (fileIdx >= mFiles.size())
+            break;
+
+        FileSummary summary;
+        summary.filePath = mFiles[fileIdx];
+
+        // failed files get a summary too, with the error
+        int ret = analyzeFile(summary.filePath, summary);
+        if (writeSummary(summary) < 0 || ret < 0)
+            mFailedCount++;
+
+        mDoneBytes += summary.fileSize;
+        size_t doneCount = ++mDoneCount;
+
+        std::lock_guard<std::mutex> locker(mPrintLock);
+        if (summary.success)
+        {
+            printf("[%zu/%zu] %s: %zu tracks, parse %lld ms, frame type %lld ms%s\n", doneCount, mFiles.size(),
+                   summary.filePath.c_str(), summary.tracks.size(), (long long)summary.parseMs, (long long)summary.frameTypeMs,
+                   summary.fromCache ? " (cached)" : "");
+        }
+        else
+        {
+            fprintf(stderr, "[%zu/%zu] %s: %s\n", doneCount, mFiles.size(), summary.filePath.c_str(), summary.error.c_str());
+        }
+    }
+}
+
+int BatchAnalyzer::analyzeFile(const string &filePath, FileSummary &summary)
+{
+    std::error_code ec;
+    summary.fileSize = fs::file_size(filePath, ec);
+    if (ec)
+        summary.fileSize = 0;
+
+    auto start  = std::chrono::steady_clock::now();
+    auto parser = createMp4Parser();
+    parser->parse(filePath);
+    if (!parser->isParseSuccess())
+    {
+        summary.error = parser->getErrorMessage();
+        if (summary.error.empty())
+            summary.error = "parse fail";
+        return -1;
+    }
+
+    vector<Mp4TrackInfo> tracks;
+    vector<SampleTable>  tables;
+    for (auto &track : parser->getTracksInfo())
+    {
+        tracks.push_back(*track);
+        tables.emplace_back();
+        tables.back().build(*track->mediaInfo);
+    }
+    summary.parseMs = elapsedMs(start);
+
+    FrameTypeExtractor extractor;
+    if (mOptions.parseFrameType)
+    {
+        start = std::chrono::steady_clock::now();
+        extractor.setWorkerCount(mOptions.frameTypeWorkers);
+        extractor.prepare(tracks, tables);
+
+        summary.fromCache = mOptions.useIndexCache && mIndexCache.load(filePath, tracks, tables, extractor);
+        if (!summary.fromCache && extractor.extract(filePath, tracks, tables, nullptr) >= 0 && mOptions.useIndexCache)
+        {
+            std::lock_guard<std::mutex> locker(mIndexCacheLock);
+            mIndexCache.save(filePath, tracks, tables, extractor);
+        }
+        summary.frameTypeMs = elapsedMs(start);
+    }
+
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); trackIdx++)
+    {
+        auto        &track   = tracks[trackIdx];
+        auto        &samples = tables[trackIdx];
+        TrackSummary trackSummary;
+
+        trackSummary.trakIndex   = track.trakIndex;
+        trackSummary.trackType   = TRACK_TYPE_VIDEO == track.trackType   ? "video"
+                                   : TRACK_TYPE_AUDIO == track.trackType ? "audio"
+                                                                         : "other";
+        trackSummary.codec       = codecName(track.mediaInfo->codecCode);
+        trackSummary.sampleCount = samples.size();
+        for (auto size : samples.getSizes())
+            trackSummary.totalBytes += size;
+        if (!samples.empty())
+        {
+            uint32_t last           = samples.size() - 1;
+            trackSummary.durationMs = samples.dtsMs(last) + samples.dtsDeltaMs(last) - samples.dtsMs(0);
+        }
+        if (trackSummary.durationMs > 0)
+            trackSummary.bitrateKbps = trackSummary.totalBytes * 8.0 / trackSummary.durationMs;
+
+        if (TRACK_TYPE_VIDEO == track.trackType)
+        {
+            // gop: from a key frame to the next one, in decode order
+            int64_t firstKeyFrame = -1;
+            int64_t lastKeyFrame  = -1;
+            for (uint32_t i = 0; i <= samples.size(); i++)
+            {
+                if (i < samples.size() && !samples.isKeyFrame(i))
+                    continue;
+                if (lastKeyFrame >= 0)
+                {
+                    uint32_t gop        = (uint32_t)(i - lastKeyFrame);
+                    trackSummary.gopMin = trackSummary.gopMin ? std::min(trackSummary.gopMin, gop) : gop;
+                    trackSummary.gopMax = std::max(trackSummary.gopMax, gop);
+                }
+                if (i < samples.size())
+                {
+                    trackSummary.keyFrameCount++;
+                    if (firstKeyFrame < 0)
+                        firstKeyFrame = i;
+                    lastKeyFrame = i;
+                }
+            }
+            // every key frame starts a gop, the last one runs to the end of the track
+            if (trackSummary.keyFrameCount > 0)
+                trackSummary.gopAvg = (double)(samples.size() - firstKeyFrame) / trackSummary.keyFrameCount;
+
+            trackSummary.hasFrameTypes = mOptions.parseFrameType && FrameTypeExtractor::isTrackSupported(track);
+            for (uint32_t i = 0; trackSummary.hasFrameTypes && i < samples.size(); i++)
+            {
+                switch (extractor.getFrameType(trackIdx, i, samples.frameType(i)))
+                {
+                    case H26X_FRAME_I:
+                        trackSummary.frameTypeCount[0]++;
+                        break;
+                    case H26X_FRAME_P:
+                        trackSummary.frameTypeCount[1]++;
+                        break;
+                    case H26X_FRAME_B:
+                        trackSummary.frameTypeCount[2]++;
+                        break;
+                    default:
+                        trackSummary.frameTypeCount[3]++;
+                        break;
+                }
+            }
+        }
+
+        summary.tracks.push_back(std::move(trackSummary));
+    }
+
+    summary.success = true;
+    return 0;
+}
+
+int BatchAnalyzer::writeSummary(const FileSummary &summary)
+{
+    // same names in different directories must not overwrite each other
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : fs::absolute(summary.filePath).string())
+    {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3ull;
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%08x", (uint32_t)hash);
+
+    string outputPath = (fs::path(mOptions.outputDir) / fs::path(summary.filePath).stem()).string() + suffix;
+
+    int ret = 0;
+    if (mOptions.outputFormat & OUTPUT_JSON)
+        ret = std::min(ret, writeJson(summary, outputPath + ".json"));
+    if (mOptions.outputFormat & OUTPUT_CSV)
+        ret = std::min(ret, writeCsv(summary, outputPath + ".csv"));
+    return ret;
+}
+
+int BatchAnalyzer::writeJson(const FileSummary &summary, const string &outputPath)
+{
+    FILE *fp = fopen(outputPath.c_str(), "w");
+    if (!fp)
+    {
+        Z_ERR("open {} fail\n", outputPath);
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"file\": \"%s\",\n", jsonEscape(summary.filePath).c_str());
+    fprintf(fp, "  \"fileSize\": %llu,\n", (unsigned long long)summary.fileSize);
+    fprintf(fp, "  \"success\": %s,\n", summary.success ? "true" : "false");
+    if (!summary.success)
+        fprintf(fp, "  \"error\": \"%s\",\n", jsonEscape(summary.error).c_str());
+    fprintf(fp, "  \"parseMs\": %lld,\n", (long long)summary.parseMs);
+    fprintf(fp, "  \"frameTypeMs\": %lld,\n", (long long)summary.frameTypeMs);
+    fprintf(fp, "  \"frameTypeFromCache\": %s,\n", summary.fromCache ? "true" : "false");
+    fprintf(fp, "  \"tracks\": [");
+    for (size_t i = 0; i < summary.tracks.size(); i++)
+    {
+        auto &track = summary.tracks[i];
+        fprintf(fp, "%s\n    {\n", i > 0 ? "," : "");
+        fprintf(fp, "      \"trakIndex\": %u,\n", track.trakIndex);
+        fprintf(fp, "      \"type\": \"%s\",\n", track.trackType.c_str());
+        fprintf(fp, "      \"codec\": \"%s\",\n", jsonEscape(track.codec).c_str());
+        fprintf(fp, "      \"sampleCount\": %u,\n", track.sampleCount);
+        fprintf(fp, "      \"totalBytes\": %llu,\n", (unsigned long long)track.totalBytes);
+        fprintf(fp, "      \"durationMs\": %llu,\n", (unsigned long long)track.durationMs);
+        fprintf(fp, "      \"bitrateKbps\": %.3f", track.bitrateKbps);
+        if (track.trackType == "video")
+        {
+            fprintf(fp, ",\n      \"gop\": {\"keyFrames\": %u, \"min\": %u, \"max\": %u, \"avg\": %.3f}", track.keyFrameCount,
+                    track.gopMin, track.gopMax, track.gopAvg);
+            if (track.hasFrameTypes)
+            {
+                fprintf(fp, ",\n      \"frameTypes\": {\"I\": %u, \"P\": %u, \"B\": %u, \"other\": %u}", track.frameTypeCount[0],
+                        track.frameTypeCount[1], track.frameTypeCount[2], track.frameTypeCount[3]);
+            }
+        }
+        fprintf(fp, "\n    }");
+    }
+    fprintf(fp, "%s]\n}\n", summary.tracks.empty() ? "" : "\n  ");
+
+    bool writeFail = ferror(fp);
+    fclose(fp);
+    return writeFail ? -1 : 0;
+}
+
+int BatchAnalyzer::writeCsv(const FileSummary &summary, const string &outputPath)
+{
+    std::ofstream csv(outputPath, std::ios::trunc);
+    if (!csv)
+    {
+        Z_ERR("open {} fail\n", outputPath);
+        return -1;
+    }
+
+    csv << "file,trakIndex,type,codec,sampleCount,totalBytes,durationMs,bitrateKbps,keyFrames,gopMin,gopMax,gopAvg,"
+           "frameI,frameP,frameB,frameOther\n";
+    for (auto &track : summary.tracks)
+    {
+        csv << csvEscape(summary.filePath) << ',' << track.trakIndex << ',' << track.trackType << ',' << csvEscape(track.codec)
+            << ',' << track.sampleCount << ',' << track.totalBytes << ',' << track.durationMs << ',' << track.bitrateKbps << ','
+            << track.keyFrameCount << ',' << track.gopMin << ',' << track.gopMax << ',' << track.gopAvg;
+        for (auto count : track.frameTypeCount)
+            csv << ',' << (track.hasFrameTypes ? std::to_string(count) : string());
+        csv << '\n';
+    }
+    return csv.good() ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+#ifndef _BATCH_ANALYZER_H_
+#define _BATCH_ANALYZER_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "IndexCache.h"
+
+// headless analysis of many files: parse, frame type pass and a summary file per input.
+// a bounded pool of jobs takes the files in list order, every job runs its own parser and extractor
+class BatchAnalyzer
+{
+public:
+    enum OutputFormat
+    {
+        OUTPUT_JSON = 1,
+        OUTPUT_CSV  = 2,
+    };
+    struct Options
+    {
+        std::vector<std::string> inputs; // files, directories, or list files given with -l
+        std::string              outputDir        = ".";
+        int                      outputFormat     = OUTPUT_JSON;
+        int                      jobs             = 0; // files at once, <= 0: auto
+        int                      frameTypeWorkers = 0; // per file, <= 0: share the cores between jobs
+        bool                     parseFrameType   = true;
+        bool                     useIndexCache    = true;
+        std::string              indexCachePath;
+    };
+
+    BatchAnalyzer() {}
+
+    // expand directories and list files, return count of media files found
+    size_t collectFiles(const Options &options);
+    // return count of failed files
+    int run();
+
+private:
+    struct TrackSummary
+    {
+        uint32_t    trakIndex = 0;
+        std::string trackType;
+        std::string codec;
+        uint32_t    sampleCount = 0;
+        uint64_t    totalBytes  = 0;
+        uint64_t    durationMs  = 0;
+        double      bitrateKbps = 0;
+
+        // video only
+        uint32_t keyFrameCount = 0;
+        uint32_t gopMin        = 0;
+        uint32_t gopMax        = 0;
+        double   gopAvg        = 0;
+        bool     hasFrameTypes = false;
+        uint32_t frameTypeCount[4]{}; // I, P, B, other
+    };
+    struct FileSummary
+    {
+        std::string               filePath;
+        uint64_t                  fileSize = 0;
+        bool                      success  = false;
+        std::string               error;
+        int64_t                   parseMs     = 0;
+        int64_t                   frameTypeMs = 0;
+        bool                      fromCache   = false;
+        std::vector<TrackSummary> tracks;
+    };
+
+    void workerRun();
+    int  analyzeFile(const std::string &filePath, FileSummary &summary);
+    int  writeSummary(const FileSummary &summary);
+    int  writeJson(const FileSummary &summary, const std::string &outputPath);
+    int  writeCsv(const FileSummary &summary, const std::string &outputPath);
+
+private:
+    Options                  mOptions;
+    std::vector<std::string> mFiles;
+    std::atomic<size_t>      mNextFile{0};
+
+    std::atomic<int>      mFailedCount{0};
+    std::atomic<uint64_t> mDoneBytes{0};
+    std::atomic<size_t>   mDoneCount{0};
+
+    IndexCache mIndexCache;
+    std::mutex mIndexCacheLock; // save trims the cache dir, one at a time
+    std::mutex mPrintLock;
+};
+
+#endif
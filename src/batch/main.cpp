@@ -0,0 +1,129 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "BatchAnalyzer.h"
+#include "Mp4Parse.h"
+
+using std::string;
+
+static void usage(const char *name)
+{
+    printf("usage: %s [options] <file|directory>...\n"
+           "  -l <list>       read input paths from a text file, one per line\n"
+           "  -o <dir>        directory of the summaries, default: current directory\n"
+           "  -f <format>     json, csv or both, default: json\n"
+           "  -j <jobs>       files analyzed at once, default: half of the cores\n"
+           "  -w <workers>    frame type workers per file, default: cores / jobs\n"
+           "  --no-frame-type skip the frame type pass\n"
+           "  --no-cache      don't read or write the index cache\n"
+           "  --cache <dir>   index cache directory, default: system temp dir\n",
+           name);
+}
+
+static int readListFile(const string &listPath, BatchAnalyzer::Options &options)
+{
+    std::ifstream list(listPath);
+    if (!list)
+    {
+        fprintf(stderr, "open list %s fail\n", listPath.c_str());
+        return -1;
+    }
+    string line;
+    while (std::getline(list, line))
+    {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+            line.pop_back();
+        if (!line.empty() && line[0] != '#')
+            options.inputs.push_back(line);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BatchAnalyzer::Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg     = argv[i];
+        bool   hasNext = i + 1 < argc;
+        if (arg == "-l" && hasNext)
+        {
+            if (readListFile(argv[++i], options) < 0)
+                return EXIT_FAILURE;
+        }
+        else if (arg == "-o" && hasNext)
+        {
+            options.outputDir = argv[++i];
+        }
+        else if (arg == "-f" && hasNext)
+        {
+            string format = argv[++i];
+            if (format == "json")
+                options.outputFormat = BatchAnalyzer::OUTPUT_JSON;
+            else if (format == "csv")
+                options.outputFormat = BatchAnalyzer::OUTPUT_CSV;
+            else if (format == "both")
+                options.outputFormat = BatchAnalyzer::OUTPUT_JSON | BatchAnalyzer::OUTPUT_CSV;
+            else
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "-j" && hasNext)
+        {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if (arg == "-w" && hasNext)
+        {
+            options.frameTypeWorkers = atoi(argv[++i]);
+        }
+        else if (arg == "--no-frame-type")
+        {
+            options.parseFrameType = false;
+        }
+        else if (arg == "--no-cache")
+        {
+            options.useIndexCache = false;
+        }
+        else if (arg == "--cache" && hasNext)
+        {
+            options.indexCachePath = argv[++i];
+        }
+        else if (arg == "-h" || arg == "--help" || arg[0] == '-')
+        {
+            usage(argv[0]);
+            return arg[0] == '-' && arg != "-h" && arg != "--help" ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        else
+        {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (options.inputs.empty())
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // only errors of the parser, the summaries are the output
+    setMp4ParseLogCallback(
+        [](MP4_LOG_LEVEL_E level, const char *msg)
+        {
+            if (MP4_LOG_LEVEL_ERR == level)
+                fprintf(stderr, "%s", msg);
+        });
+
+    BatchAnalyzer analyzer;
+    if (0 == analyzer.collectFiles(options))
+    {
+        fprintf(stderr, "no media file found\n");
+        return EXIT_FAILURE;
+    }
+    return analyzer.run() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
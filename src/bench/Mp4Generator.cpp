@@ -0,0 +1,388 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "logger.h"
+
+#include "Mp4Generator.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+}
+
+using std::string;
+using std::vector;
+
+#define AUDIO_SAMPLE_RATE (48000)
+#define TONE_PI           (3.14159265358979323846)
+
+struct EncodeStream
+{
+    AVCodecContext *codecCtx = nullptr;
+    AVStream       *stream   = nullptr;
+    AVFrame        *frame    = nullptr;
+    int64_t         nextPts  = 0; // in codec time base
+    int64_t         endPts   = 0;
+    int             seed     = 0; // pattern differs between tracks
+    bool            isVideo  = false;
+
+    ~EncodeStream()
+    {
+        avcodec_free_context(&codecCtx);
+        av_frame_free(&frame);
+    }
+};
+
+static int openVideo(AVFormatContext *fmtCtx, const CorpusSpec &spec, EncodeStream &es)
+{
+    const AVCodec *codec = avcodec_find_encoder(spec.videoCodec);
+    if (!codec)
+    {
+        Z_INFO("no encoder of {}, use mpeg4\n", avcodec_get_name(spec.videoCodec));
+        codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
+    if (!codec)
+        return -1;
+
+    auto ctx          = avcodec_alloc_context3(codec);
+    es.codecCtx       = ctx;
+    ctx->width        = spec.width;
+    ctx->height       = spec.height;
+    ctx->time_base    = AVRational{1, spec.fps};
+    ctx->framerate    = AVRational{spec.fps, 1};
+    ctx->gop_size     = spec.gopSize;
+    ctx->keyint_min   = spec.gopSize;
+    ctx->max_b_frames = spec.bFrames;
+    ctx->pix_fmt      = AV_PIX_FMT_YUV420P;
+    ctx->thread_count = 1; // threaded encoders are not bit exact
+    ctx->flags |= AV_CODEC_FLAG_BITEXACT;
+    if (fmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    // fixed gop: no key frames on scene changes
+    if (0 == strcmp(codec->name, "libx264"))
+    {
+        av_opt_set(ctx->priv_data, "preset", "veryfast", 0);
+        av_opt_set(ctx->priv_data, "x264-params", "scenecut=0", 0);
+    }
+    else if (0 == strcmp(codec->name, "libx265"))
+    {
+        av_opt_set(ctx->priv_data, "preset", "veryfast", 0);
+        av_opt_set(ctx->priv_data, "x265-params", "scenecut=0:log-level=error", 0);
+    }
+
+    int ret = avcodec_open2(ctx, codec, nullptr);
+    if (ret < 0)
+        return ret;
+
+    es.isVideo = true;
+    es.endPts  = spec.frameCount;
+    es.frame   = av_frame_alloc();
+
+    es.frame->width  = ctx->width;
+    es.frame->height = ctx->height;
+    es.frame->format = ctx->pix_fmt;
+    ret              = av_frame_get_buffer(es.frame, 0);
+    if (ret < 0)
+        return ret;
+
+    es.stream            = avformat_new_stream(fmtCtx, nullptr);
+    es.stream->time_base = ctx->time_base;
+    return avcodec_parameters_from_context(es.stream->codecpar, ctx);
+}
+
+static int openAudio(AVFormatContext *fmtCtx, const CorpusSpec &spec, EncodeStream &es)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec)
+        return -1;
+
+    auto ctx         = avcodec_alloc_context3(codec);
+    es.codecCtx      = ctx;
+    ctx->sample_fmt  = AV_SAMPLE_FMT_FLTP;
+    ctx->sample_rate = AUDIO_SAMPLE_RATE;
+    ctx->bit_rate    = 128000;
+    ctx->time_base   = AVRational{1, AUDIO_SAMPLE_RATE};
+    ctx->flags |= AV_CODEC_FLAG_BITEXACT;
+    av_channel_layout_default(&ctx->ch_layout, 2);
+    if (fmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    int ret = avcodec_open2(ctx, codec, nullptr);
+    if (ret < 0)
+        return ret;
+
+    es.endPts = (int64_t)spec.frameCount * AUDIO_SAMPLE_RATE / spec.fps;
+    es.frame  = av_frame_alloc();
+
+    es.frame->nb_samples  = ctx->frame_size;
+    es.frame->format      = ctx->sample_fmt;
+    es.frame->sample_rate = ctx->sample_rate;
+    av_channel_layout_copy(&es.frame->ch_layout, &ctx->ch_layout);
+    ret = av_frame_get_buffer(es.frame, 0);
+    if (ret < 0)
+        return ret;
+
+    es.stream            = avformat_new_stream(fmtCtx, nullptr);
+    es.stream->time_base = ctx->time_base;
+    return avcodec_parameters_from_context(es.stream->codecpar, ctx);
+}
+
+// a gradient moving with the frame index and a block jumping every second, both only depend on pts
+static void fillVideoFrame(EncodeStream &es)
+{
+    auto    frame = es.frame;
+    int64_t pts   = es.nextPts;
+    av_frame_make_writable(frame);
+
+    int blockSize = frame->height / 4;
+    int blockX    = (int)((pts / es.codecCtx->framerate.num * 97 + es.seed * 31) % (frame->width - blockSize));
+    int blockY    = (int)((pts / es.codecCtx->framerate.num * 57 + es.seed * 17) % (frame->height - blockSize));
+    for (int y = 0; y < frame->height; y++)
+    {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++)
+        {
+            bool inBlock = x >= blockX && x < blockX + blockSize && y >= blockY && y < blockY + blockSize;
+            line[x]      = inBlock ? 235 : (uint8_t)(x + y + pts * 3 + es.seed * 40);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++)
+    {
+        for (int y = 0; y < frame->height / 2; y++)
+        {
+            uint8_t *line = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < frame->width / 2; x++)
+                line[x] = (uint8_t)(128 + ((x * plane + y + pts) & 0x3F) - 32);
+        }
+    }
+    frame->pts = pts;
+    es.nextPts++;
+}
+
+static void fillAudioFrame(EncodeStream &es)
+{
+    auto frame = es.frame;
+    av_frame_make_writable(frame);
+
+    double frequency = 440.0 * (1 + es.seed);
+    for (int ch = 0; ch < frame->ch_layout.nb_channels; ch++)
+    {
+        float *samples = (float *)frame->data[ch];
+        for (int i = 0; i < frame->nb_samples; i++)
+            samples[i] = (float)(0.3 * sin(2 * TONE_PI * frequency * (double)(es.nextPts + i) / AUDIO_SAMPLE_RATE));
+    }
+    frame->pts = es.nextPts;
+    es.nextPts += frame->nb_samples;
+}
+
+static int encodeAndWrite(AVFormatContext *fmtCtx, EncodeStream &es, AVFrame *frame)
+{
+    int ret = avcodec_send_frame(es.codecCtx, frame);
+    if (ret < 0)
+        return ret;
+
+    AVPacket *packet = av_packet_alloc();
+    while (ret >= 0)
+    {
+        ret = avcodec_receive_packet(es.codecCtx, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        {
+            ret = 0;
+            break;
+        }
+        if (ret < 0)
+            break;
+        av_packet_rescale_ts(packet, es.codecCtx->time_base, es.stream->time_base);
+        packet->stream_index = es.stream->index;
+        ret                  = av_interleaved_write_frame(fmtCtx, packet);
+    }
+    av_packet_free(&packet);
+    return ret;
+}
+
+static uint32_t readU32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void writeU32(vector<uint8_t> &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((uint8_t)(value >> shift));
+}
+
+// copy a box, container boxes on the way to stbl are copied recursively, stco is written as co64
+static int rewriteBox(const uint8_t *data, uint64_t size, vector<uint8_t> &out)
+{
+    static const char *containers[] = {"moov", "trak", "mdia", "minf", "stbl"};
+
+    if (size < 8 || readU32(data) != size)
+        return -1;
+
+    if (0 == memcmp(data + 4, "stco", 4))
+    {
+        if (size < 16)
+            return -1;
+        uint32_t entryCount = readU32(data + 12);
+        if (16 + (uint64_t)entryCount * 4 > size)
+            return -1;
+
+        writeU32(out, 16 + entryCount * 8);
+        out.insert(out.end(), {'c', 'o', '6', '4'});
+        out.insert(out.end(), data + 8, data + 16);
+        for (uint32_t i = 0; i < entryCount; i++)
+        {
+            writeU32(out, 0);
+            out.insert(out.end(), data + 16 + i * 4, data + 20 + i * 4);
+        }
+        return 0;
+    }
+
+    bool isContainer = false;
+    for (auto type : containers)
+        isContainer |= 0 == memcmp(data + 4, type, 4);
+    if (!isContainer)
+    {
+        out.insert(out.end(), data, data + size);
+        return 0;
+    }
+
+    size_t headerPos = out.size();
+    out.insert(out.end(), data, data + 8);
+    for (uint64_t offset = 8; offset + 8 <= size;)
+    {
+        uint32_t subSize = readU32(data + offset);
+        if (subSize < 8 || offset + subSize > size || rewriteBox(data + offset, subSize, out) < 0)
+            return -1;
+        offset += subSize;
+    }
+    uint32_t newSize = (uint32_t)(out.size() - headerPos);
+    for (int i = 0; i < 4; i++)
+        out[headerPos + i] = (uint8_t)(newSize >> (24 - i * 8));
+    return 0;
+}
+
+// the muxer writes moov after mdat, a bigger moov moves no sample data
+static int convertToCo64(const string &filePath)
+{
+    std::ifstream input(filePath, std::ios::binary);
+    vector<uint8_t> content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+
+    for (uint64_t offset = 0; offset + 8 <= content.size();)
+    {
+        uint64_t size       = readU32(content.data() + offset);
+        uint32_t headerSize = 8;
+        if (1 == size && offset + 16 <= content.size())
+        {
+            size       = ((uint64_t)readU32(content.data() + offset + 8) << 32) | readU32(content.data() + offset + 12);
+            headerSize = 16;
+        }
+        else if (0 == size)
+        {
+            size = content.size() - offset;
+        }
+        if (size < headerSize || offset + size > content.size())
+            return -1;
+
+        if (0 == memcmp(content.data() + offset + 4, "moov", 4))
+        {
+            if (offset + size != content.size())
+            {
+                Z_ERR("moov is not the last box of {}\n", filePath);
+                return -1;
+            }
+            vector<uint8_t> moov;
+            if (rewriteBox(content.data() + offset, size, moov) < 0)
+                return -1;
+
+            std::ofstream output(filePath, std::ios::binary | std::ios::trunc);
+            output.write((const char *)content.data(), (std::streamsize)offset);
+            output.write((const char *)moov.data(), (std::streamsize)moov.size());
+            return output.good() ? 0 : -1;
+        }
+        offset += size;
+    }
+    return -1;
+}
+
+int generateMp4(const string &filePath, const CorpusSpec &spec)
+{
+    AVFormatContext *fmtCtx = nullptr;
+    int              ret    = avformat_alloc_output_context2(&fmtCtx, nullptr, "mp4", filePath.c_str());
+    if (ret < 0)
+        return ret;
+    fmtCtx->flags |= AVFMT_FLAG_BITEXACT;
+
+    vector<std::unique_ptr<EncodeStream>> streams;
+    for (int i = 0; i < spec.videoTracks + spec.audioTracks && ret >= 0; i++)
+    {
+        streams.push_back(std::make_unique<EncodeStream>());
+        streams.back()->seed = i;
+        ret = i < spec.videoTracks ? openVideo(fmtCtx, spec, *streams.back()) : openAudio(fmtCtx, spec, *streams.back());
+    }
+
+    AVDictionary *options = nullptr;
+    if (spec.fragmented)
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+
+    if (ret >= 0)
+        ret = avio_open(&fmtCtx->pb, filePath.c_str(), AVIO_FLAG_WRITE);
+    if (ret >= 0)
+        ret = avformat_write_header(fmtCtx, &options);
+    av_dict_free(&options);
+
+    // always feed the stream which is furthest behind, so the packets interleave like a recorder's
+    while (ret >= 0)
+    {
+        EncodeStream *next = nullptr;
+        for (auto &es : streams)
+        {
+            if (es->nextPts >= es->endPts)
+                continue;
+            if (!next || av_compare_ts(es->nextPts, es->codecCtx->time_base, next->nextPts, next->codecCtx->time_base) < 0)
+                next = es.get();
+        }
+        if (!next)
+            break;
+
+        if (next->isVideo)
+            fillVideoFrame(*next);
+        else
+            fillAudioFrame(*next);
+        ret = encodeAndWrite(fmtCtx, *next, next->frame);
+    }
+
+    for (auto &es : streams)
+    {
+        if (ret >= 0 && es->codecCtx)
+            ret = encodeAndWrite(fmtCtx, *es, nullptr);
+    }
+
+    if (ret >= 0)
+        ret = av_write_trailer(fmtCtx);
+    if (fmtCtx->pb)
+        avio_closep(&fmtCtx->pb);
+    avformat_free_context(fmtCtx);
+
+    if (ret < 0)
+    {
+        Z_ERR("generate {} fail: {}\n", filePath, ret);
+        return ret;
+    }
+
+    if (spec.co64 && !spec.fragmented && convertToCo64(filePath) < 0)
+    {
+        Z_ERR("convert {} to co64 fail\n", filePath);
+        return -1;
+    }
+    return 0;
+}
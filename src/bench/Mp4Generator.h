@@ -0,0 +1,31 @@
+#ifndef _MP4_GENERATOR_H_
+#define _MP4_GENERATOR_H_
+
+#include <string>
+
+extern "C"
+{
+#include <libavcodec/codec_id.h>
+}
+
+// layout of one synthetic test file, the same spec always gives the same bytes
+struct CorpusSpec
+{
+    std::string name;
+    AVCodecID   videoCodec  = AV_CODEC_ID_H264; // falls back to mpeg4 if the encoder is missing
+    int         width       = 640;
+    int         height      = 360;
+    int         fps         = 30;
+    int         frameCount  = 300;
+    int         gopSize     = 30;
+    int         bFrames     = 0;
+    int         videoTracks = 1;
+    int         audioTracks = 0;
+    bool        fragmented  = false; // moof per key frame
+    bool        co64        = false; // chunk offsets rewritten as 64 bits
+};
+
+// encode with the bundled libavcodec and mux with libavformat
+int generateMp4(const std::string &filePath, const CorpusSpec &spec);
+
+#endif
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Mp4ParseData.h"
+#include "AppConfigure.h"
+#include "Mp4Generator.h"
+#include "NaluScanner.h"
+#include "Trace.h"
+
+#define NALU_SCAN_STREAM_SIZE (64 * 1024 * 1024)
+
+using std::string;
+using std::vector;
+namespace fs = std::filesystem;
+
+// same files on every machine, so runs can be compared
+static vector<CorpusSpec> sCorpus = {
+    {"h264_gop30", AV_CODEC_ID_H264, 640, 360, 30, 600, 30, 0, 1, 0, false, false},
+    {"h264_gop120_b2", AV_CODEC_ID_H264, 640, 360, 30, 600, 120, 2, 1, 0, false, false},
+    {"h264_gop60_b3_2video_1audio", AV_CODEC_ID_H264, 640, 360, 30, 600, 60, 3, 2, 1, false, false},
+    {"h264_gop30_b2_fragmented", AV_CODEC_ID_H264, 640, 360, 30, 600, 30, 2, 1, 1, true, false},
+    {"h264_gop60_b2_co64", AV_CODEC_ID_H264, 640, 360, 30, 600, 60, 2, 1, 1, false, true},
+    {"hevc_gop60_b2", AV_CODEC_ID_HEVC, 640, 360, 30, 600, 60, 2, 1, 0, false, false},
+    {"h264_1080p_intra", AV_CODEC_ID_H264, 1920, 1080, 30, 60, 1, 0, 1, 0, false, false},
+    {"audio_only", AV_CODEC_ID_H264, 640, 360, 30, 9000, 30, 0, 0, 1, false, false},
+};
+
+struct BenchResult
+{
+    string  file;
+    string  scenario;
+    int     runs  = 0;
+    int64_t items = 0; // frames, samples or seeks handled in one run
+    int64_t bytes = 0; // bytes handled in one run, 0 if it's not a throughput scenario
+    double  minMs = 0;
+    double  avgMs = 0;
+    double  maxMs = 0;
+};
+
+static double nowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void waitParseData()
+{
+    while (getMp4DataShare().isRunning())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static void addResult(const string &file, const string &scenario, int64_t items, int64_t bytes, const vector<double> &costs,
+                      vector<BenchResult> &results)
+{
+    if (costs.empty())
+        return;
+
+    BenchResult result;
+    result.file     = file;
+    result.scenario = scenario;
+    result.items    = items;
+    result.bytes    = bytes;
+    result.runs     = (int)costs.size();
+    result.minMs    = *std::min_element(costs.begin(), costs.end());
+    result.maxMs    = *std::max_element(costs.begin(), costs.end());
+    for (auto costMs : costs)
+        result.avgMs += costMs / costs.size();
+    results.push_back(result);
+
+    printf("%-32s %-20s %8.2f ms (min %8.2f, max %8.2f)", file.c_str(), scenario.c_str(), result.avgMs, result.minMs,
+           result.maxMs);
+    if (items > 0)
+        printf(", %.1f items/s", items * 1000.0 / std::max(result.avgMs, 0.001));
+    if (bytes > 0)
+        printf(", %.2f GB/s", bytes / (std::max(result.avgMs, 0.001) * 1000.0 * 1000.0));
+    printf("\n");
+}
+
+// run() returns false when the scenario fails, nothing is recorded then
+static bool measure(const string &file, const string &scenario, int runs, int64_t items, int64_t bytes,
+                    const std::function<bool()> &run, vector<BenchResult> &results)
+{
+    vector<double> costs;
+    for (int i = 0; i < runs; i++)
+    {
+        double start = nowMs();
+        if (!run())
+            return false;
+        costs.push_back(nowMs() - start);
+    }
+    addResult(file, scenario, items, bytes, costs, results);
+    return true;
+}
+
+static bool openFile(const string &filePath)
+{
+    auto &data = getMp4DataShare();
+    data.clear();
+    data.toParseFilePath = filePath;
+    if (data.startParse(OPERATION_PARSE_FILE) < 0)
+        return false;
+    waitParseData();
+    return data.dataAvailable;
+}
+
+static bool parseFrameTypes()
+{
+    if (getMp4DataShare().startParse(OPERATION_PARSE_FRAME_TYPE) < 0)
+        return false;
+    waitParseData();
+    return true;
+}
+
+static bool hasFrameTypeTrack()
+{
+    for (auto &track : getMp4DataShare().tracksInfo)
+    {
+        if (FrameTypeExtractor::isTrackSupported(track))
+            return true;
+    }
+    return false;
+}
+
+// start code scan over the key frames, once with every implementation the cpu supports
+static void runNaluScan(const string &name, uint32_t trackIdx, int runs, vector<BenchResult> &results)
+{
+    auto &data    = getMp4DataShare();
+    auto &samples = data.tracksSamples[trackIdx];
+
+    vector<uint8_t> stream;
+    for (uint32_t i = 0; i < samples.size() && stream.size() < NALU_SCAN_STREAM_SIZE; i++)
+    {
+        if (!samples.isKeyFrame(i))
+            continue;
+        Mp4VideoFrame frame;
+        if (data.getVideoSample(trackIdx, i, frame) < 0)
+            return;
+        stream.insert(stream.end(), frame.sampleData.get(), frame.sampleData.get() + frame.dataSize);
+    }
+    if (stream.empty())
+        return;
+
+    // repeated up to a size where one run is well above the timer resolution
+    size_t keyFramesSize = stream.size();
+    size_t repeatCount   = (NALU_SCAN_STREAM_SIZE + keyFramesSize - 1) / keyFramesSize;
+    stream.resize(keyFramesSize * repeatCount);
+    for (size_t i = 1; i < repeatCount; i++)
+        memcpy(stream.data() + keyFramesSize * i, stream.data(), keyFramesSize);
+
+    bool             isHevc = MP4_CODEC_HEVC == mp4GetCodecType(data.tracksInfo[trackIdx].mediaInfo->codecCode);
+    vector<NaluSpan> nalus;
+    NaluScanIsa      defaultIsa = getNaluScanIsa();
+    for (int isa = NALU_SCAN_SCALAR; isa <= getSupportedNaluScanIsa(); isa++)
+    {
+        setNaluScanIsa((NaluScanIsa)isa);
+        scanAnnexBNalus(stream.data(), stream.size(), isHevc, nalus);
+        measure(
+            name, string("nalu_scan_") + getNaluScanIsaName((NaluScanIsa)isa), runs, (int64_t)nalus.size(),
+            (int64_t)stream.size(), [&]() { return scanAnnexBNalus(stream.data(), stream.size(), isHevc, nalus) > 0; },
+            results);
+    }
+    setNaluScanIsa(defaultIsa);
+}
+
+static void runScenarios(const string &name, const string &filePath, int runs, vector<BenchResult> &results)
+{
+    auto &data = getMp4DataShare();
+    if (!openFile(filePath))
+    {
+        fprintf(stderr, "parse %s fail\n", filePath.c_str());
+        return;
+    }
+
+    int64_t sampleCount = 0;
+    for (auto &samples : data.tracksSamples)
+        sampleCount += samples.size();
+
+    measure(name, "parse", runs, sampleCount, 0, [&filePath]() { return openFile(filePath); }, results);
+
+    if (hasFrameTypeTrack())
+    {
+        getAppConfigure().useIndexCache = false;
+        measure(name, "frame_type", runs, sampleCount, 0, parseFrameTypes, results);
+
+        // first pass writes the cache entry
+        getAppConfigure().useIndexCache = true;
+        parseFrameTypes();
+        measure(name, "frame_type_cached", runs, sampleCount, 0, parseFrameTypes, results);
+    }
+
+    if (data.videoTracksIdx.empty())
+        return;
+
+    uint32_t trackIdx   = data.videoTracksIdx[0];
+    auto    &ptsList    = data.tracksFramePtsList[(int)trackIdx];
+    uint32_t frameCount = (uint32_t)ptsList.size();
+    if (0 == frameCount)
+        return;
+
+    if (FrameTypeExtractor::isTrackSupported(data.tracksInfo[trackIdx]))
+        runNaluScan(name, trackIdx, runs, results);
+
+    // decode in display order from the start
+    uint32_t  sequentialCount = std::min<uint32_t>(frameCount, 300);
+    MyAVFrame frame;
+    measure(
+        name, "sequential_decode", runs, sequentialCount, 0,
+        [&]()
+        {
+            data.recreateDecoder();
+            for (uint32_t i = 0; i < sequentialCount; i++)
+            {
+                if (data.decodeFrameAt(trackIdx, ptsList[i], frame, {}) < 0)
+                    return false;
+            }
+            return true;
+        },
+        results);
+
+    // random access, the positions come from a fixed seed
+    vector<uint32_t> seekTargets;
+    uint32_t         seed = 12345;
+    for (int i = 0; i < 20; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        seekTargets.push_back(ptsList[(seed >> 8) % frameCount]);
+    }
+    measure(
+        name, "seek_decode", runs, (int64_t)seekTargets.size(), 0,
+        [&]()
+        {
+            data.recreateDecoder();
+            for (auto target : seekTargets)
+            {
+                uint32_t keyFrameIdx = 0;
+                if (data.seekToFrame(trackIdx, target, keyFrameIdx) == Mp4ParseData::SeekFail
+                    || data.decodeFrameAt(trackIdx, target, frame, {}) < 0)
+                    return false;
+            }
+            return true;
+        },
+        results);
+
+    // same frame twice, only the second one is timed, it comes from the decoded frame cache
+    vector<double> cachedCosts;
+    for (int i = 0; i < runs; i++)
+    {
+        double costMs = 0;
+        for (auto target : seekTargets)
+        {
+            if (data.decodeFrameAt(trackIdx, target, frame, {}) < 0)
+                return;
+            double start = nowMs();
+            if (data.decodeFrameAt(trackIdx, target, frame, {}) < 0)
+                return;
+            costMs += nowMs() - start;
+        }
+        cachedCosts.push_back(costMs);
+    }
+    addResult(name, "cached_decode", (int64_t)seekTargets.size(), 0, cachedCosts, results);
+}
+
+static int writeResults(const string &outputPath, int runs, const vector<BenchResult> &results)
+{
+    FILE *fp = fopen(outputPath.c_str(), "w");
+    if (!fp)
+    {
+        fprintf(stderr, "open %s fail\n", outputPath.c_str());
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"version\": 2,\n  \"time\": %lld,\n  \"hardwareThreads\": %u,\n  \"naluScanIsa\": \"%s\",\n",
+            (long long)time(nullptr), std::thread::hardware_concurrency(), getNaluScanIsaName(getSupportedNaluScanIsa()));
+    fprintf(fp, "  \"runs\": %d,\n  \"results\": [", runs);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        auto &result = results[i];
+        fprintf(fp,
+                "%s\n    {\"file\": \"%s\", \"scenario\": \"%s\", \"runs\": %d, \"items\": %lld, \"bytes\": %lld, "
+                "\"minMs\": %.3f, \"avgMs\": %.3f, \"maxMs\": %.3f}",
+                i > 0 ? "," : "", result.file.c_str(), result.scenario.c_str(), result.runs, (long long)result.items,
+                (long long)result.bytes, result.minMs, result.avgMs, result.maxMs);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    string corpusDir  = "bench_corpus";
+    string outputPath = "bench_results.json";
+    string filter;
+    string tracePath;
+    int    runs       = 3;
+    bool   regenerate = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg     = argv[i];
+        bool   hasNext = i + 1 < argc;
+        if (arg == "-d" && hasNext)
+            corpusDir = argv[++i];
+        else if (arg == "-o" && hasNext)
+            outputPath = argv[++i];
+        else if (arg == "-n" && hasNext)
+            runs = std::max(atoi(argv[++i]), 1);
+        else if (arg == "-f" && hasNext)
+            filter = argv[++i];
+        else if (arg == "-t" && hasNext)
+            tracePath = argv[++i];
+        else if (arg == "--regen")
+            regenerate = true;
+        else
+        {
+            printf("usage: %s [-d corpus_dir] [-o results.json] [-n runs] [-f name_filter] [-t trace.json] [--regen]\n",
+                   argv[0]);
+            return arg == "-h" || arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // software decode and a private index cache, nothing from the user's setup affects the numbers
+    auto &configure          = getAppConfigure();
+    configure.hardwareDecode = -1;
+    configure.indexCachePath = (fs::path(corpusDir) / "index_cache").u8string();
+    getMp4DataShare().init(
+        [](MP4_LOG_LEVEL_E level, const char *msg)
+        {
+            if (MP4_LOG_LEVEL_ERR == level)
+                fprintf(stderr, "%s", msg);
+        });
+
+    std::error_code ec;
+    fs::create_directories(corpusDir, ec);
+    if (!tracePath.empty())
+        Trace::setEnabled(true);
+
+    vector<BenchResult> results;
+    for (auto &spec : sCorpus)
+    {
+        if (!filter.empty() && spec.name.find(filter) == string::npos)
+            continue;
+
+        string filePath = (fs::path(corpusDir) / (spec.name + ".mp4")).u8string();
+        if (regenerate || !fs::exists(filePath, ec))
+        {
+            double start = nowMs();
+            if (generateMp4(filePath, spec) < 0)
+            {
+                fprintf(stderr, "generate %s fail\n", filePath.c_str());
+                continue;
+            }
+            printf("generated %s in %.0f ms\n", filePath.c_str(), nowMs() - start);
+        }
+        runScenarios(spec.name, filePath, runs, results);
+    }
+    getMp4DataShare().clear();
+
+    if (!tracePath.empty())
+    {
+        Trace::setEnabled(false);
+        int spanCount = Trace::exportChromeJson(tracePath);
+        if (spanCount < 0)
+            fprintf(stderr, "write trace %s fail\n", tracePath.c_str());
+        else
+            printf("%d trace spans written to %s\n", spanCount, tracePath.c_str());
+    }
+
+    if (writeResults(outputPath, runs, results) < 0)
+        return EXIT_FAILURE;
+    printf("results written to %s\n", outputPath.c_str());
+    return EXIT_SUCCESS;
+}